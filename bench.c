@@ -0,0 +1,847 @@
+// micro-benchmarks for the editor core, built and run by make bench
+//
+// te.c is included as is, with its main renamed, so the benchmarks call the
+// very same functions the editor uses, there is no terminal involved, the
+// screen size is made up and the frames go into a sink that only counts them
+//
+// every size runs in its own child process, so the peak RSS reported belongs
+// to that size only, the results are printed as one JSON object per line:
+//
+//   {"size":1048576,"op":"insert_char","iters":20000,"ns_per_op":153.2,
+//    "allocs_per_op":1.00,"bytes_per_op":0,"peak_rss_kb":10240}
+//
+// usage: te_bench [size...], sizes like 1K, 64M or 1G, the default is below
+
+#define main te_main
+#include "te.c"
+#undef main
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_ROWS 50
+#define BENCH_COLS 160
+#define BENCH_TIME_NS 300000000LL // how long each op is repeated at most
+
+// --- ALLOCATION COUNTING ---
+// the Makefile links with -Wl,--wrap, so every malloc, calloc and realloc
+// made by te.c comes through here, allocations libc makes on its own behalf
+// (getline, strdup) are not counted
+
+long bench_allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  bench_allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  bench_allocs++;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  bench_allocs++;
+  return __real_realloc(ptr, size);
+}
+
+// --- HELPERS ---
+
+long long bench_frame_bytes = 0;
+
+void benchSink(const char *s, int len) {
+  (void)s;
+  bench_frame_bytes += len; // frames are counted, never written anywhere
+}
+
+long long benchNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long benchPeakRss() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss; // in KB on linux
+}
+
+size_t benchParseSize(const char *s) {
+  char *end;
+  size_t n = strtoull(s, &end, 10);
+
+  switch (*end) {
+  case 'k':
+  case 'K':
+    return n << 10;
+  case 'm':
+  case 'M':
+    return n << 20;
+  case 'g':
+  case 'G':
+    return n << 30;
+  }
+
+  return n;
+}
+
+void benchGenerate(const char *path, size_t size) {
+  // writes a C-looking file of about size bytes, with keywords, strings,
+  // numbers, comments and tabs, so highlighting has something to do
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    perror(path);
+    exit(1);
+  }
+
+  size_t written = 0;
+  int i = 0;
+
+  while (written < size) {
+    int n;
+    switch (i % 6) {
+    case 0:
+      n = fprintf(fp, "static int func_%d(int x, char *s) {\n", i);
+      break;
+    case 1:
+      n = fprintf(fp, "\t/* multiline comment %d\n", i);
+      break;
+    case 2:
+      n = fprintf(fp, "\t   still inside it */\n");
+      break;
+    case 3:
+      n = fprintf(fp, "\tif (x > %d) s = \"string number %d\";\n", i, i);
+      break;
+    case 4:
+      n = fprintf(fp, "\treturn x * %d + 42; // trailing comment\n", i);
+      break;
+    default:
+      n = fprintf(fp, "}\n");
+      break;
+    }
+
+    written += n;
+    i++;
+  }
+
+  fclose(fp);
+}
+
+// --- LEGACY HIGHLIGHTER ---
+// the highlighter te.c had before the table-driven lexer, kept verbatim as the
+// reference the lexer is checked against and compared with
+
+int legacyHighlightRow(erow *row, int in_comment) {
+  // fills row->hl (which must already have room for rsize bytes) for the
+  // contents of row->render, in_comment tells if the row starts inside a
+  // multiline comment, returns 1 if a multiline comment is still open at the
+  // end of the row
+  memset(row->hl, HL_NORMAL,
+         row->rsize); // set all character to be HL_NORMAL by default
+
+  if (E.syntax == NULL)
+    return 0;
+
+  char **keywords = E.syntax->keywords;
+
+  char *scs = E.syntax->singleline_comment_start;
+  char *mcs = E.syntax->multiline_comment_start; // multiline_comment_start
+  char *mce = E.syntax->multiline_comment_end;   // multiline_comment_end
+  // scs for singleline_comment_start, scs_len is 0 when scs is NULL
+
+  int scs_len = scs ? strlen(scs) : 0;
+  int mcs_len = mcs ? strlen(mcs) : 0;
+  int mce_len = mce ? strlen(mce) : 0;
+
+  int prev_sep = 1; // previous_separator, defaults to 1 -> true,
+  // consider the beginning of the line to be a separator
+
+  int in_string = 0; // tracks if the current syntax is in string or not
+
+  int i = 0;
+  while (i < row->rsize) {
+    char c = row->render[i];
+
+    unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
+    // prev_hl set to the hl type of the previous character
+
+    if (scs_len && !in_string &&
+        !in_comment) { // checks if not inside a string and inside comment block
+      // checks the character is the start of the sng-line comment
+      if (!strncmp(&row->render[i], scs, scs_len)) {
+        // set the rest of the row to be HL_COMMENT
+        memset(&row->hl[i], HL_COMMENT, row->rsize - i);
+        break;
+      }
+    }
+
+    if (mcs_len && mce_len && !in_string) {
+      if (in_comment) { // checks if in a comment block
+        row->hl[i] = HL_MLCOMMENT;
+
+        if (!strncmp(&row->render[i], mce, mce_len)) {
+          // if on a comment block, set in_comment = 0
+          memset(&row->hl[i], HL_MLCOMMENT, mce_len);
+
+          i += mce_len;
+          in_comment = 0;
+
+          prev_sep = 1;
+          continue;
+        } else {
+          i++;
+          continue;
+        }
+      } else if (!strncmp(&row->render[i], mcs,
+                          mcs_len)) { // detects the beginning of comment block
+        memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
+        i += mcs_len;
+
+        in_comment = 1;
+        continue;
+      }
+    }
+
+    if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) {
+      // checks if the flags is also set to highlight string
+      if (in_string) {
+        // if current char is in string, then hl[i] = HL_STRING
+        row->hl[i] = HL_STRING;
+
+        if (c == '\\' && i + 1 < row->rsize) {
+          // checks the occurance of \' and \"
+          row->hl[i + 1] = HL_STRING;
+          i += 2;
+
+          // skip the 2 chars and continue to the index += 2
+          continue;
+        }
+
+        if (c == in_string)
+          in_string = 0; // if current char c is the same as the beginning of
+                         // the string, set in_string = 0
+        i++;
+
+        prev_sep = 1;
+        continue;
+      } else {
+        if (c == '"' ||
+            c == '\'') { // checks if current char is dbl-quote or sngl-quot
+          in_string = c;
+
+          // set in_string to c;
+          // and HL_STRING current hl[i]
+          row->hl[i] = HL_STRING;
+
+          i++;
+          continue;
+        }
+      }
+    }
+
+    if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+      if ((isdigit(row->render[i]) && (prev_sep || prev_hl == HL_NUMBER)) ||
+          (c == '.' && prev_hl == HL_NUMBER)) {
+        // to highlight a digit, it is now required that the previous character
+        // needs to be either separator or HL_NUMBER
+        //
+        // additional conditining to highlight decimal point aswell if it is
+        // between a number
+
+        row->hl[i] = HL_NUMBER; // set the hl to be a number
+        i++;                    // moves to the next character
+
+        prev_sep = 0; // set this to 0, to indicate we are in the middle of
+                      // highlighting something,
+        // and continue the loop
+        continue;
+      }
+    }
+
+    if (prev_sep) { // make sure there is a separator before the char
+      int j;
+      for (j = 0; keywords[j]; j++) {
+        int klen =
+            strlen(keywords[j]); // checks each keyword available to highlight
+        int kw2 = keywords[j][klen - 1] ==
+                  '|'; // checks if the keyword is the secondary
+
+        if (kw2)
+          klen--; // reduce the klen if kw2 is true
+
+        if (!strncmp(&row->render[i], keywords[j], klen) &&
+            is_separator(row->render[i + klen])) {
+          // checks if the word is separated from strings
+          // compare the string from i to i + klen is actually the keyword
+          //
+          // set the highlight based on what keyword 1 or keyword 2 group
+          memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+
+          i += klen; // jumps the i to i + klen
+          break;
+        }
+      }
+
+      if (keywords[j] != NULL) {
+        prev_sep = 0;
+        continue;
+      }
+    }
+
+    // if the current character is not highlighted, then set prev_sep
+    // according to whatever the current character is a separator
+
+    prev_sep = is_separator(c);
+    i++;
+  }
+
+  return in_comment;
+}
+
+int benchCompareRow(erow *row, int in_comment) {
+  // highlights row both ways, returns 0 if they disagree
+  unsigned char *hl = malloc(row->rsize + 1);
+
+  int a = legacyHighlightRow(row, in_comment);
+  memcpy(hl, row->hl, row->rsize);
+  int b = editorHighlightRow(row, in_comment);
+  int same = a == b && !memcmp(hl, row->hl, row->rsize);
+
+  free(hl);
+  return same;
+}
+
+void benchCheckLexer() {
+  // the lexer has to give the exact same result as the legacy highlighter,
+  // on every row of the document and on random rows made of the bytes that
+  // start or end something, both inside and outside of a comment
+  const char pieces[] = "/*\\\"'\\0123456789.,() \tabcfilrstuvw\x80\xff\0";
+  char buf[256];
+  erow row = {0};
+  int i, in;
+
+  for (i = 0; i < E.numrows; i++) {
+    for (in = 0; in < 2; in++) {
+      if (!benchCompareRow(&E.row[i], in)) {
+        fprintf(stderr, "te_bench: lexer differs on row %d\n", i);
+        exit(1);
+      }
+    }
+  }
+
+  const char *words[] = {"if", "int", "char ", "//", "/*", "*/", "1.5", "\\\"",
+                         "return", "unsigned", "for", "x"};
+  int nwords = sizeof(words) / sizeof(words[0]);
+
+  srand(1);
+  row.render = buf;
+  row.hl = malloc(sizeof(buf));
+
+  for (i = 0; i < 200000; i++) {
+    int len = rand() % 64, n = 0;
+    while (n < len) {
+      if (rand() % 3 == 0) {
+        const char *w = words[rand() % nwords];
+        while (*w && n < len)
+          buf[n++] = *w++;
+      } else {
+        buf[n++] = pieces[rand() % (sizeof(pieces) - 1)];
+      }
+    }
+    buf[n] = '\0';
+    row.rsize = n;
+
+    for (in = 0; in < 2; in++) {
+      if (!benchCompareRow(&row, in)) {
+        fprintf(stderr, "te_bench: lexer differs on \"%.*s\"\n", n, buf);
+        exit(1);
+      }
+    }
+  }
+
+  free(row.hl);
+}
+
+// --- OPERATIONS ---
+// every op gets the iteration number, and does one unit of work
+
+void opInsertChar(long i) {
+  if (i % 64 == 0) { // type a line of 64 chars, then go on to the next row
+    E.cy = (E.numrows / 2 + i / 64) % (E.numrows ? E.numrows : 1);
+    E.cx = 0;
+  }
+  editorInsertChar('a' + i % 26);
+}
+
+void opNewlineTop(long i) {
+  (void)i;
+  E.cy = 0;
+  E.cx = 0;
+  editorInsertNewline();
+}
+
+void opNewlineMiddle(long i) {
+  (void)i;
+  E.cy = E.numrows / 2;
+  E.cx = E.cy < E.numrows ? E.row[E.cy].size / 2 : 0; // split the line
+  editorInsertNewline();
+}
+
+void opNewlineBottom(long i) {
+  (void)i;
+  E.cy = E.numrows;
+  E.cx = 0;
+  editorInsertNewline();
+}
+
+void opDelCharJoin(long i) {
+  (void)i;
+  E.cy = E.numrows / 2;
+  E.cx = 0;
+  editorDelChar(); // joins the row with the one above
+}
+
+void opRefresh(long i) {
+  // scrolls through the file a screen at a time, drawing every frame
+  E.cy = E.numrows ? (i * E.screenrows) % E.numrows : 0;
+  E.cx = 0;
+  editorRefreshScreen();
+}
+
+void opRefreshHex(long i) {
+  // the same in hex view, the rows are formatted from the mapping
+  size_t rows = (E.hex.size + 15) / 16;
+  E.hex.cur = rows ? (i * E.screenrows) % rows * 16 : 0;
+  editorRefreshScreen();
+}
+
+void opScrollWrapped(long i) {
+  // with soft wrap on, puts the cursor on a row anywhere in the file and
+  // scrolls to it, which is a walk down the tree of screen lines
+  E.cy = E.numrows ? (i * 7919) % E.numrows : 0;
+  E.cx = 0;
+  editorScroll();
+}
+
+void opBracketMatch(long i) {
+  // jumps between a bracket on the first row and the one on the last row
+  // that matches it, every row in between is skipped a block at a time
+  E.cy = i % 2 ? E.numrows - 1 : 0;
+  E.cx = 0;
+  editorBracketsJump();
+}
+
+void opSearch(long i) {
+  (void)i;
+  free(E.search.query); // a new search, not the last one again
+  E.search.query = NULL;
+  editorFindCallback("bench: no such text", 'x'); // has to look at every row
+}
+
+void opSearchType(long i) {
+  // types a query a key at a time, like into Ctrl-F, only the first key
+  // searches the whole file, the others narrow down its matches
+  const char *query = "string number 99999\"";
+  char typed[32];
+  int n;
+
+  (void)i;
+  for (n = 1; query[n - 1]; n++) {
+    memcpy(typed, query, n);
+    typed[n] = '\0';
+    editorFindCallback(typed, typed[n - 1]);
+  }
+  editorFindCallback(typed, '\x1b');
+  free(E.search.query);
+  E.search.query = NULL;
+}
+
+void opHighlight(long i) {
+  // highlights the whole document once, bench_frame_bytes counts the bytes
+  // so bytes_per_op / ns_per_op is the throughput in bytes per ns
+  int in_comment = 0;
+  int j;
+  (void)i;
+
+  for (j = 0; j < E.numrows; j++) {
+    in_comment = editorHighlightRow(&E.row[j], in_comment);
+    bench_frame_bytes += E.row[j].rsize;
+  }
+}
+
+void opHighlightLegacy(long i) {
+  int in_comment = 0;
+  int j;
+  (void)i;
+
+  for (j = 0; j < E.numrows; j++) {
+    in_comment = legacyHighlightRow(&E.row[j], in_comment);
+    bench_frame_bytes += E.row[j].rsize;
+  }
+}
+
+void opComplete(long i) {
+  // word completion lookups, for short and long prefixes
+  const char *prefixes[] = {"f", "func_", "func_1", "st", "s", "multi", "x"};
+  const char *p = prefixes[i % (sizeof(prefixes) / sizeof(prefixes[0]))];
+  char *out[KILO_COMPLETIONS];
+
+  int n = editorWordsComplete(p, strlen(p), out, KILO_COMPLETIONS);
+  while (n-- > 0)
+    free(out[n]);
+}
+
+void opCursors(long i) {
+  // a key typed at every cursor, then deleted again by the next one
+  editorCursorsEdit(i % 2 ? BACKSPACE : 'x');
+}
+
+void benchCursors(int n) {
+  // cursors after the first n occurrences of "return", one per row, the
+  // small files have fewer of them
+  editorCursorsClear();
+
+  int j;
+  for (j = 0; j < E.numrows && E.cursors.n < n; j++) {
+    char *m = memmem(E.row[j].chars, E.row[j].size, "return", 6);
+    if (m)
+      editorCursorsPush(j, m - E.row[j].chars + 6);
+  }
+
+  if (E.cursors.n) {
+    E.cy = E.cursors.at[0].cy;
+    E.cx = E.cursors.at[0].cx;
+  }
+}
+
+void opCutPaste(long i) {
+  // cuts 100,000 lines from the middle (or what the file has), then pastes
+  // them back where they were
+  int n = E.numrows / 2 < 100000 ? E.numrows / 2 : 100000;
+  E.cy = E.numrows / 4;
+  E.cx = 0;
+
+  if (i % 2 == 0) {
+    E.sel.mode = SEL_LINES;
+    E.sel.my = E.cy + n - 1;
+    E.sel.mx = 0;
+    editorSelectionKey(CTRL_KEY('x'));
+  } else {
+    editorSelectionKey(CTRL_KEY('v'));
+  }
+}
+
+void opCutUndo(long i) {
+  // cuts the same lines as cut_paste_lines, then undoes it, which puts them
+  // back in one go
+  if (i % 2 == 0) {
+    int n = E.numrows / 2 < 100000 ? E.numrows / 2 : 100000;
+    E.cy = E.numrows / 4;
+    E.cx = 0;
+    E.sel.mode = SEL_LINES;
+    E.sel.my = E.cy + n - 1;
+    E.sel.mx = 0;
+    editorSelectionKey(CTRL_KEY('x'));
+  } else {
+    editorUndo();
+  }
+}
+
+char bench_save_path[256];
+
+void opSave(long i) {
+  (void)i;
+  if (editorWriteFile(bench_save_path) == -1) {
+    perror(bench_save_path);
+    exit(1);
+  }
+}
+
+void benchReport(size_t size, const char *op, long iters, long long ns,
+                 long allocs, long long bytes) {
+  printf("{\"size\":%zu,\"op\":\"%s\",\"iters\":%ld,\"ns_per_op\":%.1f,"
+         "\"allocs_per_op\":%.2f,\"bytes_per_op\":%lld,\"peak_rss_kb\":%ld}\n",
+         size, op, iters, (double)ns / iters, (double)allocs / iters,
+         bytes / iters, benchPeakRss());
+  fflush(stdout);
+}
+
+void benchRun(size_t size, const char *name, void (*op)(long), long maxiters) {
+  // repeats op until maxiters or BENCH_TIME_NS is reached, whichever first
+  long allocs = bench_allocs;
+  long long bytes = bench_frame_bytes;
+  long long start = benchNow();
+  long long elapsed = 0;
+  long i;
+
+  for (i = 0; i < maxiters && elapsed < BENCH_TIME_NS; i++) {
+    op(i);
+    elapsed = benchNow() - start;
+  }
+
+  benchReport(size, name, i, elapsed, bench_allocs - allocs,
+              bench_frame_bytes - bytes);
+}
+
+void benchPager(char *path, size_t size) {
+  // opens the file in the pager and goes to the bottom, which indexes all of
+  // it, then again with the index the first time left in the cache
+  const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  char cache[256];
+  snprintf(cache, sizeof(cache), "%s/te_bench_cache", tmp);
+  setenv("XDG_CACHE_HOME", cache, 1); // not the user's cache
+
+  int pass;
+  for (pass = 0; pass < 2; pass++) {
+    initEditorHeadless(BENCH_ROWS, BENCH_COLS);
+
+    long allocs = bench_allocs;
+    long long start = benchNow();
+    editorPagerOpen(path);
+    editorPagerProcessKeypress('G');
+    benchReport(size, pass ? "pager_bottom_cached" : "pager_bottom", 1,
+                benchNow() - start, bench_allocs - allocs, 0);
+
+    if (pass == 0)
+      editorIndexSave();
+
+    if (E.pager.map) // the next pass starts over, without a leak
+      munmap(E.pager.map, E.pager.size);
+    if (E.pager.cache) {
+      munmap(E.pager.cache, E.pager.cachesize);
+    } else {
+      free(E.pager.line);
+      free(E.pager.comment);
+    }
+    free(E.pager.scratch.render);
+    free(E.pager.scratch.hl);
+    free(E.pager.cols);
+  }
+
+  char *real = realpath(path, NULL);
+  char *file = real ? editorIndexPath(real, 0) : NULL;
+  if (file)
+    unlink(file);
+  free(file);
+  free(real);
+}
+
+void benchGrep(char *path, size_t size) {
+  // Ctrl-A over a directory of 16 links to the generated file, so the files
+  // are read from the page cache and the search itself is what is measured
+  const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  char dir[256], file[300], cwd[PATH_MAX];
+  int k, links = 16;
+
+  snprintf(dir, sizeof(dir), "%s/te_bench_grep_%zu", tmp, size);
+  mkdir(dir, 0700);
+  for (k = 0; k < links; k++) {
+    snprintf(file, sizeof(file), "%s/%d.c", dir, k);
+    unlink(file);
+    if (link(path, file) == -1) {
+      perror(file);
+      exit(1);
+    }
+  }
+
+  if (getcwd(cwd, sizeof(cwd)) == NULL || chdir(dir) == -1) {
+    perror(dir);
+    exit(1);
+  }
+
+  initEditorHeadless(BENCH_ROWS, BENCH_COLS);
+  long allocs = bench_allocs;
+  long long start = benchNow();
+  editorGrep("number 99999\""); // found once in every file of 1M and up
+  benchReport(size * links, "grep", 1, benchNow() - start,
+              bench_allocs - allocs, 0);
+  editorCloseFile();
+
+  if (chdir(cwd) == -1)
+    perror(cwd);
+  for (k = 0; k < links; k++) {
+    snprintf(file, sizeof(file), "%s/%d.c", dir, k);
+    unlink(file);
+  }
+  rmdir(dir);
+}
+
+void benchHex(char *path, size_t size) {
+  // opens the file in hex view, which only maps it, and scrolls through it
+  initEditorHeadless(BENCH_ROWS, BENCH_COLS);
+
+  long allocs = bench_allocs;
+  long long start = benchNow();
+  editorHexOpen(path);
+  benchReport(size, "hex_open", 1, benchNow() - start, bench_allocs - allocs,
+              0);
+  benchRun(size, "hex_refresh", opRefreshHex, 100000);
+
+  if (E.hex.map)
+    munmap(E.hex.map, E.hex.size);
+  close(E.hex.fd);
+}
+
+void benchSize(size_t size) {
+  char path[256];
+  const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+  snprintf(path, sizeof(path), "%s/te_bench_%zu.c", tmp, size);
+  snprintf(bench_save_path, sizeof(bench_save_path), "%s/te_bench_%zu.out",
+           tmp, size);
+
+  struct stat st;
+  if (stat(path, &st) == -1) // generated files are kept for the next run
+    benchGenerate(path, size);
+
+  initEditorHeadless(BENCH_ROWS, BENCH_COLS);
+  editorOutput = benchSink;
+
+  // editorOpen returns once the first screen is there, the rest of the file
+  // is read in the background
+  long allocs = bench_allocs;
+  long long start = benchNow();
+  editorOpen(path);
+  benchReport(size, "open_first_screen", 1, benchNow() - start,
+              bench_allocs - allocs, 0);
+  editorLoadFinish();
+  benchReport(size, "open", 1, benchNow() - start, bench_allocs - allocs, 0);
+
+  // the ops that add or remove rows are capped low, so the document stays
+  // close to the generated size for the ops that come after them
+  benchRun(size, "insert_char", opInsertChar, 100000);
+  benchRun(size, "newline_top", opNewlineTop, 1000);
+  benchRun(size, "newline_middle", opNewlineMiddle, 1000);
+  benchRun(size, "newline_bottom", opNewlineBottom, 1000);
+  benchRun(size, "delchar_join", opDelCharJoin, 1000);
+  benchRun(size, "refresh", opRefresh, 100000);
+  benchRun(size, "search", opSearch, 100000);
+  benchRun(size, "search_type", opSearchType, 100000);
+
+  // narrow enough for most of the generated rows to wrap
+  E.wrap.enabled = 1;
+  E.screencols = 24;
+  allocs = bench_allocs;
+  start = benchNow();
+  editorScroll(); // the screen lines of every row are counted once
+  benchReport(size, "wrap_build", 1, benchNow() - start,
+              bench_allocs - allocs, 0);
+  benchRun(size, "scroll_wrapped", opScrollWrapped, 100000);
+  benchRun(size, "refresh_wrapped", opRefresh, 100000);
+  E.wrap.enabled = 0;
+  E.screencols = BENCH_COLS;
+
+  // one pair of brackets around the whole file, the generated file can stop
+  // in a comment or in the middle of a function, which get closed first
+  int closed = 1;
+  editorInsertRow(0, "{", 1);
+  if (E.row[E.numrows - 1].hl_open_comment) {
+    editorInsertRow(E.numrows, "*/", 2);
+    closed++;
+  }
+  editorInsertRow(E.numrows, "}", 1);
+  allocs = bench_allocs;
+  start = benchNow();
+  opBracketMatch(0); // the first jump sums up the brackets of every row
+  benchReport(size, "brackets_build", 1, benchNow() - start,
+              bench_allocs - allocs, 0);
+  while (E.cy != E.numrows - 1 && closed < 4) {
+    editorInsertRow(E.numrows, "}", 1);
+    closed++;
+    opBracketMatch(0);
+  }
+  if (E.cy != E.numrows - 1)
+    fprintf(stderr, "te_bench: the brackets around the file don't match\n");
+  benchRun(size, "bracket_match", opBracketMatch, 100000);
+  while (closed--)
+    editorDelRow(E.numrows - 1);
+  editorDelRow(0);
+
+  // refresh with the matches of a search drawn, every row is scanned for
+  // them once, when it first comes on the screen, and never again
+  editorFindCallback("x", 'x');
+  benchRun(size, "refresh_matches", opRefresh, 100000);
+  editorFindCallback("x", '\x1b');
+
+  benchCheckLexer();
+  benchRun(size, "highlight", opHighlight, 1000);
+  benchRun(size, "highlight_legacy", opHighlightLegacy, 1000);
+  benchRun(size, "save", opSave, 1000);
+
+  allocs = bench_allocs;
+  start = benchNow();
+  editorWordsBuild(); // done by the first completion
+  benchReport(size, "words_build", 1, benchNow() - start,
+              bench_allocs - allocs, 0);
+  benchRun(size, "complete", opComplete, 100000);
+
+  benchCursors(10000);
+  benchRun(size, "cursors_type", opCursors, 1000);
+  editorCursorsClear();
+
+  benchRun(size, "cut_paste_lines", opCutPaste, 100);
+  benchRun(size, "cut_undo_lines", opCutUndo, 100);
+
+  allocs = bench_allocs;
+  start = benchNow();
+  if (!editorFilter("cat", 0, E.numrows)) // out to cat and back into rows
+    fprintf(stderr, "te_bench: %s\n", E.statusmsg);
+  benchReport(size, "filter", 1, benchNow() - start, bench_allocs - allocs, 0);
+  editorUndo();
+
+  // undoing a filter of the middle half puts its rows back above the rest,
+  // not at the end of the file
+  if (!editorFilter("cat", E.numrows / 4, E.numrows / 2))
+    fprintf(stderr, "te_bench: %s\n", E.statusmsg);
+  allocs = bench_allocs;
+  start = benchNow();
+  editorUndo();
+  benchReport(size, "filter_undo_middle", 1, benchNow() - start,
+              bench_allocs - allocs, 0);
+
+  benchGrep(path, size);
+  benchPager(path, size);
+  benchHex(path, size);
+
+  unlink(bench_save_path);
+}
+
+int main(int argc, char *argv[]) {
+  char *defaults[] = {NULL, "1K", "1M", "64M"}; // 1G works too, given the RAM
+
+  signal(SIGPIPE, SIG_IGN); // as te's main does, for the filter
+
+  if (argc < 2) {
+    argv = defaults;
+    argc = sizeof(defaults) / sizeof(defaults[0]);
+  }
+
+  int i;
+  for (i = 1; i < argc; i++) {
+    size_t size = benchParseSize(argv[i]);
+
+    pid_t pid = fork(); // a process per size, so peak_rss_kb is per size
+    if (pid == -1) {
+      perror("fork");
+      return 1;
+    }
+
+    if (pid == 0) {
+      benchSize(size);
+      exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "te_bench: size %s failed\n", argv[i]);
+      return 1;
+    }
+  }
+
+  return 0;
+}
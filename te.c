@@ -3,19 +3,35 @@
 #define _GNU_SOURCE
 
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // --- DEFINES ---
 
 #define CTRL_KEY(k) ((k) & 0x1f)
@@ -23,6 +39,22 @@
 #define KILO_VERSION "0.0.1"
 #define KILO_TAB_STOP 4
 #define KILO_QUIT_TIMES 3
+#define KILO_FOLLOW_CHUNK 65536 // bytes read per pread() while following
+#define KILO_PAGER_SCAN (1 << 20) // bytes searched for newlines at a time
+#define KILO_INDEX_MIN (1 << 24)  // smaller files are scanned, not cached
+#define KILO_INDEX_MAGIC "teidx1"  // changes whenever the cache layout does
+#define KILO_LOAD_AHEAD (1 << 20) // bytes read before the rows are made
+#define KILO_LOAD_BATCH (1 << 18) // bytes made into rows between two keys
+#define KILO_IOV_BATCH 1024        // iovecs handed to a single writev()
+#define KILO_UNDO_MAX 1000         // undo steps kept, the oldest are dropped
+#define KILO_STATS_WINDOW 256      // frames the stats summary line looks at
+#define KILO_STATS_BUCKETS 40      // log2 histogram buckets, up to 2^40
+#define KILO_WORD_MAX 256          // longer words aren't offered to complete
+#define KILO_COMPLETIONS 64        // completions Ctrl-P cycles through at most
+#define KILO_MATCH_SETS 256        // rows of matches cached for drawing, x2
+#define KILO_BRACKET_BLOCK 64      // rows summed up by a leaf of the brackets
+#define KILO_SUMS_BLOCK 64         // rows in a block of the line index
+#define KILO_GREP_TEXT 200         // bytes of a matching line Ctrl-A lists
 
 #define HL_HIGHLIGHT_NUMBERS (1 << 0)
 #define HL_HIGHLIGHT_STRINGS (1 << 1)
@@ -40,6 +72,15 @@ enum editorKey {
   PAGE_DOWN
 };
 
+enum editorStat { // what the stats measure for every frame
+  STAT_KEY = 0, // processing the keys that came before the frame
+  STAT_SYNTAX,  // editorUpdateSyntax
+  STAT_DRAW,    // editorDrawRows
+  STAT_WRITE,   // writing the frame to the terminal
+  STAT_BYTES,   // size of the frame
+  STAT_COUNT
+};
+
 enum editorHighlight {
   HL_NORMAL = 0,
   HL_COMMENT,
@@ -53,6 +94,30 @@ enum editorHighlight {
 
 // --- Data ---
 
+// character classes of the lexer, a byte can be in more than one
+#define LX_SEP (1 << 0)   // a separator, see is_separator
+#define LX_DIGIT (1 << 1) // a digit, when numbers are highlighted
+#define LX_DOT (1 << 2)   // the decimal point of a number
+#define LX_QUOTE (1 << 3) // starts a string, when strings are highlighted
+#define LX_SCS (1 << 4)   // first byte of singleline_comment_start
+#define LX_MCS (1 << 5)   // first byte of multiline_comment_start
+#define LX_KW (1 << 6)    // first byte of some keyword
+
+struct editorKeyword {
+  const char *s;
+  int len;          // without the | of secondary keywords
+  unsigned char hl; // HL_KEYWORD1 or HL_KEYWORD2
+};
+
+struct editorLexer { // an editorSyntax compiled into tables, for editorLexRow
+  unsigned char cls[256]; // class of every byte, LX_*
+  struct editorKeyword *kw;
+  int kwfirst[256]; // the keywords starting with byte b are kw[kwfirst[b]]
+  int kwcount[256]; // and the kwcount[b] after it
+  const char *scs, *mcs, *mce;
+  int scs_len, mcs_len, mce_len;
+};
+
 struct editorSyntax {
   char *filetype;
   char **filematch;
@@ -61,18 +126,352 @@ struct editorSyntax {
   char *multiline_comment_start;
   char *multiline_comment_end;
   int flags;
+  struct editorLexer *lexer; // compiled the first time a syntax is selected
 };
 
 typedef struct erow { // for storing size of the file and the chars in them
   int idx;
   int size;
-  int rsize; // size of the contents of render
+  int rsize;        // size of the contents of render
+  unsigned version; // a new one whenever render changes, caches are keyed
+                    // by it, so a stale entry is never used
   char *chars;
   char *render;      // contains actual character to draw on the screen
   unsigned char *hl; // integers in range 0 - 255, an array of unsigned char
   int hl_open_comment;
+  int rcols; // how many columns render takes on the screen
+  int *rcol; // the column each byte of render starts at, rsize + 1 of them,
+             // NULL when render is all ASCII and every byte is a column
 } erow;
 
+typedef struct undoSpan { // rows [at, at + nnew) used to be the old rows
+  int at;
+  int nnew;  // how many rows the span has now
+  int nold;  // how many rows it had before the change
+  erow *old; // the rows before the change, only chars and size are used
+} undoSpan;
+
+typedef struct undoUnit { // everything one undo step takes back
+  undoSpan *spans; // undone from the last to the first
+  int nspans;
+  int cx, cy; // where the cursor was before the change
+} undoUnit;
+
+struct editorFollow { // state of follow mode (-f), like tail -f
+  int fd;        // inotify instance, -1 when follow mode is off
+  int wd;        // watch descriptor of the followed file
+  off_t offset;  // how many bytes of the file are already loaded into rows
+  int partial;   // 1 if the last row is not terminated by a newline yet
+  dev_t dev;     // the file the rows came from, a rotated-in file with the
+  ino_t ino;     // same name is a different one
+};
+
+struct editorCodec { // a compression format, handled by its own program
+  char *name;
+  char *magic;  // the bytes every file in this format starts with
+  int magiclen;
+  char *decompress[4]; // argv of the program, reads stdin and writes stdout
+  char *compress[4];
+};
+
+struct editorLoading { // the file being read by a background thread
+  int active; // 1 until the last row of the file is in E.row
+  struct editorCodec *codec; // format of the file, NULL if not compressed
+  int codec_asked;           // the first save asked whether to keep it
+  pthread_t thread;          // reads the file, or the decompressor's output
+  pthread_mutex_t lock;      // held while buf, len, done and stop change
+  pthread_cond_t room;       // signaled when the rows were made from buf
+  pid_t pid;                 // the decompressor, -1 if there is none
+  int in;                    // what the thread reads
+  int wake[2];  // the thread writes a byte to wake[1] when buf got more
+  char *buf;    // bytes read but not yet turned into rows
+  size_t len;
+  size_t cap;
+  int done; // 1 when the whole file is read, -1 if reading it failed
+  int stop; // the file was closed, the thread should stop reading
+  long long total;  // size of the file, 0 if not known (compressed)
+  long long loaded; // how much of it is in rows already
+};
+
+struct editorPager { // read-only pager mode (-R), lines come from the mapping
+  int enabled;
+  char *map; // the whole file mmapped, NULL when the file is empty
+  size_t size;
+  size_t *line;  // start offset of every line indexed so far
+  int nlines;    // how many lines are in line[]
+  int linecap;   // how many offsets line[] has room for
+  size_t scanned; // the file is searched for newlines up to this offset
+  unsigned char *comment; // one bit per line, multiline comment open at end
+  int hl_valid;   // comment[] is known for the lines before this one
+  erow scratch;   // the line being drawn, rendered and highlighted
+  int scratchcap; // how many bytes scratch.render and scratch.hl have room for
+  int *cols;      // scratch.rcol points here when the line isn't all ASCII
+  int match_line; // line of the current search match, -1 if none
+  int match_col;  // render column and length of the current search match
+  int match_len;
+  char *cache;       // the index cache mapped, line and comment point into it
+  size_t cachesize;  // until they need room for more lines, NULL if not
+  size_t cached;     // how far the cache that was read went, 0 for none
+  int cached_hl;     // and how many comment bits it had
+};
+
+struct editorHexByte { // a byte typed over in hex view (-x)
+  size_t off;
+  unsigned char byte;
+  unsigned char edited; // for Ctrl-Z, 1 if byte was typed over off already
+};
+
+struct editorHex { // hex view (-x), 16 bytes a row straight from the mapping
+  int enabled;
+  int fd;              // open for pwrite, -1 if the file can't be written
+  unsigned char *map;  // the whole file mmapped shared, NULL when it's empty
+  size_t size;
+  size_t cur;          // the byte the cursor is on
+  int low;             // 1 when the next hex digit is the low half of it
+  int ascii;           // 1 when typing goes to the text column (Tab)
+  size_t top;          // the row at the top of the screen
+  int width;           // hex digits of the offsets
+  struct editorHexByte *edits; // not saved yet, sorted by offset
+  int nedits, editcap;
+  struct editorHexByte *undo;  // the bytes before they were typed over
+  int nundo, undocap;
+};
+
+struct editorIndexHeader { // how a cache file starts, see INDEX CACHE
+  char magic[8];
+  unsigned long long dev, ino; // the file that was indexed
+  long long size;
+  long long mtime_sec, mtime_nsec;
+  long long scanned;         // what the index covers, see editorPager
+  long long nlines;
+  long long hl_valid;
+  unsigned long long tail;   // a hash of the bytes just before scanned
+  long long pathlen;         // the path follows, then line and comment
+};
+
+struct editorSymbol { // where a function, struct, typedef or macro is defined
+  char *name;
+  int file; // index into the indexer's files, -1 for the open buffer
+  int line; // 0 based
+  struct editorSymbol *next; // next one in the same hash bucket
+};
+
+struct editorSymtab { // name -> definitions, a chained hash table
+  struct editorSymbol **bucket;
+  int nbuckets; // a power of two, doubled when the chains get long
+  int count;
+};
+
+struct editorSymbols { // definitions found in the open buffer
+  int enabled;
+  struct editorSymtab tab;
+  struct editorSymbol **byline; // the same definitions sorted by line
+  int n;
+  int cap;
+};
+
+struct editorIndexedFile { // a sibling file indexed by the background thread
+  char *path;
+  char *base; // the name without the directory
+  time_t mtime;
+  struct editorSymbol **syms;
+  int nsyms;
+};
+
+struct editorIndexer { // the background thread indexing the sibling files
+  int running;
+  pthread_t thread;
+  pthread_mutex_t lock; // held while the table or the files change
+  char *dir;
+  struct editorSyntax *syntax; // only the files of this syntax are indexed
+  struct editorSymtab tab;
+  struct editorIndexedFile *files;
+  int nfiles;
+};
+
+struct editorWordNode { // a node of the ternary search tree of words
+  unsigned char c;
+  int lo, eq, hi; // indexes into the node array, 0 for none
+  int count;      // how many times the word ending here is in the buffer
+};
+
+struct editorWords { // the words of the buffer, for completion (Ctrl-P)
+  int built;        // counted from every row once, kept up to date after that
+  struct editorWordNode *node; // node[0] is unused, so 0 can mean none
+  int n;
+  int cap;
+  char **cand; // completions of the last Ctrl-P, to cycle through
+  int ncand;
+  int at;       // which candidate is in the buffer now
+  int inserted; // and how many bytes of it were inserted
+};
+
+struct editorCursor {
+  int cy, cx;
+};
+
+struct editorCursors { // the cursors added by Ctrl-D, n is 0 with just one
+  struct editorCursor *at; // all of them, E.cx and E.cy included, sorted by
+  int n;                   // row and then by column
+  int cap;
+};
+
+struct editorRowMatches { // where the query is on a row, cached for drawing
+  unsigned version;      // the version of the row
+  unsigned gen;          // and the query, 0 for an empty entry
+  unsigned used;         // when it was last drawn, the older of two goes
+  int *off;              // byte offsets into render, in order
+  int n;
+  int cap;
+};
+
+struct editorSearch { // the rows that have the query typed into Ctrl-F
+  char *query;
+  int qlen;
+  int *rows; // in order, rows[0..done) have the query, rows[next..n) had
+  int n;     // a shorter one, and have to be looked at again
+  int cap;
+  int done;
+  int next;
+  int scanned;     // the rows from here on were never looked at
+  long long edits; // E.edits when they were searched for
+  int active;      // 1 while the matches are drawn, in the prompt of Ctrl-F
+  unsigned gen;    // a new one whenever the query changes
+  unsigned used;
+  struct editorRowMatches *cache; // two ways for each of KILO_MATCH_SETS
+};
+
+struct editorBracketSum { // brackets of some rows, ( [ { count 1, ) ] } -1
+  int net;                 // what they add up to
+  int min;                 // the lowest the sum gets going through them, <= 0
+  int closed;              // rows that don't end inside a multiline comment
+};
+
+struct editorBrackets {         // see BRACKETS
+  int built;                    // 0 until the first Ctrl-O or Ctrl-K
+  struct editorBracketSum *row; // one for every row
+  int cap;
+  struct editorBracketSum *tree; // tree[1] sums up all the blocks, tree[k]
+  int leaves;                    // tree[2k] and tree[2k + 1], the blocks are
+  int valid;                     // tree[leaves..], right up to valid
+};
+
+struct editorFold { // rows (start, end] are hidden
+  int start;
+  int end;
+};
+
+struct editorFolds { // the folds of Ctrl-K, in order, none inside another
+  struct editorFold *at;
+  int n;
+  int cap;
+};
+
+enum editorSelect { SEL_NONE = 0, SEL_CHARS, SEL_LINES, SEL_BLOCK };
+
+struct editorSelection { // from the mark to the cursor, set by Ctrl-B
+  int mode;   // SEL_NONE when nothing is selected
+  int my, mx; // the mark, the other end is E.cy, E.cx
+};
+
+struct editorYank { // what Ctrl-C or Ctrl-X took, for Ctrl-V
+  int mode;   // SEL_CHARS, SEL_LINES or SEL_BLOCK, each pastes differently
+  char *text; // all the lines after each other, without newlines
+  int *off;   // line k is text[off[k]] up to text[off[k + 1]]
+  int n;
+};
+
+struct editorSumsNode { // rows after each other, and their values summed up
+  long long sum;
+  int rows;
+};
+
+struct editorSums { // a value per row summed up, over blocks of rows
+  long long *val;               // the value of every row
+  int n;                        // the rows val has
+  int cap;                      // how many rows val has room for
+  struct editorSumsNode *block; // the rows in order, block by block
+  int nblocks;
+  int blockcap;
+  struct editorSumsNode *tree; // Fenwick tree, tree[k] sums the blocks
+  int treecap;                 // (k - (k & -k), k], counted from 1
+  int built;                   // 0 until the rows are measured
+};
+
+struct editorWrap { // soft wrap, long rows go on over several screen lines
+  int enabled;             // toggled by Ctrl-W or -w
+  int width;               // the text columns lines were built for
+  struct editorSums lines; // how many screen lines each row takes
+  int sub;                 // screen lines of row rowoff above the screen
+  int y;                   // where editorScroll put the cursor on the screen
+  int x;
+};
+
+struct editorView { // what a client of the server (-a) sees of the document
+  int cx, cy, rx;
+  int rowoff, coloff;
+  int screenrows, screencols; // the client's terminal
+  int linenumbers;
+  int wrap; // E.wrap.enabled
+  int sub;  // and E.wrap.sub
+  struct editorSelection sel;
+  struct editorCursors cursors;
+  long long edits; // E.edits when the view was swapped out
+  char statusmsg[80];
+  time_t statusmsg_time;
+};
+
+struct editorClient { // a te -a attached to a document of the server
+  int fd;   // the connection
+  int gone; // 1 once it went away or quit, it is dropped after the key
+  struct editorView view;
+  char *frame; // the last frame it was sent, NULL if its screen is unknown
+  int framelen;
+};
+
+struct editorServer { // the clients of a document, in a thread of te -d
+  int enabled;
+  int feed; // the server hands new clients to the document through this pipe
+  struct editorClient *client;
+  int n;
+  int cap;
+  int cur; // the client whose view is in E, -1 for none
+};
+
+struct editorGrep { // Ctrl-A, the search of the files under the directory
+  int list;    // 1 while the buffer holds the results, Enter opens one
+  char *query; // the last search, an empty query runs it again
+};
+
+struct editorTrace { // recording (-t) or replaying (-p) the typed input
+  FILE *fp;          // the trace file, NULL when doing neither
+  int replay;        // 1 when replaying, 0 when recording
+  long long start;   // when the recording started, in ns
+  long long last;    // time of the last byte taken from the trace, in us
+  long long next;    // time of the next byte in the trace, -1 at the end
+  int nextbyte;      // and the byte itself
+  long long keyend;  // when the last key was handed over, 0 before the first
+  long long *lat;    // how long each key took to process, in ns
+  int nlat, latcap;
+  long long bytes; // how much output the frames produced
+  int rows, cols;  // terminal size the trace was recorded with
+};
+
+struct editorStats { // frame cost measurements, only taken when enabled
+  int enabled;
+  int visible; // the summary line below the status bar is shown (Ctrl-T)
+  char *dump;  // the file the histograms are written to on exit (-S)
+  long long cur[STAT_COUNT]; // the frame being measured
+  long long window[KILO_STATS_WINDOW][STAT_COUNT]; // the recent frames, a ring
+  int head; // the slot of window the next frame goes to
+  long long frames;
+  long long hist[STAT_COUNT][KILO_STATS_BUCKETS]; // all frames, log2 buckets
+  long long max[STAT_COUNT];
+  long long wait; // time spent waiting for keys since the last frame
+  long long last; // when the last frame was written
+  int depth; // editorUpdateSyntax calls itself, only the outer call counts
+};
+
 struct editorConfig {
   int cx, cy;
   int rx; // cx is for index for chars, rx for render field
@@ -81,6 +480,7 @@ struct editorConfig {
   int screenrows;
   int screencols;
   int numrows; //
+  int rowcap;  // how many erow structs row has room for, grows by doubling
   erow *row;   // store multiple erow structs
   int dirty;   // to know if the current buffer is already changed and saved to
                // disk
@@ -88,10 +488,37 @@ struct editorConfig {
   char statusmsg[80];
   time_t statusmsg_time;
   struct editorSyntax *syntax;
+  undoUnit *undo; // the undo stack, the last unit is undone first
+  int nundo;
+  int undo_typing; // row of the typing still going into the last unit, -2
+                   // for typing at the cursors of Ctrl-D, or -1
+  struct editorSums lines; // the byte offset of every row
+  struct editorWrap wrap;
+  struct editorSymbols symbols;
+  struct editorWords words;
+  struct editorCursors cursors;
+  struct editorSelection sel;
+  struct editorYank yank;
+  struct editorSearch search;
+  struct editorBrackets brackets;
+  struct editorFolds folds;
+  long long edits; // counts the changes of rows, to tell if anything changed
+  int linenumbers; // 1 when the line number gutter is shown (-n, Ctrl-N)
+  int gutter;      // columns taken by the gutter, set by editorScroll
+  struct editorFollow follow;
+  struct editorLoading load;
+  struct editorPager pager;
+  struct editorHex hex;
+  struct editorTrace trace;
+  struct editorStats stats;
+  struct editorServer server;
+  struct editorGrep grep;
   struct termios orig_termios;
 };
 
-struct editorConfig E;
+// every thread has its own E, the batch mode (-b) runs one document per worker
+// thread through the same editing functions the interactive editor uses
+__thread struct editorConfig E;
 
 // --- FILETYPES ---
 char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL};
@@ -106,19 +533,318 @@ char *C_HL_keywords[] = {"switch",    "if",      "while",   "for",    "break",
 // HLDB -> highlight db
 struct editorSyntax HLDB[] = {{"c", C_HL_extensions, C_HL_keywords, "//", "/*",
                                "*/",
-                               HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS}};
+                               HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS,
+                               NULL}};
 
 #define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
 
+// compressed files are recognized by their first bytes, not by the name
+struct editorCodec CODECS[] = {
+    {"gzip", "\x1f\x8b", 2, {"gzip", "-dc", NULL}, {"gzip", "-c", NULL}},
+    {"zstd",
+     "\x28\xb5\x2f\xfd",
+     4,
+     {"zstd", "-dcq", NULL},
+     {"zstd", "-cq", NULL}}};
+
+#define CODECS_ENTRIES (sizeof(CODECS) / sizeof(CODECS[0]))
+
 // --- PROTOTYPES ---
 
+void die(const char *s);
 void editorSetStatusMessage(const char *fmt, ...);
 void editorRefreshScreen();
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorPromptEx(char *prompt, void (*callback)(char *, int),
+                     int allow_empty);
+int editorFollowWait();
+int editorLoadWait();
+void editorLoadTo(int n);
+void editorLoadFinish();
+void editorLoadStop();
+struct editorCodec *editorCodecOf(int fd);
+void editorLoadStart(int fd, struct editorCodec *codec);
+ssize_t editorWriteCompressed(char *filename, struct editorCodec *codec);
+int editorPagerIndexTo(int n);
+int editorIndexLoad(struct stat *st);
+void editorIndexSave();
+erow *editorPagerRow(int n);
+void editorPagerProcessKeypress(int c);
+void editorHexProcessKeypress(int c);
+void editorPagerFindCallback(char *query, int key);
+void editorFind();
+void editorGoto();
+void editorSymbolsRow(erow *row);
+long long editorWrapHeight(erow *row);
+void editorBracketsRow(erow *row);
+void editorBracketsMoved(int at, int removed, int added);
+void editorFoldsMoved(int at, int removed, int added);
+int editorFoldAt(int row);
+void editorSymbolsMoved(int at, int removed, int added);
+void editorCursorsClear();
+int editorPagerLineOf(size_t off);
+extern void (*editorOutput)(const char *s, int len);
+int serverRead(char *c, int seq);
+void serverDetach();
+void serverDie(const char *s);
+void serverSwap(int k);
+void serverAdd();
+void initEditorHeadless(int rows, int cols);
+
+// --- CLOCK ---
+
+long long editorNow() {
+  // monotonic time in ns, for measuring how long things take
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --- STATS ---
+// opt-in measurement of what every frame costs (-S or Ctrl-T), a frame is one
+// editorRefreshScreen, it is charged with the time spent on the keys since
+// the previous frame (waiting for them not included), highlighting, drawing
+// the rows and writing the frame out, plus the size of the frame
+
+int statsBucket(long long v) {
+  // log2 histogram bucket of a value
+  int b = 0;
+  while (v > 1 && b < KILO_STATS_BUCKETS - 1) {
+    v >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void statsFrame(long long start) {
+  // closes the frame that began at start, it goes into the window of recent
+  // frames and into the histograms
+  long long now = editorNow();
+
+  if (E.stats.last) // the keys processed since the previous frame
+    E.stats.cur[STAT_KEY] = start - E.stats.last - E.stats.wait;
+  if (E.stats.cur[STAT_KEY] < 0) // a frame drawn while waiting (follow mode)
+    E.stats.cur[STAT_KEY] = 0;
+
+  int i;
+  for (i = 0; i < STAT_COUNT; i++) {
+    long long v = E.stats.cur[i];
+
+    E.stats.window[E.stats.head][i] = v;
+    E.stats.hist[i][statsBucket(v)]++;
+    if (v > E.stats.max[i])
+      E.stats.max[i] = v;
+
+    E.stats.cur[i] = 0;
+  }
+
+  E.stats.head = (E.stats.head + 1) % KILO_STATS_WINDOW;
+  E.stats.frames++;
+  E.stats.wait = 0;
+  E.stats.last = now;
+}
+
+int statsCompare(const void *a, const void *b) {
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+long long statsPercentile(int stat, int pct) {
+  // percentile of one measurement over the recent frames
+  long long v[KILO_STATS_WINDOW];
+  int n = E.stats.frames < KILO_STATS_WINDOW ? E.stats.frames
+                                              : KILO_STATS_WINDOW;
+  if (n == 0)
+    return 0;
+
+  int i;
+  for (i = 0; i < n; i++)
+    v[i] = E.stats.window[i][stat];
+
+  qsort(v, n, sizeof(long long), statsCompare);
+  return v[n * pct / 100];
+}
+
+char *statsFormat(char *buf, long long ns) {
+  // a short human readable duration, buf needs 24 bytes
+  if (ns < 10000)
+    snprintf(buf, 24, "%lldns", ns);
+  else if (ns < 10000000)
+    snprintf(buf, 24, "%lldus", ns / 1000);
+  else
+    snprintf(buf, 24, "%lldms", ns / 1000000);
+  return buf;
+}
+
+void statsToggle() {
+  // shows or hides the summary line, the first time it also starts measuring
+  E.stats.enabled = 1;
+  E.stats.visible = !E.stats.visible;
+
+  E.screenrows += E.stats.visible ? -1 : 1; // the line takes a text row
+}
+
+void statsDump() {
+  // writes everything measured to the -S file, called on exit
+  FILE *fp = fopen(E.stats.dump, "w");
+  if (!fp)
+    return;
+
+  static const char *names[STAT_COUNT] = {"key", "syntax", "draw", "write",
+                                          "bytes"};
+
+  fprintf(fp, "{\"frames\":%lld", E.stats.frames);
+
+  int i, b;
+  for (i = 0; i < STAT_COUNT; i++) {
+    // values are ns, except for bytes, bucket b holds values below 2^(b+1)
+    fprintf(fp, ",\n \"%s\":{\"p50\":%lld,\"p99\":%lld,\"max\":%lld,"
+                "\"hist\":[",
+            names[i], statsPercentile(i, 50), statsPercentile(i, 99),
+            E.stats.max[i]);
+
+    int first = 1;
+    for (b = 0; b < KILO_STATS_BUCKETS; b++) {
+      if (E.stats.hist[i][b] == 0)
+        continue;
+      fprintf(fp, "%s[%lld,%lld]", first ? "" : ",", 1LL << (b + 1),
+              E.stats.hist[i][b]);
+      first = 0;
+    }
+
+    fprintf(fp, "]}");
+  }
+
+  fprintf(fp, "}\n");
+  fclose(fp);
+}
+
+void statsStart(char *dump) {
+  E.stats.enabled = 1;
+  E.stats.dump = dump;
+  atexit(statsDump);
+}
+
+// --- TRACE ---
+// a trace is the raw input bytes of a session with the time each one arrived,
+// recorded with -t, replaying it with -p runs the session again without a
+// terminal, as fast as possible, and reports how long every key took, the
+// file starts with a "te-trace 1 <rows> <cols>" line, then every byte has
+// its own "<microseconds since start> <byte>" line
+
+time_t editorTime() {
+  // the time used for the status message, a replay uses the time of the
+  // trace instead of the clock, so it draws the same frames on every run
+  if (E.trace.fp && E.trace.replay)
+    return E.trace.last / 1000000;
+  return time(NULL);
+}
+
+void traceRecordStart(char *path, int rows, int cols) {
+  E.trace.fp = fopen(path, "w");
+  if (!E.trace.fp)
+    die("fopen");
+
+  E.trace.replay = 0;
+  E.trace.start = editorNow();
+  fprintf(E.trace.fp, "te-trace 1 %d %d\n", rows, cols);
+}
+
+void traceRecord(char c) {
+  fprintf(E.trace.fp, "%lld %d\n", (editorNow() - E.trace.start) / 1000,
+          (unsigned char)c);
+}
+
+void traceNextByte() {
+  // reads the next record of the trace into E.trace.next and nextbyte
+  if (fscanf(E.trace.fp, "%lld %d", &E.trace.next, &E.trace.nextbyte) != 2)
+    E.trace.next = -1;
+}
+
+int traceCompare(const void *a, const void *b) {
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+void traceReport() {
+  // printed when the replay ends, one JSON object
+  int n = E.trace.nlat;
+  long long total = 0;
+  int i;
+
+  qsort(E.trace.lat, n, sizeof(long long), traceCompare);
+  for (i = 0; i < n; i++)
+    total += E.trace.lat[i];
+
+  printf("{\"keys\":%d,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,"
+         "\"total_ms\":%.2f,\"bytes\":%lld,\"rows\":%d,\"cols\":%d}\n",
+         n, n ? E.trace.lat[n / 2] / 1e3 : 0.0,
+         n ? E.trace.lat[n * 99 / 100] / 1e3 : 0.0,
+         n ? E.trace.lat[n - 1] / 1e3 : 0.0, total / 1e6, E.trace.bytes,
+         E.screenrows + 2, E.screencols);
+}
+
+void traceSink(const char *s, int len) {
+  (void)s;
+  E.trace.bytes += len; // a replay has no terminal, the frames are counted
+}
+
+void traceReplayStart(char *path) {
+  E.trace.fp = fopen(path, "r");
+  if (!E.trace.fp) {
+    perror(path);
+    exit(1);
+  }
+
+  if (fscanf(E.trace.fp, "te-trace 1 %d %d", &E.trace.rows, &E.trace.cols) !=
+      2) {
+    fprintf(stderr, "te: %s: not a trace file\n", path);
+    exit(1);
+  }
+
+  E.trace.replay = 1;
+  traceNextByte();
+
+  atexit(traceReport); // Ctrl-Q in the trace ends the replay through exit()
+}
+
+int traceReplayRead(char *c, int seq) {
+  // hands out the next byte of the trace, seq is 1 for the bytes after an
+  // escape, the terminal gives up on those after 100ms (VTIME), so a gap
+  // that long in the trace makes the read come back empty, just like it did
+  // while recording
+  long long now = editorNow();
+
+  if (!seq && E.trace.keyend) { // the time since the last key was handed over
+    if (E.trace.nlat == E.trace.latcap) {
+      E.trace.latcap = E.trace.latcap ? E.trace.latcap * 2 : 1024;
+      E.trace.lat = realloc(E.trace.lat, sizeof(long long) * E.trace.latcap);
+    }
+    E.trace.lat[E.trace.nlat++] = now - E.trace.keyend;
+  }
+
+  if (E.trace.next == -1)
+    exit(0); // the end of the trace, traceReport prints the results
+
+  if (seq && E.trace.next - E.trace.last >= 100000)
+    return 0;
+
+  *c = E.trace.nextbyte;
+  E.trace.last = E.trace.next;
+  traceNextByte();
+
+  E.trace.keyend = editorNow();
+  return 1;
+}
 
 // --- TERMINAL ---
 
 void die(const char *s) {
+  if (E.server.enabled) // a document of te -d, the others go on
+    serverDie(s);
+
   write(STDOUT_FILENO, "\x1b[2J", 4);
   write(STDOUT_FILENO, "\x1b[H", 3);
   perror(s);
@@ -158,31 +884,103 @@ void enableRawMode() {
     die("tcsetattr"); // set the attr
 }
 
+int editorInputFd() {
+  // where the keys come from, the terminal or a client of te -d
+  return E.server.cur != -1 ? E.server.client[E.server.cur].fd : STDIN_FILENO;
+}
+
+int editorReadRaw(char *c, int seq) {
+  // reads one byte of input, returns 0 when none came in time, seq is 1 for
+  // the bytes of an escape sequence
+  if (E.trace.fp && E.trace.replay)
+    return traceReplayRead(c, seq);
+  if (E.server.cur != -1)
+    return serverRead(c, seq);
+
+  int nread = read(STDIN_FILENO, c, 1);
+
+  if (nread == 1 && E.trace.fp)
+    traceRecord(*c);
+
+  return nread;
+}
+
+int editorCancelFd() {
+  // what to poll for Esc while a command (Ctrl-E) or a search of the files
+  // (Ctrl-A) runs, -1 when there is nothing to watch, stdin that isn't a
+  // terminal may be at its end and poll as readable forever, and a replay
+  // takes its keys from the trace, so it polls with a timeout instead, see
+  // editorCancelTimeout
+  if (E.trace.fp && E.trace.replay)
+    return -1;
+  if (E.server.cur != -1)
+    return E.server.client[E.server.cur].fd;
+  return isatty(STDIN_FILENO) ? STDIN_FILENO : -1;
+}
+
+int editorCancelTimeout() {
+  // the poll timeout to go with editorCancelFd, in ms
+  return E.trace.fp && E.trace.replay ? 10 : -1;
+}
+
+int editorCancelled(short revents) {
+  // 1 if Esc was typed, revents is what poll said of editorCancelFd(), never
+  // waits for a key, other keys are dropped
+  char c;
+
+  if (E.trace.fp && E.trace.replay) {
+    // the bytes typed while the command ran in the recording come when they
+    // did then, counting from when the key that started it was handed over
+    if (E.trace.next == -1 ||
+        E.trace.next - E.trace.last > (editorNow() - E.trace.keyend) / 1000)
+      return 0;
+  } else if (!(revents & POLLIN)) {
+    return 0;
+  }
+
+  if (editorReadRaw(&c, 0) != 1 || c != '\x1b')
+    return 0;
+
+  // an arrow or another key that starts with Esc has more bytes right after
+  return editorReadRaw(&c, 1) != 1;
+}
+
 int editorReadKey() {
   int nread;
 
   char c;
 
-  while ((nread = read(STDIN_FILENO, &c, 1)) !=
-         1) { // detects incoming keypress
+  long long waited = E.stats.enabled ? editorNow() : 0;
+
+  while (1) { // detects incoming keypress
+    if (E.follow.fd != -1 && !editorFollowWait())
+      continue; // the followed file grew, but no key has been pressed yet
+    if (E.load.active && E.server.cur == -1 && !editorLoadWait())
+      continue; // more rows were decompressed, but no key has been pressed
+
+    if ((nread = editorReadRaw(&c, 0)) == 1)
+      break;
     if (nread == -1 && errno != EAGAIN)
       die("read");
   }
 
+  if (E.stats.enabled) // waiting for the user is not what a key costs
+    E.stats.wait += editorNow() - waited;
+
   if (c ==
       '\x1b') { // for detecting escape key sequences (arrow and other things)
     char seq[3];
 
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
+    if (editorReadRaw(&seq[0], 1) != 1)
       return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
+    if (editorReadRaw(&seq[1], 1) != 1)
       return '\x1b';
 
     if (seq[0] == '[') { // checks if after the escape character is [ character
       if (seq[1] >= '0' &&
           seq[1] <= '9') { // options when the escape key seq is page_up or
                            // down and home and end key
-        if (read(STDIN_FILENO, &seq[2], 1) != 1)
+        if (editorReadRaw(&seq[2], 1) != 1)
           return '\x1b';
 
         if (seq[2] == '~') { // detects for h/k or pu/pd
@@ -288,1150 +1086,8129 @@ int getWindowSize(int *rows, int *cols) {
 
 // --- SYNTAX HIGHLIGHTING ---
 
+int is_ident(int c) {
+  // a byte that can be in a C identifier
+  return isalnum(c) || c == '_';
+}
+
 int is_separator(int c) {
   // looks for separator, using isspace, null or strchr
   return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c);
 }
 
-void editorUpdateSyntax(erow *row) {
-  row->hl = realloc(
-      row->hl, row->rsize); // allocate hl memory block to be the same as rsize
-  memset(row->hl, HL_NORMAL,
-         row->rsize); // set all character to be HL_NORMAL by default
-
-  if (E.syntax == NULL) // if no filetype is set, return immediately
-                        // by this point, the entire line is set to HL_NORMAL
-    return;
-
-  char **keywords = E.syntax->keywords;
-
-  char *scs = E.syntax->singleline_comment_start;
-  char *mcs = E.syntax->multiline_comment_start; // multiline_comment_start
-  char *mce = E.syntax->multiline_comment_end;   // multiline_comment_end
-  // scs for singleline_comment_start, scs_len is 0 when scs is NULL
-
-  int scs_len = scs ? strlen(scs) : 0;
-  int mcs_len = mcs ? strlen(mcs) : 0;
-  int mce_len = mce ? strlen(mce) : 0;
-
-  int prev_sep = 1; // previous_separator, defaults to 1 -> true,
-  // consider the beginning of the line to be a separator
+int editorLexRow(struct editorLexer *lx, const char *s, int n,
+                 unsigned char *hl, int in_comment) {
+  // highlights the n bytes at s into hl in a single pass, in_comment is the
+  // state carried over from the row above (1 inside a multiline comment),
+  // returns the state to carry over to the next row, strings can't span rows
+  //
+  // the class of each byte decides what it can start, most bytes (letters
+  // after the first one of a word, spaces inside a comment or a string) can't
+  // start anything, so whole runs of them are skipped at once
+  int ml = lx->mcs_len && lx->mce_len;
+  int prev_sep = 1; // the beginning of the line counts as a separator
+  int in_string = 0;
+  int i = 0;
 
-  int in_string = 0; // tracks if the current syntax is in string or not
-  int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
-  // checks if current is inside a comment, by checking previous row
-  // hl_open_comment is set to 1 or not
+  memset(hl, HL_NORMAL, n); // set all character to be HL_NORMAL by default
 
-  int i = 0;
-  while (i < row->rsize) {
-    char c = row->render[i];
-
-    unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
-    // prev_hl set to the hl type of the previous character
-
-    if (scs_len && !in_string &&
-        !in_comment) { // checks if not inside a string and inside comment block
-      // checks the character is the start of the sng-line comment
-      if (!strncmp(&row->render[i], scs, scs_len)) {
-        // set the rest of the row to be HL_COMMENT
-        memset(&row->hl[i], HL_COMMENT, row->rsize - i);
+  while (i < n) {
+    if (in_comment && ml) {
+      // everything up to the end of the comment is comment
+      const char *end = memmem(s + i, n - i, lx->mce, lx->mce_len);
+      if (!end) {
+        memset(&hl[i], HL_MLCOMMENT, n - i);
         break;
       }
-    }
-
-    if (mcs_len && mce_len && !in_string) {
-      if (in_comment) { // checks if in a comment block
-        row->hl[i] = HL_MLCOMMENT;
-
-        if (!strncmp(&row->render[i], mce, mce_len)) {
-          // if on a comment block, set in_comment = 0
-          memset(&row->hl[i], HL_MLCOMMENT, mce_len);
 
-          i += mce_len;
-          in_comment = 0;
+      int j = end - s + lx->mce_len;
+      memset(&hl[i], HL_MLCOMMENT, j - i);
+      i = j;
+      in_comment = 0;
+      prev_sep = 1;
+      continue;
+    }
 
-          prev_sep = 1;
-          continue;
-        } else {
-          i++;
-          continue;
-        }
-      } else if (!strncmp(&row->render[i], mcs,
-                          mcs_len)) { // detects the beginning of comment block
-        memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-        i += mcs_len;
+    if (in_string) {
+      // the string goes on until its quote, skipping what is escaped
+      while (i < n && s[i] != in_string && s[i] != '\\')
+        hl[i++] = HL_STRING;
+      if (i == n)
+        break;
 
-        in_comment = 1;
+      hl[i] = HL_STRING;
+      if (s[i] == '\\' && i + 1 < n) {
+        hl[i + 1] = HL_STRING;
+        i += 2;
         continue;
       }
-    }
-
-    if (E.syntax->flags & HL_HIGHLIGHT_STRINGS) {
-      // checks if the flags is also set to highlight string
-      if (in_string) {
-        // if current char is in string, then hl[i] = HL_STRING
-        row->hl[i] = HL_STRING;
 
-        if (c == '\\' && i + 1 < row->rsize) {
-          // checks the occurance of \' and \"
-          row->hl[i + 1] = HL_STRING;
-          i += 2;
+      if (s[i] == in_string)
+        in_string = 0;
+      i++;
+      prev_sep = 1;
+      continue;
+    }
 
-          // skip the 2 chars and continue to the index += 2
-          continue;
-        }
+    unsigned char c = s[i];
+    int k = lx->cls[c];
 
-        if (c == in_string)
-          in_string = 0; // if current char c is the same as the beginning of
-                         // the string, set in_string = 0
+    if (k == 0 || (k == LX_KW && !prev_sep)) {
+      // a byte that starts nothing, and so do the ones after it
+      i++;
+      while (i < n && (lx->cls[(unsigned char)s[i]] & ~LX_KW) == 0)
         i++;
+      prev_sep = 0;
+      continue;
+    }
 
-        prev_sep = 1;
-        continue;
-      } else {
-        if (c == '"' ||
-            c == '\'') { // checks if current char is dbl-quote or sngl-quot
-          in_string = c;
-
-          // set in_string to c;
-          // and HL_STRING current hl[i]
-          row->hl[i] = HL_STRING;
-
-          i++;
-          continue;
-        }
-      }
+    if ((k & LX_SCS) && !in_comment && i + lx->scs_len <= n &&
+        !memcmp(&s[i], lx->scs, lx->scs_len)) {
+      memset(&hl[i], HL_COMMENT, n - i); // the rest of the row is comment
+      break;
     }
 
-    if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-      if ((isdigit(row->render[i]) && (prev_sep || prev_hl == HL_NUMBER)) ||
-          (c == '.' && prev_hl == HL_NUMBER)) {
-        // to highlight a digit, it is now required that the previous character
-        // needs to be either separator or HL_NUMBER
-        //
-        // additional conditining to highlight decimal point aswell if it is
-        // between a number
+    if ((k & LX_MCS) && i + lx->mcs_len <= n &&
+        !memcmp(&s[i], lx->mcs, lx->mcs_len)) {
+      memset(&hl[i], HL_MLCOMMENT, lx->mcs_len);
+      i += lx->mcs_len;
+      in_comment = 1;
+      continue;
+    }
 
-        row->hl[i] = HL_NUMBER; // set the hl to be a number
-        i++;                    // moves to the next character
+    if (k & LX_QUOTE) {
+      in_string = (char)c;
+      hl[i++] = HL_STRING;
+      continue;
+    }
 
-        prev_sep = 0; // set this to 0, to indicate we are in the middle of
-                      // highlighting something,
-        // and continue the loop
+    if (k & (LX_DIGIT | LX_DOT)) {
+      // a digit after a separator or a number, or a decimal point in one
+      unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+      if (((k & LX_DIGIT) && (prev_sep || prev_hl == HL_NUMBER)) ||
+          ((k & LX_DOT) && prev_hl == HL_NUMBER)) {
+        hl[i++] = HL_NUMBER;
+        prev_sep = 0;
         continue;
       }
     }
 
-    if (prev_sep) { // make sure there is a separator before the char
+    if (prev_sep && (k & LX_KW)) {
+      // only the keywords starting with this byte are tried, in HLDB order
       int j;
-      for (j = 0; keywords[j]; j++) {
-        int klen =
-            strlen(keywords[j]); // checks each keyword available to highlight
-        int kw2 = keywords[j][klen - 1] ==
-                  '|'; // checks if the keyword is the secondary
-
-        if (kw2)
-          klen--; // reduce the klen if kw2 is true
-
-        if (!strncmp(&row->render[i], keywords[j], klen) &&
-            is_separator(row->render[i + klen])) {
-          // checks if the word is separated from strings
-          // compare the string from i to i + klen is actually the keyword
-          //
-          // set the highlight based on what keyword 1 or keyword 2 group
-          memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-
-          i += klen; // jumps the i to i + klen
+      int end = lx->kwfirst[c] + lx->kwcount[c];
+
+      for (j = lx->kwfirst[c]; j < end; j++) {
+        struct editorKeyword *kw = &lx->kw[j];
+        int after = i + kw->len;
+
+        if (after <= n && !memcmp(&s[i], kw->s, kw->len) &&
+            (after == n || (lx->cls[(unsigned char)s[after]] & LX_SEP))) {
+          memset(&hl[i], kw->hl, kw->len);
+          i = after;
           break;
         }
       }
 
-      if (keywords[j] != NULL) {
+      if (j < end) {
         prev_sep = 0;
         continue;
       }
     }
 
-    // if the current character is not highlighted, then set prev_sep
-    // according to whatever the current character is a separator
-
-    prev_sep = is_separator(c);
+    prev_sep = (k & LX_SEP) != 0;
     i++;
   }
 
-  // updates syntax if there is multiline_comment_start
-  int changed = (row->hl_open_comment != in_comment);
-  row->hl_open_comment = in_comment;
-
-  if (changed &&
-      row->idx + 1 <
-          E.numrows) // if hl_open_comment changed, call editorUpdateSyntax
-    editorUpdateSyntax(&E.row[row->idx + 1]);
+  return in_comment;
 }
 
-int editorSyntaxToColor(int hl) {
-  switch (hl) {
-  case HL_COMMENT:
-  case HL_MLCOMMENT:
-    return 36; // gray -> 90, cyan -> 36
-  case HL_KEYWORD1:
-    return 33;
-  case HL_KEYWORD2:
-    return 32;
-  case HL_STRING:
-    return 35; // magenta
-  case HL_NUMBER:
-    return 31; // red
-  case HL_MATCH:
-    return 34; // i believe this is blue
-  default:
-    return 37;
+struct editorLexer *editorLexerCompile(struct editorSyntax *syntax) {
+  // turns a HLDB entry into the tables editorLexRow runs on
+  struct editorLexer *lx = calloc(1, sizeof(struct editorLexer));
+
+  lx->scs = syntax->singleline_comment_start;
+  lx->mcs = syntax->multiline_comment_start;
+  lx->mce = syntax->multiline_comment_end;
+  lx->scs_len = lx->scs ? strlen(lx->scs) : 0;
+  lx->mcs_len = lx->mcs ? strlen(lx->mcs) : 0;
+  lx->mce_len = lx->mce ? strlen(lx->mce) : 0;
+
+  int b;
+  for (b = 0; b < 256; b++) {
+    char c = b; // as a char, the way editorUpdateSyntax always looked at them
+
+    if (is_separator(c))
+      lx->cls[b] |= LX_SEP;
+
+    if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+      if (isdigit(c))
+        lx->cls[b] |= LX_DIGIT;
+      if (c == '.')
+        lx->cls[b] |= LX_DOT;
+    }
+
+    if ((syntax->flags & HL_HIGHLIGHT_STRINGS) && (c == '"' || c == '\''))
+      lx->cls[b] |= LX_QUOTE;
   }
-}
 
-void editorSelectSyntaxHighlight() {
-  E.syntax = NULL;
+  if (lx->scs_len)
+    lx->cls[(unsigned char)lx->scs[0]] |= LX_SCS;
+  if (lx->mcs_len && lx->mce_len)
+    lx->cls[(unsigned char)lx->mcs[0]] |= LX_MCS;
 
-  if (E.filename == NULL)
-    return;
+  // keywords are grouped by their first byte, keeping their order
+  int n = 0;
+  while (syntax->keywords[n])
+    n++;
 
-  char *ext =
-      strrchr(E.filename, '.'); // locates the last occurance of char . in the
-                                // filename if no ext returns NULL
-
-  for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
-    // try to match what is the syntax on the HLDB
-    struct editorSyntax *s = &HLDB[j];
+  lx->kw = malloc(sizeof(struct editorKeyword) * (n ? n : 1));
 
-    unsigned int i = 0;
-    while (s->filematch[i]) {
-      int is_ext = (s->filematch[i][0] == '.');
+  int k = 0;
+  for (b = 0; b < 256; b++) {
+    lx->kwfirst[b] = k;
 
-      // if the pattern starts with . then it is a file ext pattern
-      if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
-          (!is_ext && strstr(E.filename, s->filematch[i]))) {
-        // compare the ext and the filematch[i]
-        E.syntax = s;
+    int j;
+    for (j = 0; j < n; j++) {
+      char *word = syntax->keywords[j];
+      if ((unsigned char)word[0] != b)
+        continue;
 
-        // this for rehighlighting the entire line after setting E.syntax
-        int filerow;
-        for (filerow = 0; filerow < E.numrows; filerow++) {
-          editorUpdateSyntax(&E.row[filerow]);
-        }
-        return;
-      }
+      int len = strlen(word);
+      int kw2 = word[len - 1] == '|'; // secondary keywords end with |
 
-      i++;
+      lx->kw[k].s = word;
+      lx->kw[k].len = kw2 ? len - 1 : len;
+      lx->kw[k].hl = kw2 ? HL_KEYWORD2 : HL_KEYWORD1;
+      k++;
     }
+
+    lx->kwcount[b] = k - lx->kwfirst[b];
+    if (lx->kwcount[b])
+      lx->cls[b] |= LX_KW;
   }
+
+  return lx;
 }
 
-// --- ROW OPERATIONS ---
+int editorHighlightRow(erow *row, int in_comment) {
+  // fills row->hl (which must already have room for rsize bytes) for the
+  // contents of row->render, in_comment tells if the row starts inside a
+  // multiline comment, returns 1 if a multiline comment is still open at the
+  // end of the row
+  if (E.syntax == NULL) {
+    memset(row->hl, HL_NORMAL, row->rsize);
+    return 0;
+  }
 
-int editorRowCxToRx(erow *row, int cx) {
-  // this to deal with movement of the cursor when it find a tab character
-  int rx = 0;
+  return editorLexRow(E.syntax->lexer, row->render, row->rsize, row->hl,
+                      in_comment);
+}
 
-  int j;
-  for (j = 0; j < cx; j++) {
-    if (row->chars[j] == '\t')
-      rx += (KILO_TAB_STOP - 1) -
-            (rx % KILO_TAB_STOP); // to find how many columns are to the right
-                                  // of the last tab stop
+void editorUpdateSyntaxRow(erow *row);
 
-    rx++;
+void editorUpdateSyntax(erow *row) {
+  if (!E.stats.enabled) {
+    editorUpdateSyntaxRow(row);
+    return;
   }
 
-  return rx;
+  long long start = E.stats.depth++ ? 0 : editorNow();
+  editorUpdateSyntaxRow(row);
+  if (--E.stats.depth == 0)
+    E.stats.cur[STAT_SYNTAX] += editorNow() - start;
 }
 
-int editorRowRxToCx(erow *row, int rx) {
-  int cur_rx = 0;
-  int cx;
+void editorUpdateSyntaxRow(erow *row) {
+  // highlights the row, and the rows below as long as a multiline comment
+  // opening or closing changes them
+  row->hl = realloc(
+      row->hl, row->rsize); // allocate hl memory block to be the same as rsize
 
-  // this is basically the inverse of editorRowCxToRx function
+  if (E.syntax == NULL) { // if no filetype is set, return immediately
+    memset(row->hl, HL_NORMAL, row->rsize);
+    editorBracketsRow(row);
+    return;
+  }
 
-  for (cx = 0; cx < row->size; cx++) {
-    if (row->chars[cx] == '\t') // handles when upon meets with tab char
-      cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-    cur_rx++;
+  int in_comment = editorHighlightRow(
+      row, row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
+  // checks if current is inside a comment, by checking previous row
+  // hl_open_comment is set to 1 or not
 
-    if (cur_rx > rx)
-      return cx;
-  }
+  // updates syntax if there is multiline_comment_start
+  int changed = (row->hl_open_comment != in_comment);
+  row->hl_open_comment = in_comment;
 
-  return cx;
+  if (E.symbols.enabled) // the definitions on the row might have changed
+    editorSymbolsRow(row);
+  editorBracketsRow(row); // and so might its brackets
+
+  if (changed &&
+      row->idx + 1 <
+          E.numrows) // if hl_open_comment changed, call editorUpdateSyntax
+    editorUpdateSyntax(&E.row[row->idx + 1]);
 }
 
-void editorUpdateRow(erow *row) {
-  int tabs = 0;
-  int j;
-  for (j = 0; j < row->size;
-       j++) { // counts how many tabs are there within a line
-    if (row->chars[j] == '\t')
-      tabs++;
+int editorSyntaxToColor(int hl) {
+  switch (hl) {
+  case HL_COMMENT:
+  case HL_MLCOMMENT:
+    return 36; // gray -> 90, cyan -> 36
+  case HL_KEYWORD1:
+    return 33;
+  case HL_KEYWORD2:
+    return 32;
+  case HL_STRING:
+    return 35; // magenta
+  case HL_NUMBER:
+    return 31; // red
+  case HL_MATCH:
+    return 34; // i believe this is blue
+  default:
+    return 37;
   }
+}
 
-  free(row->render);
+int editorSyntaxMatches(struct editorSyntax *s, const char *filename) {
+  // tells if the filename is one of the files the syntax is for
+  char *ext =
+      strrchr(filename, '.'); // locates the last occurance of char . in the
+                              // filename if no ext returns NULL
 
-  row->render = malloc(row->size + tabs * (KILO_TAB_STOP - 1) +
-                       1); // sets render size to acommodate tabs
+  unsigned int i = 0;
+  while (s->filematch[i]) {
+    int is_ext = (s->filematch[i][0] == '.');
 
-  int idx = 0; // contains the number of chars copied to row->render
-  for (j = 0; j < row->size; j++) {
-    if (row->chars[j] == '\t') { // when tabs are present
-      row->render[idx++] = ' ';
-      while ((idx % KILO_TAB_STOP) != 0) // iterate until gets to a tab stop,
-                                         // which is a column divisible by 8
-        row->render[idx++] = ' ';
-    } else {
-      row->render[idx++] = row->chars[j];
-    }
+    // if the pattern starts with . then it is a file ext pattern
+    if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
+        (!is_ext && strstr(filename, s->filematch[i])))
+      return 1;
+
+    i++;
   }
 
-  row->render[idx] = '\0';
-  row->rsize = idx;
+  return 0;
+}
 
-  editorUpdateSyntax(row);
+pthread_once_t editorLexerOnce = PTHREAD_ONCE_INIT;
+
+void editorLexerCompileAll() {
+  unsigned int j;
+  for (j = 0; j < HLDB_ENTRIES; j++)
+    HLDB[j].lexer = editorLexerCompile(&HLDB[j]);
 }
 
-void editorInsertRow(int at, char *s, size_t len) {
-  if (at < 0 || at > E.numrows)
-    return;
+void editorSelectSyntaxHighlight() {
+  E.syntax = NULL;
 
-  E.row = realloc(
-      E.row,
-      sizeof(erow) * (E.numrows + 1)); // reallocate the memory to store new row
-  // take the size of the erow and multiply by the number on numrows + 1
+  // HLDB is shared by the batch workers, so it's compiled only once
+  pthread_once(&editorLexerOnce, editorLexerCompileAll);
 
-  memmove(&E.row[at + 1], &E.row[at],
-          sizeof(erow) *
-              (E.numrows -
-               at)); // make room at the specified index fo the next new row
+  if (E.filename == NULL)
+    return;
 
-  for (int j = at + 1; j <= E.numrows; j++)
-    E.row[j].idx++; // updates row index after current row
+  for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
+    // try to match what is the syntax on the HLDB
+    struct editorSyntax *s = &HLDB[j];
 
-  E.row[at].idx = at; // set the row index to at variable
+    if (editorSyntaxMatches(s, E.filename)) {
+      E.syntax = s;
 
-  E.row[at].size = len;
-  E.row[at].chars = malloc(len + 1);
+      // this for rehighlighting the entire line after setting E.syntax
+      int filerow;
+      for (filerow = 0; filerow < E.numrows; filerow++) {
+        editorUpdateSyntax(&E.row[filerow]);
+      }
+      return;
+    }
+  }
+}
 
-  memcpy(E.row[at].chars, s, len);
-  E.row[at].chars[len] = '\0';
+// --- UTF-8 ---
 
-  E.row[at].rsize = 0;
-  E.row[at].render = NULL;
-  E.row[at].hl = NULL;
+int editorIsAscii(const char *s, int n) {
+  // tells if none of the n bytes at s has the high bit set, which is nearly
+  // always the case, 16 bytes are looked at once where SSE2 is there
+  int i = 0;
 
-  E.row[at].hl_open_comment = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    if (_mm_movemask_epi8(v)) // the high bit of every byte
+      return 0;
+  }
+#endif
 
-  editorUpdateRow(&E.row[at]); // for rendering tabs
+  for (; i < n; i++) {
+    if (s[i] & 0x80)
+      return 0;
+  }
 
-  E.numrows++;
-  E.dirty++; // increase the dirty value
+  return 1;
 }
 
-void editorFreeRow(erow *row) {
-  free(row->render); // free the memory by the row we want to delete
-  free(row->chars);
-  free(row->hl);
-}
+int editorDecodeUtf8(const char *s, int n, int *len) {
+  // decodes the sequence at s, which has n bytes at most, sets *len to how
+  // many bytes it takes and returns the code point, or -1 (with *len 1) when
+  // the byte doesn't start a valid sequence
+  const unsigned char *u = (const unsigned char *)s;
+  int cp, need, k;
+
+  *len = 1;
+
+  if (u[0] < 0x80)
+    return u[0];
+
+  if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+    cp = u[0] & 0x1f;
+    need = 1;
+  } else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+    cp = u[0] & 0x0f;
+    need = 2;
+  } else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+    cp = u[0] & 0x07;
+    need = 3;
+  } else {
+    return -1; // a continuation byte, or a lead byte that can't be valid
+  }
 
-void editorDelRow(int at) {
-  if (at < 0 || at >= E.numrows)
-    return; // validate the index if it's valid to delete
+  if (need >= n)
+    return -1; // cut short by the end of the row
 
-  editorFreeRow(&E.row[at]);
-  memmove(
-      &E.row[at], &E.row[at + 1],
-      sizeof(erow) *
-          (E.numrows - at -
-           1)); // overwrite the deleted row struct with the rest of the rows
+  for (k = 1; k <= need; k++) {
+    if ((u[k] & 0xc0) != 0x80)
+      return -1;
+    cp = (cp << 6) | (u[k] & 0x3f);
+  }
 
-  for (int j = at; j < E.numrows - 1; j++)
-    E.row[j].idx--; // decrease the row index below current row
+  // overlong encodings, surrogates and anything past U+10FFFF
+  if ((need == 2 && cp < 0x800) || (need == 3 && cp < 0x10000) ||
+      (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+    return -1;
 
-  E.numrows--;
-  E.dirty++;
+  *len = need + 1;
+  return cp;
 }
 
-void editorRowInsertChar(erow *row, int at, int c) {
-  if (at < 0 || at > row->size)
-    at = row->size; // at is the index we want to insert the character
-  // at can go beyond 0 or beyond the row len limit
-
-  row->chars =
-      realloc(row->chars,
-              row->size + 2); // allocate 2 byte for the new char and null byte
-  memmove(&row->chars[at + 1], &row->chars[at],
-          row->size - at + 1); // make new room for the new chars
-  row->size++;                 // this is self-explanatory
+int editorCodepointWidth(int cp) {
+  // how many columns the code point takes on the screen, combining marks take
+  // none, east asian wide and fullwidth characters and emoji take two
+  static const int zero[][2] = {
+      {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x0610, 0x061a},
+      {0x064b, 0x065f}, {0x0e31, 0x0e31}, {0x0e34, 0x0e3a}, {0x0e47, 0x0e4e},
+      {0x1ab0, 0x1aff}, {0x1dc0, 0x1dff}, {0x200b, 0x200f}, {0x20d0, 0x20ff},
+      {0xfe00, 0xfe0f}, {0xfe20, 0xfe2f}};
+  static const int wide[][2] = {
+      {0x1100, 0x115f},   {0x2e80, 0x303e},   {0x3041, 0x33ff},
+      {0x3400, 0x4dbf},   {0x4e00, 0x9fff},   {0xa000, 0xa4cf},
+      {0xac00, 0xd7a3},   {0xf900, 0xfaff},   {0xfe30, 0xfe4f},
+      {0xff00, 0xff60},   {0xffe0, 0xffe6},   {0x1f300, 0x1f64f},
+      {0x1f900, 0x1f9ff}, {0x20000, 0x2fffd}, {0x30000, 0x3fffd}};
+  unsigned int i;
+
+  if (cp < 0x300) // nothing below is zero width or wide
+    return 1;
+
+  for (i = 0; i < sizeof(zero) / sizeof(zero[0]); i++) {
+    if (cp >= zero[i][0] && cp <= zero[i][1])
+      return 0;
+  }
 
-  row->chars[at] = c;   // assign the char on the appropriate position -> at
-  editorUpdateRow(row); // -> update the row with the new content
+  for (i = 0; i < sizeof(wide) / sizeof(wide[0]); i++) {
+    if (cp >= wide[i][0] && cp <= wide[i][1])
+      return 2;
+  }
 
-  E.dirty++;
+  return 1;
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len) {
-  row->chars = realloc(
-      row->chars,
-      row->size + len +
-          1); // reallocate the new size of the row, + 1 is for the null byte
+int editorCharWidth(const char *s, int n, int *len) {
+  // the columns taken by the character at s, an invalid byte is drawn as a
+  // single ? so it takes one
+  int cp = editorDecodeUtf8(s, n, len);
+  return cp < 0 ? 1 : editorCodepointWidth(cp);
+}
 
-  memcpy(&row->chars[row->size], s, len); // copy the memory
+int editorRenderColumns(const char *s, int n, int *col) {
+  // fills col[b] with the column byte b starts at, the bytes of a sequence
+  // all get the column of its first byte, col[n] is the width of it all
+  int c = 0;
+  int b = 0;
 
-  row->size += len; // update the row size by len
-  row->chars[row->size] = '\0';
+  while (b < n) {
+    if (!(s[b] & 0x80)) {
+      col[b++] = c++;
+      continue;
+    }
 
-  editorUpdateRow(row);
+    int len, k;
+    int w = editorCharWidth(&s[b], n - b, &len);
+    for (k = 0; k < len; k++)
+      col[b + k] = c;
+    b += len;
+    c += w;
+  }
 
-  E.dirty++;
+  col[n] = c;
+  return c;
 }
 
-void editorRowDelChar(erow *row, int at) {
-  if (at < 0 || at >= row->size)
+void editorUpdateWidths(erow *row, int ascii) {
+  // caches the column of every byte of render, but only for the rows that
+  // need it, ascii tells if the row is all ASCII (see editorIsAscii)
+  if (ascii) {
+    free(row->rcol);
+    row->rcol = NULL;
+    row->rcols = row->rsize;
     return;
+  }
 
-  memmove(&row->chars[at], &row->chars[at + 1],
-          row->size - at); // memmove to overwrite the deleted character with
-                           // the characters that come after it
-  row->size--;
-
-  editorUpdateRow(row);
-  E.dirty++;
+  row->rcol = realloc(row->rcol, sizeof(int) * (row->rsize + 1));
+  row->rcols = editorRenderColumns(row->render, row->rsize, row->rcol);
 }
 
-// --- EDITOR OPERATIONS ---
+int editorRowByteToCol(erow *row, int b) {
+  // the column where byte b of render is drawn
+  return row->rcol ? row->rcol[b] : b;
+}
 
-void editorInsertChar(int c) {
-  if (E.cy == E.numrows) { // when the cursor is on the very bottom
-    editorInsertRow(E.numrows, "",
-                    0); // append a new row on there before inserting anything
+int editorRowColToByte(erow *row, int col) {
+  // the first byte of render drawn at column col or after it
+  if (!row->rcol)
+    return col < row->rsize ? col : row->rsize;
+
+  int lo = 0, hi = row->rsize;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (row->rcol[mid] < col)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
 
-  editorRowInsertChar(&E.row[E.cy], E.cx, c); // insert the char
-  E.cx++;
+  return lo;
 }
 
-void editorInsertNewline() {
-  // inserts a new blank line row before the line
-  if (E.cx == 0) {
-    editorInsertRow(E.cy, "", 0);
-  } else {
-    // split the line into two rows, separated by what the cursor is pointing
-    erow *row = &E.row[E.cy];
+int editorIsContinuation(char c) {
+  // a byte in the middle of a UTF-8 sequence, the cursor never stops on one
+  return (c & 0xc0) == 0x80;
+}
 
-    // insert a new row and append string after the cursor when we hit enter
-    editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-    row = &E.row[E.cy];
-    row->size = E.cx;
-    row->chars[row->size] = '\0'; // sets the last index to be null
+// --- LINE INDEX ---
+// where every row starts in the file, in bytes, for going to a line or a byte
+// offset and for the percentage in the status bar, a row takes its size plus
+// the newline, every row keeps its value in an array that moves along with
+// the rows, the rows are summed up in blocks of a few dozen rows and the
+// blocks in a Fenwick tree, so inserting or deleting rows only changes the
+// blocks they are in, and an offset is found in O(log n) plus a walk through
+// one block, a block that grows too big is split, one that gets empty is
+// dropped, and only then is the tree over the blocks built again, the screen
+// lines of soft wrap are summed up by the same kind of tree
+
+void editorSumsAdd(struct editorSums *t, int k, long long sum, int rows) {
+  // block k got sum and rows more, k counted from 0
+  t->block[k].sum += sum;
+  t->block[k].rows += rows;
+  for (k++; k <= t->nblocks; k += k & -k) {
+    t->tree[k].sum += sum;
+    t->tree[k].rows += rows;
+  }
+}
 
-    // this func is always called whenever we have update in the rows
-    editorUpdateRow(row);
+void editorSumsTree(struct editorSums *t) {
+  // builds the tree over the blocks again, after blocks came or went
+  if (t->nblocks + 1 > t->treecap) {
+    t->treecap = t->nblocks + 1 > 2 * t->treecap ? t->nblocks + 1
+                                                  : 2 * t->treecap;
+    t->tree = realloc(t->tree, sizeof(struct editorSumsNode) * t->treecap);
   }
 
-  E.cy++;
-  E.cx = 0;
+  int k;
+  for (k = 1; k <= t->nblocks; k++)
+    t->tree[k] = t->block[k - 1];
+  for (k = 1; k <= t->nblocks; k++) {
+    int up = k + (k & -k);
+    if (up <= t->nblocks) {
+      t->tree[up].sum += t->tree[k].sum;
+      t->tree[up].rows += t->tree[k].rows;
+    }
+  }
 }
 
-void editorDelChar() {
-  if (E.cy == E.numrows)
-    return; // if the cursor are past the the end of the file, nothing to be
-            // deleted
-
-  if (E.cx == 0 && E.cy == 0)
-    return;
+int editorSumsBlock(struct editorSums *t, int at, int by_sum, long long *sum,
+                    int *first) {
+  // walks down the tree to the blocks that come before row at, or with
+  // by_sum before the blocks whose sums go past *sum, returns how many they
+  // are, with their sum in *sum and their rows in *first
+  int pos = 0, rows = 0;
+  long long s = 0;
+  int step = 1;
+  while (step * 2 <= t->nblocks)
+    step *= 2;
+
+  for (; step > 0; step /= 2) {
+    if (pos + step > t->nblocks)
+      continue;
+    struct editorSumsNode *n = &t->tree[pos + step];
+    if (by_sum ? s + n->sum <= *sum : rows + n->rows <= at) {
+      pos += step;
+      s += n->sum;
+      rows += n->rows;
+    }
+  }
 
-  erow *row = &E.row[E.cy]; // grab the pointer of the current row erow
+  *sum = s;
+  *first = rows;
+  return pos;
+}
 
-  if (E.cx > 0) {
-    editorRowDelChar(
-        row, E.cx - 1); // deletes one character and moves the cursor back by 1
-    E.cx--;
-  } else {
-    E.cx = E.row[E.cy - 1].size;
-    editorRowAppendString(&E.row[E.cy - 1], row->chars,
-                          row->size); // append the string on the current line
-                                      // or row to the previous
-    editorDelRow(E.cy);               // deletes the current row / line
+void editorSumsSplit(struct editorSums *t, int k, int first) {
+  // block k, which starts at row first, got too big and is cut up into
+  // blocks of KILO_SUMS_BLOCK rows
+  int rows = t->block[k].rows;
+  int add = (rows + KILO_SUMS_BLOCK - 1) / KILO_SUMS_BLOCK - 1;
+
+  if (t->nblocks + add > t->blockcap) {
+    t->blockcap = t->nblocks + add > 2 * t->blockcap ? t->nblocks + add
+                                                      : 2 * t->blockcap;
+    t->block =
+        realloc(t->block, sizeof(struct editorSumsNode) * t->blockcap);
+  }
+  memmove(&t->block[k + add + 1], &t->block[k + 1],
+          sizeof(struct editorSumsNode) * (t->nblocks - k - 1));
+  t->nblocks += add;
 
-    E.cy--;
+  int j;
+  for (j = k; j <= k + add; j++) {
+    int n = rows < KILO_SUMS_BLOCK ? rows : KILO_SUMS_BLOCK;
+    t->block[j].rows = n;
+    t->block[j].sum = 0;
+    for (; n > 0; n--)
+      t->block[j].sum += t->val[first++];
+    rows -= t->block[j].rows;
   }
+
+  editorSumsTree(t);
 }
 
-// --- FILE I/O ---
+void editorSumsMoved(struct editorSums *t, int at, int removed, int added) {
+  // rows [at, at + removed) were deleted, or added rows were inserted at at,
+  // called before numrows changes, the new rows count 0 until they are
+  // updated
+  if (!t->built)
+    return;
 
-void *editorRowsToString(int *buflen) {
-  int totlen = 0; // store the total length of the entire text
-  int j;
+  long long sum;
+  int first, k;
+
+  if (removed) {
+    sum = 0;
+    k = editorSumsBlock(t, at, 0, &sum, &first);
+    int row = at, left = removed, empty = 0;
+    while (left > 0) {
+      int take = t->block[k].rows - (row - first);
+      if (take > left)
+        take = left;
+      long long s = 0;
+      int j;
+      for (j = row; j < row + take; j++)
+        s += t->val[j];
+      first += t->block[k].rows;
+      editorSumsAdd(t, k, -s, -take);
+      empty |= t->block[k].rows == 0;
+      row += take;
+      left -= take;
+      k++;
+    }
 
-  for (j = 0; j < E.numrows; j++) {
-    totlen += E.row[j].size + 1; // adding one to each line for return char
+    memmove(&t->val[at], &t->val[at + removed],
+            sizeof(long long) * (t->n - at - removed));
+    t->n -= removed;
+
+    if (empty) { // the blocks that got empty go
+      int j = 0;
+      for (k = 0; k < t->nblocks; k++)
+        if (t->block[k].rows)
+          t->block[j++] = t->block[k];
+      t->nblocks = j;
+      editorSumsTree(t);
+    }
   }
 
-  *buflen = totlen;
-
-  char *buf = malloc(totlen); // allocate the required memory
-  char *p = buf;              // pointer to buf
+  if (added) {
+    if (t->n + added > t->cap) {
+      t->cap = t->n + added > 2 * t->cap ? t->n + added : 2 * t->cap;
+      t->val = realloc(t->val, sizeof(long long) * t->cap);
+    }
+    memmove(&t->val[at + added], &t->val[at],
+            sizeof(long long) * (t->n - at));
+    memset(&t->val[at], 0, sizeof(long long) * added);
+    t->n += added;
+
+    if (t->nblocks == 0) {
+      if (t->blockcap == 0) {
+        t->blockcap = 16;
+        t->block = malloc(sizeof(struct editorSumsNode) * t->blockcap);
+      }
+      t->nblocks = 1;
+      t->block[0].sum = 0;
+      t->block[0].rows = 0;
+      editorSumsTree(t);
+    }
 
-  for (j = 0; j < E.numrows; j++) {
-    memcpy(p, E.row[j].chars,
-           E.row[j].size); // copy the entire line to the p -> buf
-    p += E.row[j].size;    // move the pointer in size with the row
-    *p = '\n';             // add return char at the end
-    p++;                   // move the pointer by 1
+    // into the block holding row at, or the last one for rows at the end
+    sum = 0;
+    k = editorSumsBlock(t, at, 0, &sum, &first);
+    if (k == t->nblocks) {
+      k--;
+      first -= t->block[k].rows;
+    }
+    editorSumsAdd(t, k, 0, added);
+    if (t->block[k].rows > 2 * KILO_SUMS_BLOCK)
+      editorSumsSplit(t, k, first);
   }
-
-  return buf; // returns the pointer of buf, expected to free the memory by the
-              // caller
 }
 
-void editorOpen(char *filename) {
-  free(E.filename);
+void editorSumsUpdate(struct editorSums *t, int at, long long value) {
+  // row at has a new value, a point update of its block
+  if (!t->built)
+    return; // measured when it is built
 
-  E.filename = strdup(filename); // duplicates filename to E.filename
+  long long delta = value - t->val[at];
+  if (!delta)
+    return;
+  t->val[at] = value;
 
-  editorSelectSyntaxHighlight();
+  long long sum = 0;
+  int first;
+  editorSumsAdd(t, editorSumsBlock(t, at, 0, &sum, &first), delta, 0);
+}
 
-  FILE *fp = fopen(
-      filename,
-      "r"); // open the file based on the argument passed when running the app
+void editorSumsBuild(struct editorSums *t, long long (*leaf)(erow *row)) {
+  // measures every row, the first time the sums are asked for, or after
+  // they were dropped, leaf gives the value of a row
+  if (t->built)
+    return;
 
-  if (!fp)
-    die("fopen");
+  if (E.numrows > t->cap) {
+    t->cap = E.numrows;
+    t->val = realloc(t->val, sizeof(long long) * t->cap);
+  }
+  t->n = E.numrows;
 
-  char *line = NULL;
+  int j;
+  for (j = 0; j < t->n; j++)
+    t->val[j] = leaf(&E.row[j]);
 
-  size_t linecap = 0; // line capacity, to know how much memory is allocated
-  ssize_t linelen;
+  t->nblocks = 0;
+  t->built = 1;
+  if (t->n == 0)
+    return;
 
-  while ((linelen = getline(&line, &linecap, fp)) !=
-         -1) { // continously read each line of the provided file argument
-               // until it reaches the EOF
-    // to read line doesnt matter the length until it reaches \n
+  // a single block for all of them, cut up like one that grew
+  if (t->blockcap == 0) {
+    t->blockcap = 16;
+    t->block = malloc(sizeof(struct editorSumsNode) * t->blockcap);
+  }
+  t->nblocks = 1;
+  t->block[0].rows = t->n;
+  editorSumsSplit(t, 0, 0);
+}
 
-    while (linelen > 0 &&
-           (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-      linelen--;
+void editorSumsFree(struct editorSums *t) {
+  free(t->val);
+  free(t->block);
+  free(t->tree);
+  memset(t, 0, sizeof(*t));
+}
 
-    editorInsertRow(E.numrows, line, linelen);
-  }
+long long editorSumsPrefix(struct editorSums *t, int at) {
+  // the sum of the rows before at, the sums have to be built
+  long long sum = 0;
+  int first;
+  editorSumsBlock(t, at, 0, &sum, &first);
+  for (; first < at; first++)
+    sum += t->val[first];
 
-  free(line);
-  fclose(fp);
+  return sum;
+}
 
-  E.dirty = 0; // sets E.dirty to 0 after opening a file
+int editorSumsFind(struct editorSums *t, long long sum) {
+  // the row whose part of the sums holds sum, the blocks before it are found
+  // by walking down the tree, then the rows of its block are gone through
+  long long s = sum;
+  int pos;
+  editorSumsBlock(t, 0, 1, &s, &pos);
+  sum -= s;
+  for (; pos < t->n && t->val[pos] <= sum; pos++)
+    sum -= t->val[pos];
+
+  return pos; // rows before pos end at or before sum
 }
 
-void editorSave() {
-  if (E.filename == NULL) {
-    E.filename = editorPrompt("Save as: %s", NULL);
+long long editorLinesLeaf(erow *row) { return row->size + 1; }
 
-    if (E.filename == NULL) {
-      editorSetStatusMessage("Save aborted");
-      return;
-    }
+void editorLinesMoved(int at, int removed, int added) {
+  // rows [at, at + removed) were deleted, or added rows were inserted at at,
+  // called after editorBracketsMoved, a fold dropped there measures its rows
+  // again at the places they still have
+  editorSumsMoved(&E.lines, at, removed, added);
+  editorSumsMoved(&E.wrap.lines, at, removed, added);
+}
 
-    editorSelectSyntaxHighlight();
-  }
+void editorLinesUpdate(erow *row) {
+  // the size of row changed, and so might the screen lines it wraps to
+  editorSumsUpdate(&E.lines, row->idx, row->size + 1);
+  if (E.wrap.lines.built)
+    editorSumsUpdate(&E.wrap.lines, row->idx, editorWrapHeight(row));
+}
 
-  int len;
-  char *buf = editorRowsToString(&len);
+long long editorLinesOffset(int at) {
+  // the byte offset row at starts at, at can be numrows for the file size
+  editorSumsBuild(&E.lines, editorLinesLeaf);
+  return editorSumsPrefix(&E.lines, at);
+}
 
-  int fd = open(E.filename, O_RDWR | O_CREAT,
-                0644); // create the file based on the name of the filename
-  // O_RDWR -> reading and writing
-  // O_CREAT -> create new file if it doesnt already exist, 0644 is the argument
-  // for fie permission, just like the chmod file/dir permission
+int editorLinesRowAt(long long off) {
+  // the row the byte at off belongs to
+  editorSumsBuild(&E.lines, editorLinesLeaf);
+  return editorSumsFind(&E.lines, off);
+}
 
-  if (fd != -1) {
-    if (ftruncate(fd, len) != -1) {
-      // sets the file size to len, and also truncate any data
-      // that is larger than len
-      // the normal way to overwrite a file is to pass O_TRUNC flag to open()
-      // func
-      // -> trucates the file completely truncating the file len first is
-      // actually safer, since if the write operation below us fails, we still
-      // have the remaining data until the new len, so we don't actually lose
-      // all the stuff.
-      //
-      // most advanced editors will write to a new temp file, then rename the
-      // file to the actual file that user wants to overwrite, and then
-      // carefully check for errors through the whole process
-
-      if (write(fd, buf, len) == len) {
-        close(fd);
-        free(buf);
-
-        E.dirty = 0; // sets the dirty value to 0 after saving the file
-
-        editorSetStatusMessage("%d bytes written to disk",
-                               len); // send message to messagebuf
-        return;
-      } // write the bytes
-    }
-    close(fd); // close the open
+// --- WORDS ---
+// every word of the buffer (an identifier, 2 bytes at least) with how many
+// times it appears, in a ternary search tree, so the words starting with a
+// prefix are found by walking down the prefix, the counts are built from
+// every row the first time a completion is asked for, after that every
+// editorUpdateRow only counts what changed between the old and the new row
+
+int editorWordsNode(unsigned char c) {
+  if (E.words.n == 0)
+    E.words.n = 1; // node 0 means none
+
+  if (E.words.n >= E.words.cap) {
+    E.words.cap = E.words.cap ? E.words.cap * 2 : 1024;
+    E.words.node =
+        realloc(E.words.node, sizeof(struct editorWordNode) * E.words.cap);
   }
 
-  free(buf);
-  editorSetStatusMessage(
-      "Can't save! I/O error: %s",
-      strerror(errno)); // strerror returns the human readable string for the
-                        // provided error code
+  struct editorWordNode *node = &E.words.node[E.words.n];
+  node->c = c;
+  node->lo = node->eq = node->hi = 0;
+  node->count = 0;
+
+  return E.words.n++;
 }
 
-// --- FIND ---
+void editorWordsAdd(const char *w, int len, int delta) {
+  // adds delta to the count of the word w
+  if (E.words.n <= 1)
+    editorWordsNode(w[0]); // the root is node 1
 
-void editorFindCallback(char *query, int key) {
-  static int last_match = -1;
-  static int direction = 1;
+  int cur = 1;
+  int i = 0;
 
-  static int saved_hl_line;     // save the previous line highlighted
-  static char *saved_hl = NULL; // save the original hl line
+  while (1) {
+    unsigned char c = w[i];
+    int next;
 
-  if (saved_hl) {
-    memcpy(E.row[saved_hl_line].hl, saved_hl, E.row[saved_hl_line].rsize);
-    free(saved_hl); // free the fucking memory, after hl is restored
+    if (c < E.words.node[cur].c) {
+      if ((next = E.words.node[cur].lo) == 0) {
+        next = editorWordsNode(c); // may move the nodes
+        E.words.node[cur].lo = next;
+      }
+    } else if (c > E.words.node[cur].c) {
+      if ((next = E.words.node[cur].hi) == 0) {
+        next = editorWordsNode(c);
+        E.words.node[cur].hi = next;
+      }
+    } else {
+      if (++i == len) {
+        E.words.node[cur].count += delta;
+        return;
+      }
 
-    saved_hl = NULL;
-  }
+      if ((next = E.words.node[cur].eq) == 0) {
+        next = editorWordsNode(w[i]);
+        E.words.node[cur].eq = next;
+      }
+    }
 
-  if (key == '\r' || key == '\x1b') {
-    last_match = -1;
-    direction = 1;
-    return;
-  } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
-    direction = 1;
-  } else if (key == ARROW_LEFT || key == ARROW_UP) {
-    direction = -1;
-  } else {
-    last_match = -1;
-    direction = 1;
+    cur = next;
   }
+}
 
-  if (last_match == -1)
-    direction = 1;
-
-  int current =
-      last_match; // current is the index of the current row we are searching
-  // if there was a last match, it starts on the line after,
-  // if there isnt is starts at the top of the file
+void editorWordsCount(const char *s, int n, int delta) {
+  // adds delta to the count of every word in the n bytes at s
+  int i = 0;
 
-  int i;
-  for (i = 0; i < E.numrows; i++) {
-    current += direction;
-    if (current == -1)
-      current = E.numrows - 1; // causes current to go from the end of the file
-                               // back to the beginning
-    else if (current == E.numrows)
-      current = 0;
-
-    erow *row = &E.row[current];
-
-    char *match = strstr(row->render, query);
-    // query search using strstr function
-    // the rest is self-explanatory code
-
-    if (match) {
-      last_match = current; // updates last_match to current
-      E.cy = current;
-      E.cx = editorRowRxToCx(
-          row,
-          match - row->render); // converts the rx to cx, since cx is referring
-                                // to the position of char, not on the screen
-      E.rowoff = E.numrows;
-
-      saved_hl_line = current;       // set the current hl to saved_hl_line
-      saved_hl = malloc(row->rsize); // make the size fit for the line
-      memcpy(saved_hl, row->hl,
-             row->rsize); // copy the entire content of the line
-      memset(&row->hl[match - row->render], HL_MATCH,
-             strlen(query)); // highlight the search match
-      // match - row->render is the index of the matched search keyword
-      break;
+  while (i < n) {
+    if (!is_ident((unsigned char)s[i])) {
+      i++;
+      continue;
     }
+
+    int j = i;
+    while (j < n && is_ident((unsigned char)s[j]))
+      j++;
+
+    if (j - i >= 2 && !isdigit((unsigned char)s[i]))
+      editorWordsAdd(&s[i], j - i, delta);
+    i = j;
   }
 }
 
-void editorFind() {
-  int saved_cx = E.cx;
-  int saved_cy = E.cy;
-  int saved_coloff = E.coloff;
-  int saved_rowoff = E.rowoff;
+void editorWordsDiff(const char *old, int oldlen, const char *new,
+                     int newlen) {
+  // a row went from old to new, only the words touching the bytes between
+  // their common beginning and their common end are counted again
+  int p = 0, q = 0;
 
-  char *query =
-      editorPrompt("Search: %s (Use ESC/Arrows/Enter)", editorFindCallback);
+  while (p < oldlen && p < newlen && old[p] == new[p])
+    p++;
+  while (q < oldlen - p && q < newlen - p &&
+         old[oldlen - 1 - q] == new[newlen - 1 - q])
+    q++;
 
-  if (query)
-    free(query);
-  else {
-    E.cx = saved_cx;
-    E.cy = saved_cy;
-    E.coloff = saved_coloff;
-    E.rowoff = saved_rowoff;
-  }
-}
+  if (p == oldlen && p == newlen)
+    return; // nothing changed, like a row highlighted again
 
-// --- INPUT ---
+  int start = p; // back to the start of the word, the same in both
+  while (start > 0 && is_ident((unsigned char)old[start - 1]))
+    start--;
 
-char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
-  // prompt is expected to be a format string containing a %s user input
-  size_t bufsize = 128;        // user input will be stored in this buf
-  char *buf = malloc(bufsize); // here on buf
+  int oldend = oldlen - q;
+  while (oldend < oldlen && is_ident((unsigned char)old[oldend]))
+    oldend++;
 
-  size_t buflen = 0;
-  buf[0] = '\0'; // initialize the buf string to empty string, despite there is
-                 // null char inside
+  int newend = newlen - q;
+  while (newend < newlen && is_ident((unsigned char)new[newend]))
+    newend++;
 
-  while (1) {
-    editorSetStatusMessage(prompt, buf);
-    editorRefreshScreen();
+  editorWordsCount(&old[start], oldend - start, -1);
+  editorWordsCount(&new[start], newend - start, 1);
+}
 
-    int c = editorReadKey(); // read the key user press after
-    if (c == '\x1b') {
-      editorSetStatusMessage("");
-      if (callback)
-        callback(buf, c);
+void editorWordsBuild() {
+  int j;
+  for (j = 0; j < E.numrows; j++)
+    editorWordsCount(E.row[j].render, E.row[j].rsize, 1);
+  E.words.built = 1;
+}
 
-      free(buf);
-      return NULL;
-    } else if (c ==
-               '\r') { // if the key pressed is enter, clear the status message
-      if (buflen != 0) { // and if the buf is not empty
-        editorSetStatusMessage("");
-        if (callback)
-          callback(buf, c);
+void editorWordsCollect(int cur, char *word, int len, int max, char **out,
+                        int *n) {
+  // the words in the subtree of cur, in order, word holds the len bytes
+  // leading to cur
+  while (cur && *n < max) {
+    struct editorWordNode *node = &E.words.node[cur];
 
-        return buf;
-      }
-    } else if (!iscntrl(c) && c < 128) { // if c is not a control or special
-                                         // key (key id is less than 128)
-      if (buflen == bufsize - 1) { // if the buflen reached the maximum capacity
-        bufsize *= 2;              // double the size of the bufsize
-        buf = realloc(buf, bufsize); // and reallocate them
-      }
+    if (node->lo)
+      editorWordsCollect(node->lo, word, len, max, out, n);
+    if (*n >= max || len + 1 >= KILO_WORD_MAX)
+      return;
 
-      buf[buflen++] = c;
-      buf[buflen] = '\0';
-    } else if (c == BACKSPACE || c == DEL_KEY || c == CTRL_KEY('h')) {
-      // when the key pressed is the bs, del, or ctrl-h
+    node = &E.words.node[cur];
+    word[len] = node->c;
 
-      if (buflen != 0)
-        buf[--buflen] = '\0';
+    if (node->count > 0) {
+      out[(*n)++] = strndup(word, len + 1);
+      if (*n >= max)
+        return;
     }
 
-    if (callback)
-      callback(buf, c);
+    if (node->eq)
+      editorWordsCollect(node->eq, word, len + 1, max, out, n);
+
+    cur = node->hi; // the hi side is a loop, not a recursion
   }
 }
 
-void editorMoveCursor(int key) {
-  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-  // to know what is the len of current line
+int editorWordsComplete(const char *prefix, int plen, char **out, int max) {
+  // the words starting with prefix, longer than it, in order, at most max
+  // of them, the strings are to be freed by the caller
+  if (!E.words.built)
+    editorWordsBuild();
 
-  // to move the cursor inside the terminal window, and also checks whether
-  // the cursor has reaches the end of each side of the window
-  switch (key) {
-  case ARROW_LEFT:
-    if (E.cx != 0)
-      E.cx--;
-    else if (E.cy >
-             0) { // allow cursor when hit the left screen to continue upward
-      E.cy--;
-      E.cx = E.row[E.cy].size;
-    }
-    break;
-  case ARROW_RIGHT:
-    if (row && E.cx < row->size) { // preventing user to able to move the
-                                   // cursor outside of the line
-      E.cx++;
-    } else if (row &&
-               E.cx == row->size) { // makes the cursor put to the beginning
-                                    // of new line when reaches the end
-      E.cy++;
-      E.cx = 0;
-    }
-    break;
-  case ARROW_UP:
-    if (E.cy != 0)
-      E.cy--;
-    break;
-  case ARROW_DOWN:
-    if (E.cy < E.numrows)
-      E.cy++;
-    break;
+  if (plen == 0 || plen >= KILO_WORD_MAX || E.words.n <= 1)
+    return 0;
+
+  int cur = 1;
+  int i = 0;
+
+  while (cur) { // down to the node of the last byte of the prefix
+    unsigned char c = prefix[i];
+    if (c < E.words.node[cur].c)
+      cur = E.words.node[cur].lo;
+    else if (c > E.words.node[cur].c)
+      cur = E.words.node[cur].hi;
+    else if (++i == plen)
+      break;
+    else
+      cur = E.words.node[cur].eq;
   }
 
-  row = (E.cy >= E.numrows) ? NULL
-                            : &E.row[E.cy]; // the next line or previous line
+  if (!cur || !E.words.node[cur].eq)
+    return 0;
 
-  int rowlen = row ? row->size : 0;
+  char word[KILO_WORD_MAX];
+  int n = 0;
 
-  if (E.cx > rowlen) {
-    E.cx = rowlen; // forces the cursor to stay in the last character on each
-                   // line after doing cursor movement (up or down)
-  }
+  memcpy(word, prefix, plen);
+  editorWordsCollect(E.words.node[cur].eq, word, plen, max, out, &n);
+
+  return n;
 }
 
-void editorProcessKeypress() {
-  // handles what key is pressed
-  int c = editorReadKey();
+// --- ROW OPERATIONS ---
 
-  static int quit_times =
-      KILO_QUIT_TIMES; // keep track how many Ctrl-Q has been pressed
+int editorRenderChars(const char *chars, int size, char *render, int ascii) {
+  // copies chars into render with the tabs expanded, returns the length of
+  // render, tab stops are counted in columns, which are bytes when ascii
+  int idx = 0; // contains the number of chars copied to render
+  int col = 0;
+  int j;
 
-  switch (c) {
-  case '\r':
-    // when enter key is pressed
-    editorInsertNewline();
-    break;
+  for (j = 0; j < size; j++) {
+    if (chars[j] == '\t') { // when tabs are present
+      do {
+        render[idx++] = ' ';
+        col++;
+      } while ((col % KILO_TAB_STOP) != 0); // iterate until gets to a tab
+                                            // stop, a column divisible by 8
+    } else if (!ascii && (chars[j] & 0x80)) {
+      int len;
+      col += editorCharWidth(&chars[j], size - j, &len);
+      memcpy(&render[idx], &chars[j], len);
+      idx += len;
+      j += len - 1;
+    } else {
+      render[idx++] = chars[j];
+      col++;
+    }
+  }
 
-  case CTRL_KEY('q'):
+  render[idx] = '\0';
+  return idx;
+}
 
-    if (E.dirty && quit_times > 0) {
-      editorSetStatusMessage("WARNING!!! File has unsaved changes. "
-                             "Press Ctrl-Q %d more times to quit.",
-                             quit_times);
-      quit_times--;
+int editorRowCxToRx(erow *row, int cx) {
+  // this to deal with movement of the cursor when it find a tab character
+  int rx = 0;
 
-      return;
+  int j;
+  for (j = 0; j < cx; j++) {
+    if (row->chars[j] & 0x80) { // a UTF-8 sequence, it may be 0 or 2 wide
+      int len;
+      rx += editorCharWidth(&row->chars[j], row->size - j, &len);
+      j += len - 1;
+      continue;
     }
 
-    write(STDOUT_FILENO, "\x1b[2J", 4);
-    write(STDOUT_FILENO, "\x1b[H", 3);
-    exit(0);
-    break;
+    if (row->chars[j] == '\t')
+      rx += (KILO_TAB_STOP - 1) -
+            (rx % KILO_TAB_STOP); // to find how many columns are to the right
+                                  // of the last tab stop
 
-  case CTRL_KEY('s'):
+    rx++;
+  }
 
-    editorSave();
-    break;
+  return rx;
+}
 
-  case HOME_KEY:
-    E.cx = 0;
-    break;
+int editorRowRxToCx(erow *row, int rx) {
+  int cur_rx = 0;
+  int cx;
 
-  case END_KEY:
-    if (E.cy < E.numrows)
-      E.cx = E.row[E.cy].size; // ensures to move to the end of the line
-                               // defined by the row cy size
-    break;
+  // this is basically the inverse of editorRowCxToRx function
 
-  case CTRL_KEY('f'):
-    editorFind();
-    break;
+  cx = 0;
+  while (cx < row->size) {
+    int len = 1;
 
-  case BACKSPACE:
-  case CTRL_KEY('h'):
-  case DEL_KEY:
-    if (c == DEL_KEY) // when the pressed key is DEL_KEY, move the cursor to
-                      // the right by 1
+    if (row->chars[cx] & 0x80) {
+      cur_rx += editorCharWidth(&row->chars[cx], row->size - cx, &len);
+    } else {
+      if (row->chars[cx] == '\t') // handles when upon meets with tab char
+        cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
+      cur_rx++;
+    }
+
+    if (cur_rx > rx)
+      return cx;
+    cx += len;
+  }
+
+  return cx;
+}
+
+void editorUpdateRow(erow *row) {
+  int tabs = 0;
+  int j;
+  for (j = 0; j < row->size;
+       j++) { // counts how many tabs are there within a line
+    if (row->chars[j] == '\t')
+      tabs++;
+  }
+
+  char *old = row->render; // kept until the words are counted again
+  int oldsize = row->rsize;
+
+  row->render = malloc(row->size + tabs * (KILO_TAB_STOP - 1) +
+                       1); // sets render size to acommodate tabs
+
+  int ascii = editorIsAscii(row->chars, row->size);
+
+  row->rsize = editorRenderChars(row->chars, row->size, row->render, ascii);
+
+  if (E.words.built)
+    editorWordsDiff(old ? old : "", old ? oldsize : 0, row->render,
+                    row->rsize);
+  free(old);
+
+  editorUpdateWidths(row, ascii);
+  editorLinesUpdate(row);
+  editorUpdateSyntax(row);
+  row->version = ++E.edits; // anything cached for the old render is stale
+}
+
+void editorInsertRow(int at, char *s, size_t len) {
+  if (at < 0 || at > E.numrows)
+    return;
+
+  if (E.symbols.enabled)
+    editorSymbolsMoved(at, 0, 1);
+  editorBracketsMoved(at, 0, 1);
+  editorLinesMoved(at, 0, 1);
+
+  if (E.numrows == E.rowcap) {
+    // grow the row array geometrically, so appending many rows (opening a big
+    // file, following a log) costs amortized O(1) per row instead of a
+    // realloc for each one
+    E.rowcap = E.rowcap ? E.rowcap * 2 : 16;
+    E.row = realloc(E.row, sizeof(erow) * E.rowcap);
+  }
+
+  memmove(&E.row[at + 1], &E.row[at],
+          sizeof(erow) *
+              (E.numrows -
+               at)); // make room at the specified index fo the next new row
+
+  for (int j = at + 1; j <= E.numrows; j++)
+    E.row[j].idx++; // updates row index after current row
+
+  E.row[at].idx = at; // set the row index to at variable
+
+  E.row[at].size = len;
+  E.row[at].chars = malloc(len + 1);
+
+  memcpy(E.row[at].chars, s, len);
+  E.row[at].chars[len] = '\0';
+
+  E.row[at].rsize = 0;
+  E.row[at].render = NULL;
+  E.row[at].hl = NULL;
+  E.row[at].rcol = NULL;
+
+  E.row[at].hl_open_comment = 0;
+
+  editorUpdateRow(&E.row[at]); // for rendering tabs
+
+  E.numrows++;
+  E.dirty++; // increase the dirty value
+}
+
+void editorInsertRowsEx(int at, char **lines, int *sizes, int n, int take) {
+  // inserts n rows at at with a single memmove, instead of calling
+  // editorInsertRow n times, which would move the rows below n times, with
+  // take the rows get the buffers in lines instead of copies of them, they
+  // need room for a '\0' after the line
+  if (at < 0 || at > E.numrows || n <= 0)
+    return;
+
+  if (E.symbols.enabled)
+    editorSymbolsMoved(at, 0, n);
+  editorBracketsMoved(at, 0, n);
+  editorLinesMoved(at, 0, n);
+
+  if (E.numrows + n > E.rowcap) {
+    while (E.numrows + n > E.rowcap)
+      E.rowcap = E.rowcap ? E.rowcap * 2 : 16;
+    E.row = realloc(E.row, sizeof(erow) * E.rowcap);
+  }
+
+  memmove(&E.row[at + n], &E.row[at], sizeof(erow) * (E.numrows - at));
+
+  int numrows = E.numrows + n;
+  int j;
+  for (j = at + n; j < numrows; j++)
+    E.row[j].idx = j;
+
+  for (j = 0; j < n; j++) {
+    erow *row = &E.row[at + j];
+    row->idx = at + j;
+    row->size = sizes[j];
+    row->chars = take ? lines[j] : malloc(sizes[j] + 1);
+    if (!take)
+      memcpy(row->chars, lines[j], sizes[j]);
+    row->chars[sizes[j]] = '\0';
+    row->rsize = 0;
+    row->render = NULL;
+    row->hl = NULL;
+    row->rcol = NULL;
+    row->hl_open_comment = 0;
+  }
+
+  // the new rows are rendered in order, a multiline comment opened in one
+  // of them must only reach the ones after it once they are rendered, the
+  // last one can reach the old rows below
+  for (j = 0; j < n; j++) {
+    E.numrows = j == n - 1 ? numrows : at + j + 1;
+    editorUpdateRow(&E.row[at + j]);
+  }
+
+  E.dirty++;
+}
+
+void editorInsertRows(int at, char **lines, int *sizes, int n) {
+  editorInsertRowsEx(at, lines, sizes, n, 0);
+}
+
+void editorFreeRow(erow *row) {
+  if (E.words.built) // its words are gone
+    editorWordsCount(row->render, row->rsize, -1);
+
+  free(row->render); // free the memory by the row we want to delete
+  free(row->chars);
+  free(row->hl);
+  free(row->rcol);
+}
+
+void editorDelRow(int at) {
+  if (at < 0 || at >= E.numrows)
+    return; // validate the index if it's valid to delete
+
+  if (E.symbols.enabled)
+    editorSymbolsMoved(at, 1, 0);
+  editorBracketsMoved(at, 1, 0);
+  editorLinesMoved(at, 1, 0);
+  editorFreeRow(&E.row[at]);
+  memmove(
+      &E.row[at], &E.row[at + 1],
+      sizeof(erow) *
+          (E.numrows - at -
+           1)); // overwrite the deleted row struct with the rest of the rows
+
+  for (int j = at; j < E.numrows - 1; j++)
+    E.row[j].idx--; // decrease the row index below current row
+
+  E.numrows--;
+  E.dirty++;
+  E.edits++;
+}
+
+void editorRowInsertChar(erow *row, int at, int c) {
+  if (at < 0 || at > row->size)
+    at = row->size; // at is the index we want to insert the character
+  // at can go beyond 0 or beyond the row len limit
+
+  row->chars =
+      realloc(row->chars,
+              row->size + 2); // allocate 2 byte for the new char and null byte
+  memmove(&row->chars[at + 1], &row->chars[at],
+          row->size - at + 1); // make new room for the new chars
+  row->size++;                 // this is self-explanatory
+
+  row->chars[at] = c;   // assign the char on the appropriate position -> at
+  editorUpdateRow(row); // -> update the row with the new content
+
+  E.dirty++;
+}
+
+void editorRowAppendString(erow *row, char *s, size_t len) {
+  row->chars = realloc(
+      row->chars,
+      row->size + len +
+          1); // reallocate the new size of the row, + 1 is for the null byte
+
+  memcpy(&row->chars[row->size], s, len); // copy the memory
+
+  row->size += len; // update the row size by len
+  row->chars[row->size] = '\0';
+
+  editorUpdateRow(row);
+
+  E.dirty++;
+}
+
+void editorRowDelChar(erow *row, int at, int len) {
+  // deletes the character at, which is len bytes long in UTF-8
+  if (at < 0 || at + len > row->size)
+    return;
+
+  memmove(&row->chars[at], &row->chars[at + len],
+          row->size - at - len + 1); // memmove to overwrite the deleted
+                                     // character with the characters that
+                                     // come after it, and the '\0'
+  row->size -= len;
+
+  editorUpdateRow(row);
+  E.dirty++;
+}
+
+void editorDelRows(int at, int n) {
+  // deletes n rows starting at at with a single memmove, instead of calling
+  // editorDelRow n times, which would move the rows below n times
+  if (at < 0 || n <= 0 || at >= E.numrows)
+    return;
+  if (n > E.numrows - at)
+    n = E.numrows - at;
+
+  if (E.symbols.enabled)
+    editorSymbolsMoved(at, n, 0);
+  editorBracketsMoved(at, n, 0);
+  editorLinesMoved(at, n, 0);
+
+  int j;
+  for (j = at; j < at + n; j++)
+    editorFreeRow(&E.row[j]);
+
+  memmove(&E.row[at], &E.row[at + n],
+          sizeof(erow) * (E.numrows - at - n));
+
+  E.numrows -= n;
+  for (j = at; j < E.numrows; j++)
+    E.row[j].idx = j;
+
+  E.dirty++;
+  E.edits++;
+}
+
+int editorRowReplace(erow *row, char *query, int qlen, char *with, int wlen,
+                     char **old) {
+  // replaces every occurrence of query in the row with a single new buffer,
+  // the row is rendered and highlighted only once no matter how many
+  // occurrences there were, returns the number of replacements, if old is
+  // not NULL the previous chars are handed over there instead of freed
+  if (qlen == 0)
+    return 0;
+
+  int n = 0;
+  char *p = row->chars;
+  char *end = row->chars + row->size;
+  char *m;
+
+  while ((m = memmem(p, end - p, query, qlen))) { // count them first
+    n++;
+    p = m + qlen;
+  }
+
+  if (n == 0)
+    return 0;
+
+  int size = row->size + n * (wlen - qlen);
+  char *chars = malloc(size + 1);
+  char *out = chars;
+
+  p = row->chars;
+  while ((m = memmem(p, end - p, query, qlen))) {
+    memcpy(out, p, m - p); // the text between the matches
+    out += m - p;
+    memcpy(out, with, wlen);
+    out += wlen;
+    p = m + qlen;
+  }
+
+  memcpy(out, p, end - p); // and whatever is left after the last one
+  chars[size] = '\0';
+
+  if (old)
+    *old = row->chars;
+  else
+    free(row->chars);
+  row->chars = chars;
+  row->size = size;
+
+  editorUpdateRow(row);
+  E.dirty++;
+
+  return n;
+}
+
+// --- SOFT WRAP ---
+// with wrap on (Ctrl-W or -w) a row goes on over as many screen lines as it
+// takes instead of scrolling sideways, a screen line is cut before the first
+// character that doesn't fit in the text columns anymore, and the end of the
+// row takes a column too, for the cursor, how many screen lines every row
+// takes is kept in a tree like the line index, point updated by
+// editorUpdateRow and built again when the text columns change, so finding
+// the screen line of a row or the row of a screen line is O(log n)
+
+int editorWrapNext(erow *row, int start, int width) {
+  // the byte the screen line after the one starting at start starts at, or
+  // -1 when start is on the last screen line of the row
+  int limit = editorRowByteToCol(row, start) + width;
+  if (editorRowByteToCol(row, row->rsize) < limit)
+    return -1;
+
+  if (!row->rcol)
+    return start + width;
+
+  // the last byte at or before the limit, the characters before it fit
+  int lo = start, hi = row->rsize;
+  while (lo < hi) {
+    int mid = lo + (hi - lo + 1) / 2;
+    if (row->rcol[mid] <= limit)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  while (lo > start && lo < row->rsize && editorIsContinuation(row->render[lo]))
+    lo--;
+
+  if (lo == start) { // a character wider than the screen, it goes on its own
+    lo++;
+    while (lo < row->rsize && editorIsContinuation(row->render[lo]))
+      lo++;
+  }
+
+  return lo;
+}
+
+long long editorWrapHeight(erow *row) {
+  // how many screen lines the row takes, none when it is folded away
+  int width = E.wrap.width;
+  if (E.folds.n && editorFoldAt(row->idx) != -1)
+    return 0;
+  if (!row->rcol)
+    return row->rsize / width + 1;
+
+  int n = 1;
+  int start = 0;
+  while ((start = editorWrapNext(row, start, width)) != -1)
+    n++;
+
+  return n;
+}
+
+int editorWrapStart(erow *row, int sub) {
+  // the byte screen line sub of the row starts at
+  if (!row->rcol)
+    return sub * E.wrap.width;
+
+  int start = 0;
+  while (sub-- > 0)
+    start = editorWrapNext(row, start, E.wrap.width);
+
+  return start;
+}
+
+int editorWrapSub(erow *row, int b, int *start) {
+  // the screen line of the row byte b is on, and the byte it starts at
+  int sub = 0;
+  int s = 0, next;
+
+  if (!row->rcol) {
+    sub = b / E.wrap.width;
+    s = sub * E.wrap.width;
+  } else {
+    while ((next = editorWrapNext(row, s, E.wrap.width)) != -1 && next <= b) {
+      s = next;
+      sub++;
+    }
+  }
+
+  if (start)
+    *start = s;
+  return sub;
+}
+
+int editorWrapOn() { return E.wrap.enabled && !E.pager.enabled; }
+
+void editorWrapBuild(int width) {
+  // brings the screen lines of every row up to date, the text columns the
+  // rows wrap at are width
+  if (width < 1)
+    width = 1;
+  if (width != E.wrap.width) { // every row wraps differently now
+    E.wrap.width = width;
+    E.wrap.lines.built = 0;
+  }
+
+  editorSumsBuild(&E.wrap.lines, editorWrapHeight);
+}
+
+long long editorWrapLine(int at, int b) {
+  // the screen line, counted from the top of the file, of byte b of the
+  // render of row at, at can be numrows for the line after the last row
+  long long line = editorSumsPrefix(&E.wrap.lines, at);
+  if (at < E.numrows)
+    line += editorWrapSub(&E.row[at], b, NULL);
+
+  return line;
+}
+
+void editorWrapToggle() {
+  E.wrap.enabled = !E.wrap.enabled;
+  E.wrap.lines.built = 0; // not kept up to date while wrap was off
+  E.wrap.sub = 0;
+}
+
+void editorWrapMove(long long lines) {
+  // moves the cursor up (negative) or down by screen lines, staying in the
+  // same column on the screen as far as the line it lands on is long
+  editorWrapBuild(E.screencols - E.gutter);
+  long long total = editorSumsPrefix(&E.wrap.lines, E.numrows);
+  int x = 0;
+  long long line = total;
+
+  if (E.cy < E.numrows) {
+    erow *row = &E.row[E.cy];
+    int rx = editorRowCxToRx(row, E.cx);
+    int start;
+    int b = editorRowColToByte(row, rx);
+
+    line = editorWrapLine(E.cy, b);
+    editorWrapSub(row, b, &start);
+    x = rx - editorRowByteToCol(row, start);
+  }
+
+  line += lines;
+  if (line < 0)
+    line = 0;
+  if (line >= total) { // the line after the last row
+    E.cy = E.numrows;
+    E.cx = 0;
+    return;
+  }
+
+  E.cy = editorSumsFind(&E.wrap.lines, line);
+  erow *row = &E.row[E.cy];
+  int sub = line - editorSumsPrefix(&E.wrap.lines, E.cy);
+  int start = editorWrapStart(row, sub);
+  int next = editorWrapNext(row, start, E.wrap.width);
+
+  int b = editorRowColToByte(row, editorRowByteToCol(row, start) + x);
+  if (next != -1 && b >= next) { // not past the end of the screen line
+    b = next - 1;
+    while (b > start && editorIsContinuation(row->render[b]))
+      b--;
+  }
+
+  E.cx = editorRowRxToCx(row, editorRowByteToCol(row, b));
+  if (E.cx < row->size &&
+      editorRowCxToRx(row, E.cx) < editorRowByteToCol(row, start))
+    E.cx++; // a tab that began on the line above, the cursor goes after it
+}
+
+void editorWrapScroll(int width) {
+  // like editorScroll, with screen lines instead of rows, E.rowoff is the
+  // row at the top of the screen, and E.wrap.sub how many of its screen
+  // lines are above the screen
+  editorWrapBuild(width);
+  E.coloff = 0;
+
+  if (E.rowoff >= E.numrows) {
+    E.rowoff = E.numrows;
+    E.wrap.sub = 0;
+  } else if (E.wrap.sub >= editorWrapHeight(&E.row[E.rowoff])) {
+    E.wrap.sub = 0; // the row got shorter
+  }
+
+  long long top = editorWrapLine(E.rowoff, 0) + E.wrap.sub;
+  long long cur = editorWrapLine(E.cy, 0);
+  int start = 0;
+
+  if (E.cy < E.numrows) {
+    erow *row = &E.row[E.cy];
+    cur += editorWrapSub(row, editorRowColToByte(row, E.rx), &start);
+  }
+
+  if (cur < top)
+    top = cur;
+  if (cur >= top + E.screenrows)
+    top = cur - E.screenrows + 1;
+
+  E.rowoff = editorSumsFind(&E.wrap.lines, top);
+  E.wrap.sub = top - editorSumsPrefix(&E.wrap.lines, E.rowoff);
+
+  E.wrap.y = cur - top;
+  E.wrap.x = E.cy < E.numrows
+                 ? E.rx - editorRowByteToCol(&E.row[E.cy], start)
+                 : 0;
+}
+
+// --- BRACKETS ---
+// every row is summed up by its brackets outside strings and comments, an
+// opening one counts 1 and a closing one -1, with what they add up to and the
+// lowest the sum gets going through them, the rows are summed up in blocks
+// and the blocks in a tree, so the bracket matching one is found by walking
+// down the tree instead of through the rows between them, the summaries move
+// along with the rows, like the definitions of the symbol index
+
+int editorBracketKind(erow *row, int b) {
+  // 1 for an opening bracket at byte b of render, -1 for a closing one
+  if (row->hl[b] == HL_STRING || row->hl[b] == HL_COMMENT ||
+      row->hl[b] == HL_MLCOMMENT)
+    return 0;
+
+  switch (row->render[b]) {
+  case '(':
+  case '[':
+  case '{':
+    return 1;
+  case ')':
+  case ']':
+  case '}':
+    return -1;
+  }
+  return 0;
+}
+
+struct editorBracketSum editorBracketsJoin(struct editorBracketSum a,
+                                           struct editorBracketSum b) {
+  // the summary of the rows of a followed by the rows of b
+  struct editorBracketSum s;
+  s.net = a.net + b.net;
+  s.min = a.net + b.min < a.min ? a.net + b.min : a.min;
+  s.closed = a.closed + b.closed;
+  return s;
+}
+
+void editorBracketsRow(erow *row) {
+  // sums up the row again, after it was highlighted
+  if (!E.brackets.built)
+    return;
+
+  struct editorBracketSum s = {0, 0, !row->hl_open_comment};
+  int j;
+  for (j = 0; j < row->rsize; j++) {
+    s.net += editorBracketKind(row, j);
+    if (s.net < s.min)
+      s.min = s.net;
+  }
+  E.brackets.row[row->idx] = s;
+
+  // the block of the row is summed up again right away, unless it is built
+  // again anyway
+  int block = row->idx / KILO_BRACKET_BLOCK;
+  if (block >= E.brackets.valid)
+    return;
+
+  struct editorBracketSum sum = {0, 0, 0};
+  int first = block * KILO_BRACKET_BLOCK;
+  for (j = first; j < first + KILO_BRACKET_BLOCK && j < E.numrows; j++)
+    sum = editorBracketsJoin(sum, E.brackets.row[j]);
+
+  int k = E.brackets.leaves + block;
+  E.brackets.tree[k] = sum;
+  for (k /= 2; k > 0; k /= 2)
+    E.brackets.tree[k] =
+        editorBracketsJoin(E.brackets.tree[2 * k], E.brackets.tree[2 * k + 1]);
+}
+
+void editorBracketsMoved(int at, int removed, int added) {
+  // rows [at, at + removed) were deleted, or added rows were inserted at at,
+  // called before numrows changes
+  editorFoldsMoved(at, removed, added);
+  if (!E.brackets.built)
+    return;
+
+  if (E.numrows + added > E.brackets.cap) {
+    E.brackets.cap = E.numrows + added > 2 * E.brackets.cap
+                         ? E.numrows + added
+                         : 2 * E.brackets.cap;
+    E.brackets.row = realloc(E.brackets.row, sizeof(struct editorBracketSum) *
+                                                 E.brackets.cap);
+  }
+
+  memmove(&E.brackets.row[at + added], &E.brackets.row[at + removed],
+          sizeof(struct editorBracketSum) * (E.numrows - at - removed));
+
+  if (at / KILO_BRACKET_BLOCK < E.brackets.valid)
+    E.brackets.valid = at / KILO_BRACKET_BLOCK;
+}
+
+void editorBracketsBuild() {
+  // sums up every row the first time, then the blocks from the first one
+  // whose rows moved
+  struct editorBrackets *b = &E.brackets;
+  int j;
+
+  if (!b->built) {
+    b->built = 1;
+    b->cap = E.numrows > 16 ? E.numrows : 16;
+    b->row = malloc(sizeof(struct editorBracketSum) * b->cap);
+    b->valid = 0;
+    for (j = 0; j < E.numrows; j++)
+      editorBracketsRow(&E.row[j]);
+  }
+
+  int blocks = (E.numrows + KILO_BRACKET_BLOCK - 1) / KILO_BRACKET_BLOCK;
+  int leaves = 1;
+  while (leaves < blocks)
+    leaves *= 2;
+
+  if (leaves != b->leaves) { // the tree has a different shape now
+    b->leaves = leaves;
+    b->tree = realloc(b->tree, sizeof(struct editorBracketSum) * 2 * leaves);
+    b->valid = 0;
+  }
+  if (b->valid >= leaves)
+    return;
+
+  int k;
+  for (k = b->valid; k < leaves; k++) {
+    struct editorBracketSum sum = {0, 0, 0};
+    int first = k * KILO_BRACKET_BLOCK;
+    for (j = first; j < first + KILO_BRACKET_BLOCK && j < E.numrows; j++)
+      sum = editorBracketsJoin(sum, b->row[j]);
+    b->tree[leaves + k] = sum;
+  }
+
+  for (k = leaves - 1; k > 0; k--)
+    b->tree[k] = editorBracketsJoin(b->tree[2 * k], b->tree[2 * k + 1]);
+  b->valid = leaves;
+}
+
+int editorBracketsHit(struct editorBracketSum s, int *depth, int dir,
+                      int comment) {
+  // tells if the depth gets to 0 somewhere in s going in direction dir, or
+  // if s has the end of a multiline comment, else takes s into account
+  if (comment)
+    return s.closed > 0;
+
+  if (dir == 1) {
+    if (*depth + s.min <= 0)
+      return 1;
+    *depth += s.net;
+  } else {
+    if (s.net - s.min >= *depth) // the highest any suffix of s gets
+      return 1;
+    *depth -= s.net;
+  }
+  return 0;
+}
+
+int editorBracketsDescend(int k, int lo, int hi, int from, int *depth,
+                          int dir, int comment) {
+  // the first block of node k, which has blocks [lo, hi), after from going
+  // down (dir 1), or before it going up, where the depth gets to 0
+  if (dir == 1 ? hi <= from : lo >= from)
+    return -1; // on the wrong side of from
+
+  int whole = dir == 1 ? lo >= from : hi <= from;
+  if (whole) {
+    struct editorBracketSum s = E.brackets.tree[k];
+    int d = *depth;
+    if (!editorBracketsHit(s, &d, dir, comment)) {
+      *depth = d;
+      return -1;
+    }
+    if (hi - lo == 1)
+      return lo;
+  }
+
+  int mid = (lo + hi) / 2;
+  int first = dir == 1 ? 2 * k : 2 * k + 1;
+  int r = dir == 1 ? editorBracketsDescend(first, lo, mid, from, depth, dir,
+                                           comment)
+                   : editorBracketsDescend(first, mid, hi, from, depth, dir,
+                                           comment);
+  if (r != -1)
+    return r;
+
+  return dir == 1 ? editorBracketsDescend(2 * k + 1, mid, hi, from, depth,
+                                          dir, comment)
+                  : editorBracketsDescend(2 * k, lo, mid, from, depth, dir,
+                                          comment);
+}
+
+int editorBracketsFind(int from, int *depth, int dir, int comment) {
+  // the first row from row from on going in direction dir where the depth
+  // gets to 0, the rows passed are taken into account in depth, -1 if none,
+  // with comment the first row that doesn't end inside a multiline comment
+  editorBracketsBuild();
+
+  int r = from;
+  int block = -1;
+  while (r >= 0 && r < E.numrows) {
+    if (editorBracketsHit(E.brackets.row[r], depth, dir, comment))
+      return r;
+
+    r += dir;
+    if (r / KILO_BRACKET_BLOCK != from / KILO_BRACKET_BLOCK && block == -1) {
+      // the rest of the block of from is done, the tree finds the block
+      block = editorBracketsDescend(1, 0, E.brackets.leaves,
+                                    r / KILO_BRACKET_BLOCK + (dir == 1 ? 0 : 1),
+                                    depth, dir, comment);
+      if (block == -1)
+        return -1;
+      r = dir == 1 ? block * KILO_BRACKET_BLOCK
+                   : block * KILO_BRACKET_BLOCK + KILO_BRACKET_BLOCK - 1;
+      if (r >= E.numrows)
+        r = E.numrows - 1;
+    }
+  }
+  return -1;
+}
+
+int editorBracketsMatch(int *at, int *b) {
+  // moves row at and byte b of its render from a bracket to the one that
+  // matches it, returns 0 if b isn't a bracket or nothing matches it
+  erow *row = &E.row[*at];
+  int dir = *b < row->rsize ? editorBracketKind(row, *b) : 0;
+  if (dir == 0)
+    return 0;
+
+  int depth = 0;
+  int r = *at;
+  int j = *b;
+
+  while (1) {
+    for (; j >= 0 && j < row->rsize; j += dir) {
+      depth += dir * editorBracketKind(row, j);
+      if (depth == 0) {
+        *at = r;
+        *b = j;
+        return 1;
+      }
+    }
+
+    r = editorBracketsFind(r + dir, &depth, dir, 0);
+    if (r == -1)
+      return 0;
+    row = &E.row[r];
+    j = dir == 1 ? 0 : row->rsize - 1;
+  }
+}
+
+void editorBracketsJump() {
+  // Ctrl-O, from the bracket at the cursor to the one that matches it
+  if (E.cy >= E.numrows)
+    return;
+
+  erow *row = &E.row[E.cy];
+  int at = E.cy;
+  int b = editorRowColToByte(row, editorRowCxToRx(row, E.cx));
+
+  int found = editorBracketsMatch(&at, &b);
+  if (!found && b > 0) { // or the bracket right before the cursor
+    b--;
+    found = editorBracketsMatch(&at, &b);
+  }
+
+  if (!found) {
+    editorSetStatusMessage("No matching bracket");
+    return;
+  }
+
+  E.cy = at;
+  E.cx = editorRowRxToCx(&E.row[at], editorRowByteToCol(&E.row[at], b));
+}
+
+// --- FOLDS ---
+// Ctrl-K on a row with an opening bracket hides the rows up to the one with
+// the bracket that matches it, or on a row that begins a multiline comment
+// the rest of the comment, the folds are kept in order, so the rows shown
+// next to each other are found without going through the hidden ones
+
+int editorFoldFirst(int row) {
+  // the first fold that starts at row or after it
+  int lo = 0, hi = E.folds.n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (E.folds.at[mid].start < row)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int editorFoldAt(int row) {
+  // the fold that hides row, or -1
+  int k = editorFoldFirst(row) - 1; // the last one starting before row
+  if (k >= 0 && E.folds.at[k].end >= row)
+    return k;
+  return -1;
+}
+
+int editorFoldNext(int row) {
+  // the row shown below row
+  int k = editorFoldFirst(row);
+  if (k < E.folds.n && E.folds.at[k].start == row)
+    return E.folds.at[k].end + 1;
+  return row + 1;
+}
+
+int editorFoldPrev(int row) {
+  // the row shown above row
+  int k = editorFoldAt(row - 1);
+  return k == -1 ? row - 1 : E.folds.at[k].start;
+}
+
+int editorFoldRows(int from, int to) {
+  // how many rows are shown from row from up to row to, not counting to
+  int n = to - from;
+  int k;
+  for (k = editorFoldFirst(from); k < E.folds.n && E.folds.at[k].start < to;
+       k++)
+    n -= E.folds.at[k].end - E.folds.at[k].start;
+  return n;
+}
+
+void editorFoldMeasure(int start, int end) {
+  // rows (start, end] were hidden or shown again, they take other screen
+  // lines now
+  if (!E.wrap.lines.built)
+    return;
+
+  int j;
+  for (j = start + 1; j <= end; j++)
+    editorSumsUpdate(&E.wrap.lines, j, editorWrapHeight(&E.row[j]));
+}
+
+void editorFoldDel(int k) {
+  struct editorFold f = E.folds.at[k];
+  memmove(&E.folds.at[k], &E.folds.at[k + 1],
+          sizeof(struct editorFold) * (E.folds.n - k - 1));
+  E.folds.n--;
+  editorFoldMeasure(f.start, f.end); // shown again
+}
+
+void editorFoldsMoved(int at, int removed, int added) {
+  // rows [at, at + removed) were deleted, or added rows were inserted at at,
+  // a fold loses its rows with any of them, the ones below move
+  int k = editorFoldFirst(at) - 1; // the one before might hold at
+  if (k < 0)
+    k = 0;
+
+  while (k < E.folds.n) {
+    struct editorFold *f = &E.folds.at[k];
+    if (f->end < at) {
+      k++;
+    } else if (removed && f->start < at + removed) {
+      editorFoldDel(k);
+    } else {
+      if (f->start >= at) // below, or rows were inserted into it
+        f->start += added - removed;
+      f->end += added - removed;
+      k++;
+    }
+  }
+}
+
+void editorFoldToggle() {
+  // Ctrl-K, folds the block or the comment that begins on the cursor row, or
+  // unfolds it
+  if (E.cy >= E.numrows)
+    return;
+
+  int k = editorFoldFirst(E.cy);
+  if (k < E.folds.n && E.folds.at[k].start == E.cy) {
+    editorFoldDel(k);
+    return;
+  }
+
+  // the outermost opening bracket on the row that closes on a later row, or
+  // else a multiline comment that goes on past the row
+  erow *row = &E.row[E.cy];
+  int end = -1;
+  int j;
+  for (j = 0; j < row->rsize && end == -1; j++) {
+    int at = E.cy, b = j;
+    if (editorBracketKind(row, j) == 1 && editorBracketsMatch(&at, &b) &&
+        at - 1 > E.cy)
+      end = at - 1; // the closing bracket is still shown
+  }
+
+  if (end == -1 && row->hl_open_comment &&
+      (E.cy == 0 || !E.row[E.cy - 1].hl_open_comment)) {
+    int depth = 0;
+    end = editorBracketsFind(E.cy + 1, &depth, 1, 1);
+  }
+
+  if (end <= E.cy) {
+    editorSetStatusMessage("Nothing to fold here");
+    return;
+  }
+
+  // folds inside the new one are taken in by it
+  k = editorFoldFirst(E.cy);
+  while (k < E.folds.n && E.folds.at[k].start <= end) {
+    if (E.folds.at[k].end > end)
+      end = E.folds.at[k].end;
+    editorFoldDel(k);
+  }
+
+  if (E.folds.n == E.folds.cap) {
+    E.folds.cap = E.folds.cap ? E.folds.cap * 2 : 16;
+    E.folds.at = realloc(E.folds.at, sizeof(struct editorFold) * E.folds.cap);
+  }
+  memmove(&E.folds.at[k + 1], &E.folds.at[k],
+          sizeof(struct editorFold) * (E.folds.n - k));
+  E.folds.at[k].start = E.cy;
+  E.folds.at[k].end = end;
+  E.folds.n++;
+
+  editorFoldMeasure(E.cy, end); // hidden rows take no lines
+  editorSetStatusMessage("Folded %d lines", end - E.cy);
+}
+
+// --- UNDO ---
+// an undo unit is a list of spans, each span remembers which rows a change
+// replaced with which, undoing puts the old rows back, row contents are saved
+// whole, so a run of typing on one row needs just one saved row
+
+void editorUndoFreeUnit(undoUnit *u) {
+  int i, k;
+  for (i = 0; i < u->nspans; i++) {
+    for (k = 0; k < u->spans[i].nold; k++)
+      free(u->spans[i].old[k].chars);
+    free(u->spans[i].old);
+  }
+  free(u->spans);
+}
+
+void editorUndoClear() {
+  // forgets all the undo history, the rows it refers to are gone
+  int i;
+  for (i = 0; i < E.nundo; i++)
+    editorUndoFreeUnit(&E.undo[i]);
+
+  free(E.undo);
+  E.undo = NULL;
+  E.nundo = 0;
+  E.undo_typing = -1;
+}
+
+void editorUndoOpen() {
+  // starts a new undo unit, the changes recorded until the next one are
+  // undone together
+  if (E.nundo == KILO_UNDO_MAX) { // drop the oldest
+    editorUndoFreeUnit(&E.undo[0]);
+    memmove(&E.undo[0], &E.undo[1], sizeof(undoUnit) * (E.nundo - 1));
+    E.nundo--;
+  }
+
+  E.undo = realloc(E.undo, sizeof(undoUnit) * (E.nundo + 1));
+
+  undoUnit *u = &E.undo[E.nundo++];
+  u->spans = NULL;
+  u->nspans = 0;
+  u->cx = E.cx;
+  u->cy = E.cy;
+
+  E.undo_typing = -1;
+}
+
+undoSpan *editorUndoSpan(int at, int nold, int nnew) {
+  // adds a span to the last unit, the caller fills span->old
+  undoUnit *u = &E.undo[E.nundo - 1];
+  u->spans = realloc(u->spans, sizeof(undoSpan) * (u->nspans + 1));
+
+  undoSpan *span = &u->spans[u->nspans++];
+  span->at = at;
+  span->nold = nold;
+  span->nnew = nnew;
+  span->old = nold ? malloc(sizeof(erow) * nold) : NULL;
+
+  return span;
+}
+
+void editorUndoRecord(int at, int nold, int nnew) {
+  // call before rows [at, at + nold) get replaced by nnew rows, it saves a
+  // copy of them to the last unit
+  undoSpan *span = editorUndoSpan(at, nold, nnew);
+
+  int k;
+  for (k = 0; k < nold; k++) {
+    erow *row = &E.row[at + k];
+    span->old[k].size = row->size;
+    span->old[k].chars = malloc(row->size + 1);
+    memcpy(span->old[k].chars, row->chars, row->size + 1);
+  }
+}
+
+void editorUndoRecordOwned(int at, char *chars, int size) {
+  // records that row at used to contain chars, the buffer is taken over, so
+  // a change that already made a new buffer for the row doesn't copy the old
+  undoSpan *span = editorUndoSpan(at, 1, 1);
+  span->old[0].chars = chars;
+  span->old[0].size = size;
+}
+
+void editorUndoTyping() {
+  // typing into the same row keeps going into the same unit, its saved copy
+  // from before the first key is all that is needed to undo all of it
+  if (E.undo_typing == E.cy && E.nundo > 0)
+    return;
+
+  editorUndoOpen();
+  editorUndoRecord(E.cy, 1, 1);
+  E.undo_typing = E.cy;
+}
+
+void editorUndo() {
+  if (E.nundo == 0) {
+    editorSetStatusMessage("Nothing to undo");
+    return;
+  }
+
+  undoUnit *u = &E.undo[E.nundo - 1];
+
+  int i, k;
+  for (i = u->nspans - 1; i >= 0; i--) {
+    undoSpan *span = &u->spans[i];
+
+    if (span->nold == span->nnew) {
+      // the same rows were changed, just swap the old contents back in
+      for (k = 0; k < span->nold; k++) {
+        erow *row = &E.row[span->at + k];
+        free(row->chars);
+        row->chars = span->old[k].chars;
+        row->size = span->old[k].size;
+        editorUpdateRow(row);
+      }
+      E.dirty++;
+    } else {
+      // the old rows go back in one move of the rows below, taking the
+      // saved buffers instead of copies of them
+      editorDelRows(span->at, span->nnew);
+      if (span->nold) {
+        char **chars = malloc(sizeof(char *) * span->nold);
+        int *sizes = malloc(sizeof(int) * span->nold);
+        for (k = 0; k < span->nold; k++) {
+          chars[k] = span->old[k].chars;
+          sizes[k] = span->old[k].size;
+        }
+        editorInsertRowsEx(span->at, chars, sizes, span->nold, 1);
+        free(chars);
+        free(sizes);
+      }
+    }
+
+    span->nold = 0; // the old rows are back in E.row, nothing left to free
+  }
+
+  E.cx = u->cx;
+  E.cy = u->cy;
+
+  editorUndoFreeUnit(u);
+  E.nundo--;
+  E.undo_typing = -1;
+}
+
+// --- EDITOR OPERATIONS ---
+
+void editorInsertChar(int c) {
+  if (E.cy == E.numrows) { // when the cursor is on the very bottom
+    editorUndoOpen();
+    editorUndoRecord(E.numrows, 0, 1);
+
+    editorInsertRow(E.numrows, "",
+                    0); // append a new row on there before inserting anything
+  }
+
+  editorUndoTyping();
+  editorRowInsertChar(&E.row[E.cy], E.cx, c); // insert the char
+  E.cx++;
+}
+
+void editorInsertNewline() {
+  editorUndoOpen();
+  if (E.cx == 0)
+    editorUndoRecord(E.cy, 0, 1);
+  else
+    editorUndoRecord(E.cy, 1, 2);
+
+  // inserts a new blank line row before the line
+  if (E.cx == 0) {
+    editorInsertRow(E.cy, "", 0);
+  } else {
+    // split the line into two rows, separated by what the cursor is pointing
+    erow *row = &E.row[E.cy];
+
+    // insert a new row and append string after the cursor when we hit enter
+    editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
+    row = &E.row[E.cy];
+    row->size = E.cx;
+    row->chars[row->size] = '\0'; // sets the last index to be null
+
+    // this func is always called whenever we have update in the rows
+    editorUpdateRow(row);
+  }
+
+  E.cy++;
+  E.cx = 0;
+}
+
+void editorDelChar() {
+  if (E.cy == E.numrows)
+    return; // if the cursor are past the the end of the file, nothing to be
+            // deleted
+
+  if (E.cx == 0 && E.cy == 0)
+    return;
+
+  erow *row = &E.row[E.cy]; // grab the pointer of the current row erow
+
+  if (E.cx > 0) {
+    int at = E.cx - 1; // back to the first byte of the character
+    while (at > 0 && editorIsContinuation(row->chars[at]))
+      at--;
+
+    editorUndoTyping();
+    editorRowDelChar(row, at,
+                     E.cx - at); // deletes one character and moves the
+                                 // cursor back to where it started
+    E.cx = at;
+  } else {
+    editorUndoOpen();
+    editorUndoRecord(E.cy - 1, 2, 1); // the two rows become one
+
+    E.cx = E.row[E.cy - 1].size;
+    editorRowAppendString(&E.row[E.cy - 1], row->chars,
+                          row->size); // append the string on the current line
+                                      // or row to the previous
+    editorDelRow(E.cy);               // deletes the current row / line
+
+    E.cy--;
+  }
+}
+
+// --- FILE I/O ---
+
+void *editorRowsToString(int *buflen) {
+  int totlen = 0; // store the total length of the entire text
+  int j;
+
+  for (j = 0; j < E.numrows; j++) {
+    totlen += E.row[j].size + 1; // adding one to each line for return char
+  }
+
+  *buflen = totlen;
+
+  char *buf = malloc(totlen); // allocate the required memory
+  char *p = buf;              // pointer to buf
+
+  for (j = 0; j < E.numrows; j++) {
+    memcpy(p, E.row[j].chars,
+           E.row[j].size); // copy the entire line to the p -> buf
+    p += E.row[j].size;    // move the pointer in size with the row
+    *p = '\n';             // add return char at the end
+    p++;                   // move the pointer by 1
+  }
+
+  return buf; // returns the pointer of buf, expected to free the memory by the
+              // caller
+}
+
+void editorLoad(FILE *fp) {
+  // reads every line of fp into rows
+  char *line = NULL;
+
+  size_t linecap = 0; // line capacity, to know how much memory is allocated
+  ssize_t linelen;
+
+  E.follow.offset = 0;
+  E.follow.partial = 0;
+
+  while ((linelen = getline(&line, &linecap, fp)) !=
+         -1) { // continously read each line of the provided file argument
+               // until it reaches the EOF
+    // to read line doesnt matter the length until it reaches \n
+
+    E.follow.offset += linelen; // remember where follow mode has to continue
+    E.follow.partial = (line[linelen - 1] != '\n');
+
+    while (linelen > 0 &&
+           (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+      linelen--;
+
+    editorInsertRow(E.numrows, line, linelen);
+  }
+
+  free(line);
+
+  E.dirty = 0; // sets E.dirty to 0 after opening a file
+}
+
+void editorOpen(char *filename) {
+  free(E.filename);
+
+  E.filename = strdup(filename); // duplicates filename to E.filename
+
+  editorSelectSyntaxHighlight();
+
+  int fd = open(filename, O_RDONLY | O_CLOEXEC); // open the file based on
+                                                 // the argument passed when
+                                                 // running the app
+  if (fd == -1)
+    die("open");
+
+  // the file is read by a background thread, compressed files through their
+  // decompressor, only the first screen of rows is waited for here, the rest
+  // is added while the user is already looking at it
+  editorLoadStart(fd, editorCodecOf(fd));
+
+  if (E.trace.fp && E.trace.replay)
+    editorLoadFinish(); // a replay must see the same rows every time
+
+  editorLoadTo(E.screenrows);
+}
+
+int editorWritevAll(int fd, struct iovec *iov, int cnt) {
+  // writev might write less than asked for, keep going until all is written
+  while (cnt > 0) {
+    ssize_t n = writev(fd, iov, cnt);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    while (cnt > 0 && (size_t)n >= iov->iov_len) { // skip the written iovecs
+      n -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+
+    if (cnt > 0) { // and the written part of a partially written one
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+
+  return 0;
+}
+
+ssize_t editorWriteRows(int fd) {
+  // writes the rows straight out of their buffers, batched with writev, so
+  // saving doesn't need a copy of the whole file the way editorRowsToString
+  // makes one, returns the number of bytes written or -1
+  struct iovec iov[KILO_IOV_BATCH];
+  int cnt = 0;
+  ssize_t total = 0;
+
+  int j;
+  for (j = 0; j < E.numrows; j++) {
+    iov[cnt].iov_base = E.row[j].chars;
+    iov[cnt].iov_len = E.row[j].size;
+    iov[cnt + 1].iov_base = "\n";
+    iov[cnt + 1].iov_len = 1;
+    cnt += 2;
+    total += E.row[j].size + 1;
+
+    if (cnt == KILO_IOV_BATCH || j == E.numrows - 1) {
+      if (editorWritevAll(fd, iov, cnt) == -1)
+        return -1;
+      cnt = 0;
+    }
+  }
+
+  return total;
+}
+
+ssize_t editorWriteFile(char *filename) {
+  // saves the rows to filename, returns the number of bytes written or -1
+  // with errno set
+  ssize_t len = 0;
+  int j;
+  for (j = 0; j < E.numrows; j++)
+    len += E.row[j].size + 1; // adding one to each line for return char
+
+  int fd = open(filename, O_RDWR | O_CREAT,
+                0644); // create the file based on the name of the filename
+  // O_RDWR -> reading and writing
+  // O_CREAT -> create new file if it doesnt already exist, 0644 is the argument
+  // for fie permission, just like the chmod file/dir permission
+
+  if (fd == -1)
+    return -1;
+
+  // sets the file size to len, and also truncate any data that is larger than
+  // len, the normal way to overwrite a file is to pass O_TRUNC flag to open()
+  // func -> trucates the file completely truncating the file len first is
+  // actually safer, since if the write operation below us fails, we still
+  // have the remaining data until the new len, so we don't actually lose all
+  // the stuff.
+  //
+  // most advanced editors will write to a new temp file, then rename the file
+  // to the actual file that user wants to overwrite, and then carefully check
+  // for errors through the whole process
+  if (ftruncate(fd, len) == -1 || editorWriteRows(fd) != len) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+
+  close(fd);
+  return len;
+}
+
+void editorSave() {
+  if (E.filename == NULL) {
+    E.filename = editorPrompt("Save as: %s", NULL);
+
+    if (E.filename == NULL) {
+      editorSetStatusMessage("Save aborted");
+      return;
+    }
+
+    editorSelectSyntaxHighlight();
+  }
+
+  if (E.load.codec && !E.load.codec_asked) {
+    // a compressed file is often opened to be kept uncompressed, so the
+    // first save asks, before the replay check, a replay reads the answer
+    char prompt[80];
+    snprintf(prompt, sizeof(prompt),
+             "Compress with %s again? %%s (Y/n, ESC to cancel)",
+             E.load.codec->name);
+    char *answer = editorPromptEx(prompt, NULL, 1);
+    if (answer == NULL) {
+      editorSetStatusMessage("Save aborted");
+      return;
+    }
+
+    if (answer[0] == 'n' || answer[0] == 'N')
+      E.load.codec = NULL; // from now on it is a plain file
+    E.load.codec_asked = 1;
+    free(answer);
+  }
+
+  if (E.trace.fp && E.trace.replay) { // a replay must not touch the file
+    E.dirty = 0;
+    editorSetStatusMessage("Replay: not saving %s", E.filename);
+    return;
+  }
+
+  if (E.load.active)
+    editorLoadFinish(); // only the whole file can be saved
+
+  ssize_t len = E.load.codec ? editorWriteCompressed(E.filename, E.load.codec)
+                             : editorWriteFile(E.filename);
+
+  if (len != -1) {
+    E.dirty = 0; // sets the dirty value to 0 after saving the file
+
+    if (E.follow.fd != -1) {
+      // the file is the rows now, following goes on from its end, instead of
+      // taking the rows written as new ones or as a truncation
+      struct stat st;
+      E.follow.offset = len;
+      E.follow.partial = 0;
+      if (stat(E.filename, &st) == 0) {
+        E.follow.dev = st.st_dev;
+        E.follow.ino = st.st_ino;
+      }
+    }
+
+    if (E.load.codec)
+      editorSetStatusMessage("%zd bytes compressed with %s and written to disk",
+                             len, E.load.codec->name);
+    else
+      editorSetStatusMessage("%zd bytes written to disk",
+                             len); // send message to messagebuf
+    return;
+  }
+
+  editorSetStatusMessage(
+      "Can't save! I/O error: %s",
+      strerror(errno)); // strerror returns the human readable string for the
+                        // provided error code
+}
+
+// --- FOLLOW ---
+// follow mode keeps reading what gets appended to the opened file, the same
+// way tail -f does, inotify tells us when the file was written to
+
+void editorFollowAppend(char *s, size_t len, int terminated) {
+  if (terminated && len > 0 && s[len - 1] == '\r')
+    len--; // same as editorOpen, strip the \r of \r\n line endings
+
+  if (E.follow.partial && E.numrows > 0) {
+    // the last row didn't end with a newline, so this piece belongs to it
+    erow *row = &E.row[E.numrows - 1];
+    editorRowAppendString(row, s, len);
+
+    if (terminated && row->size > 0 && row->chars[row->size - 1] == '\r') {
+      row->chars[--row->size] = '\0'; // \r and \n came in different reads
+      editorUpdateRow(row);
+    }
+  } else {
+    // only the new row is rendered and highlighted, the rows above are not
+    // touched at all
+    editorInsertRow(E.numrows, s, len);
+  }
+
+  E.follow.partial = !terminated;
+}
+
+int editorFollowRead() {
+  // reads everything appended to the file since the last call, returns 1 if
+  // rows were added or changed
+  int fd = open(E.filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return 0;
+  }
+
+  int replaced = st.st_dev != E.follow.dev || st.st_ino != E.follow.ino;
+  if (!replaced && st.st_size == E.follow.offset) {
+    close(fd);
+    return 0;
+  }
+
+  if (replaced || st.st_size < E.follow.offset) {
+    // the file got truncated or replaced (log rotation), start over, a new
+    // file may already be bigger than the old one was
+    while (E.numrows > 0)
+      editorDelRow(E.numrows - 1);
+    editorCursorsClear();
+    E.sel.mode = SEL_NONE;
+
+    E.cx = E.cy = E.rowoff = E.coloff = 0;
+    E.follow.offset = 0;
+    editorUndoClear();
+    E.follow.partial = 0;
+
+    E.follow.dev = st.st_dev;
+    E.follow.ino = st.st_ino;
+
+    editorSetStatusMessage("%s was %s, reloading", E.filename,
+                           replaced ? "replaced" : "truncated");
+  }
+
+  int at_end = (E.cy >= E.numrows - 1); // cursor on the last line, or past it
+  int past_end = (E.cy == E.numrows);
+  int dirty = E.dirty; // appended rows are not changes made by the user
+
+  char buf[KILO_FOLLOW_CHUNK];
+
+  // only read up to the size we saw above, if the file keeps growing while
+  // we are reading, the next inotify event will bring us back here
+  while (E.follow.offset < st.st_size) {
+    size_t want = sizeof(buf);
+    if (st.st_size - E.follow.offset < (off_t)want)
+      want = st.st_size - E.follow.offset;
+
+    ssize_t n = pread(fd, buf, want, E.follow.offset);
+    if (n <= 0)
+      break;
+
+    E.follow.offset += n;
+
+    // split the chunk on newlines, a line can be cut in two by the chunk
+    // boundary, the second part is then appended by E.follow.partial
+    char *p = buf;
+    char *end = buf + n;
+    while (p < end) {
+      char *nl = memchr(p, '\n', end - p);
+      size_t len = (nl ? nl : end) - p;
+
+      editorFollowAppend(p, len, nl != NULL);
+      p += len + (nl != NULL);
+    }
+  }
+
+  close(fd);
+  E.dirty = dirty;
+
+  if (at_end && E.numrows > 0) {
+    // keep the newest line in view, just like tail -f
+    E.cy = past_end ? E.numrows : E.numrows - 1;
+    E.cx = 0;
+  }
+
+  return 1;
+}
+
+void editorFollowWatch() {
+  // (re)creates the watch on E.filename, the file might have been renamed or
+  // deleted by a log rotation, then we have to watch the new one
+  if (E.follow.wd != -1)
+    inotify_rm_watch(E.follow.fd, E.follow.wd);
+
+  E.follow.wd = inotify_add_watch(E.follow.fd, E.filename,
+                                  IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+}
+
+void editorFollowStart() {
+  if (E.filename == NULL)
+    return;
+
+  if (E.load.codec) { // appended bytes can't be decompressed on their own
+    editorSetStatusMessage("Can't follow a compressed file");
+    return;
+  }
+
+  editorLoadFinish(); // following starts where the file ends
+
+  struct stat st;
+  if (stat(E.filename, &st) == -1)
+    die("stat");
+  E.follow.dev = st.st_dev;
+  E.follow.ino = st.st_ino;
+
+  E.follow.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (E.follow.fd == -1)
+    die("inotify_init1");
+
+  E.follow.wd = -1;
+  editorFollowWatch();
+
+  if (E.follow.wd == -1)
+    die("inotify_add_watch");
+}
+
+int editorFollowWait() {
+  // waits until either a key is pressed or the followed file changes, returns
+  // 1 when stdin has input ready to be read
+  struct pollfd pfd[2] = {{STDIN_FILENO, POLLIN, 0}, {E.follow.fd, POLLIN, 0}};
+
+  // the timeout lets us pick up a rotated file even if the old one is gone
+  if (poll(pfd, 2, E.follow.wd == -1 ? 1000 : -1) == -1) {
+    if (errno != EINTR)
+      die("poll");
+    return 0;
+  }
+
+  int changed = 0;
+
+  if (pfd[1].revents & POLLIN) {
+    // drain all pending events, many writes collapse into a single read of
+    // the new bytes below
+    char ev[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    while ((n = read(E.follow.fd, ev, sizeof(ev))) > 0) {
+      char *p;
+      for (p = ev; p < ev + n;) {
+        struct inotify_event *event = (struct inotify_event *)p;
+
+        if (event->wd != E.follow.wd)
+          ; // left over from a watch we already removed
+        else if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))
+          changed = 2;
+        else if (changed == 0)
+          changed = 1;
+
+        p += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  }
+
+  int retry = (E.follow.wd == -1); // the file was gone the last time
+
+  if (changed == 2 || retry)
+    editorFollowWatch(); // the file was rotated away, follow the new one
+
+  if ((changed || retry) && editorFollowRead())
+    editorRefreshScreen();
+
+  return (pfd[0].revents & POLLIN) != 0;
+}
+
+// --- LOADING ---
+// files are read by a background thread while the rows that came so far are
+// already on the screen, gzip and zstd files are read through the gzip or
+// zstd program, E belongs to the main thread, so the thread only fills a
+// buffer and the rows are made from it between the keys, a batch at a time
+
+struct editorCodec *editorCodecOf(int fd) {
+  // looks at the first bytes of the file, returns its format or NULL
+  char magic[8];
+  ssize_t n = pread(fd, magic, sizeof(magic), 0);
+
+  unsigned int j;
+  for (j = 0; j < CODECS_ENTRIES; j++)
+    if (n >= CODECS[j].magiclen &&
+        !memcmp(magic, CODECS[j].magic, CODECS[j].magiclen))
+      return &CODECS[j];
+
+  return NULL;
+}
+
+pid_t editorSpawn(char **argv, int in, int out) {
+  // runs argv with in as its stdin and out as its stdout, returns its pid or
+  // -1, what it complains about would mess up the screen, so it goes nowhere
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  int null = open("/dev/null", O_WRONLY);
+  if (dup2(in, STDIN_FILENO) == -1 || dup2(out, STDOUT_FILENO) == -1 ||
+      (null != -1 && dup2(null, STDERR_FILENO) == -1))
+    _exit(127);
+
+  signal(SIGPIPE, SIG_DFL); // te ignores it, what it runs shouldn't
+  execvp(argv[0], argv);
+  _exit(127);
+}
+
+void editorLoadWake(struct editorLoading *ld) {
+  // the pipe is non-blocking, if it is full the editor is woken up already
+  ssize_t r = write(ld->wake[1], "", 1);
+  (void)r;
+}
+
+void *editorLoadThread(void *arg) {
+  struct editorLoading *ld = arg; // the main thread's E.load
+  char chunk[KILO_FOLLOW_CHUNK];
+  ssize_t n = 0;
+
+  while (1) {
+    // only read ahead so far, the rows can't be made as fast as a file is
+    // read, so the rest of a big file would only sit in memory twice
+    pthread_mutex_lock(&ld->lock);
+    while (ld->len >= KILO_LOAD_AHEAD && !ld->stop)
+      pthread_cond_wait(&ld->room, &ld->lock);
+    int stop = ld->stop;
+    pthread_mutex_unlock(&ld->lock);
+
+    if (stop)
+      break;
+
+    n = read(ld->in, chunk, sizeof(chunk));
+    if (n == 0)
+      break;
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    pthread_mutex_lock(&ld->lock);
+    if (ld->len + n > ld->cap) {
+      ld->cap = (ld->len + n) * 2;
+      ld->buf = realloc(ld->buf, ld->cap);
+    }
+    memcpy(ld->buf + ld->len, chunk, n);
+    ld->len += n;
+    pthread_mutex_unlock(&ld->lock);
+
+    editorLoadWake(ld);
+  }
+
+  close(ld->in);
+
+  int ok = (n == 0);
+  if (ld->pid != -1) {
+    int status;
+    if (n != 0) // the decompressor might be blocked writing to us, stop it
+      kill(ld->pid, SIGTERM);
+    if (waitpid(ld->pid, &status, 0) != ld->pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      ok = 0;
+  }
+
+  pthread_mutex_lock(&ld->lock);
+  ld->done = ok ? 1 : -1;
+  pthread_mutex_unlock(&ld->lock);
+
+  editorLoadWake(ld);
+  return NULL;
+}
+
+void editorLoadStart(int fd, struct editorCodec *codec) {
+  // starts reading fd, or decompressing it if codec isn't NULL, the rows are
+  // added by editorLoadTake
+  struct editorLoading *ld = &E.load;
+
+  if (pipe2(ld->wake, O_CLOEXEC | O_NONBLOCK) == -1)
+    die("pipe2");
+
+  ld->codec = codec;
+  ld->codec_asked = 0;
+  ld->pid = -1;
+  ld->total = 0;
+
+  if (codec) {
+    int out[2];
+    if (pipe2(out, O_CLOEXEC) == -1)
+      die("pipe2");
+
+    ld->pid = editorSpawn(codec->decompress, fd, out[1]);
+    if (ld->pid == -1)
+      die("fork");
+    close(out[1]); // so the thread sees the end when the decompressor exits
+    close(fd);
+
+    ld->in = out[0];
+  } else {
+    struct stat st; // for the progress in the status bar
+    if (fstat(fd, &st) == 0)
+      ld->total = st.st_size;
+
+    ld->in = fd;
+  }
+
+  ld->buf = NULL;
+  ld->len = ld->cap = 0;
+  ld->done = 0;
+  ld->stop = 0;
+  ld->loaded = 0;
+  ld->active = 1;
+
+  E.follow.offset = 0;
+  E.follow.partial = 0;
+
+  pthread_mutex_init(&ld->lock, NULL);
+  pthread_cond_init(&ld->room, NULL);
+  if (pthread_create(&ld->thread, NULL, editorLoadThread, ld) != 0)
+    die("pthread_create");
+}
+
+void editorLoadEnd() {
+  // the thread is finished, cleans up after it
+  struct editorLoading *ld = &E.load;
+
+  pthread_join(ld->thread, NULL);
+  pthread_mutex_destroy(&ld->lock);
+  pthread_cond_destroy(&ld->room);
+  close(ld->wake[0]);
+  close(ld->wake[1]);
+  free(ld->buf);
+  ld->buf = NULL;
+  ld->active = 0;
+}
+
+int editorLoadTake() {
+  // turns the lines the thread has read so far into rows, returns 1 if there
+  // were new rows or the loading is finished
+  struct editorLoading *ld = &E.load;
+  char drain[64];
+
+  while (read(ld->wake[0], drain, sizeof(drain)) > 0)
+    ; // one look at buf covers every wake up so far
+
+  pthread_mutex_lock(&ld->lock);
+  char *buf = ld->buf;
+  size_t len = ld->len;
+  int done = ld->done;
+
+  // only whole lines are taken, so the last row is never half a line that
+  // the user could already be editing, unless a single line is longer than
+  // a batch, and no more than a batch, so a key has to wait for one at most
+  size_t take = len < KILO_LOAD_BATCH ? len : KILO_LOAD_BATCH;
+  if (take < len || !done) {
+    char *nl = memrchr(buf, '\n', take);
+    if (nl)
+      take = nl - buf + 1;
+    else if (take < KILO_LOAD_BATCH)
+      take = 0; // the end of the line is still to come
+  }
+
+  // the thread goes on with a new buffer, holding the rest of the line, so
+  // the rows can be made without holding the lock
+  ld->buf = NULL;
+  ld->len = ld->cap = 0;
+  if (take < len) {
+    ld->cap = KILO_FOLLOW_CHUNK + (len - take);
+    ld->buf = malloc(ld->cap);
+    memcpy(ld->buf, buf + take, len - take);
+    ld->len = len - take;
+  }
+  pthread_cond_signal(&ld->room);
+  pthread_mutex_unlock(&ld->lock);
+
+  if (take > 0 && take < len)
+    editorLoadWake(ld); // there is more for the next batch already
+
+  int dirty = E.dirty; // the rows of the file are not changes of the user
+
+  // the same splitting as follow mode, a line cut in two is joined by it
+  char *p = buf;
+  char *end = buf + take;
+  while (p < end) {
+    char *nl = memchr(p, '\n', end - p);
+    size_t n = (nl ? nl : end) - p;
+
+    editorFollowAppend(p, n, nl != NULL);
+    p += n + (nl != NULL);
+  }
+
+  free(buf);
+  E.dirty = dirty;
+  ld->loaded += take;
+  if (!ld->codec)
+    E.follow.offset = ld->loaded; // where follow mode goes on from
+
+  if (!done || take < len)
+    return take > 0;
+
+  editorLoadEnd();
+
+  if (done == -1)
+    editorSetStatusMessage("%s failed, %s is not complete",
+                           ld->codec ? ld->codec->name : "reading",
+                           E.filename);
+
+  return 1;
+}
+
+void editorLoadStep() {
+  // waits for the next batch and adds it
+  struct pollfd pfd = {E.load.wake[0], POLLIN, 0};
+  poll(&pfd, 1, -1);
+  editorLoadTake();
+}
+
+void editorLoadTo(int n) {
+  // waits until there are more than n rows, or the whole file is loaded
+  while (E.load.active && E.numrows <= n)
+    editorLoadStep();
+}
+
+void editorLoadFinish() {
+  // waits for the rest of the file
+  while (E.load.active)
+    editorLoadStep();
+}
+
+void editorLoadStop() {
+  // gives up on the rest of the file
+  struct editorLoading *ld = &E.load;
+  if (!ld->active)
+    return;
+
+  pthread_mutex_lock(&ld->lock);
+  ld->stop = 1;
+  pthread_cond_signal(&ld->room);
+  pthread_mutex_unlock(&ld->lock);
+
+  if (ld->pid != -1)
+    kill(ld->pid, SIGTERM); // the thread might be waiting for its output
+
+  editorLoadEnd();
+}
+
+int editorLoadWait() {
+  // waits until either a key is pressed or more of the file was read, a key
+  // always goes first, returns 1 when the keys (stdin, or the client of the
+  // server) have input ready to be read
+  struct pollfd pfd[2] = {{editorInputFd(), POLLIN, 0},
+                          {E.load.wake[0], POLLIN, 0}};
+
+  if (poll(pfd, 2, -1) == -1) {
+    if (errno != EINTR)
+      die("poll");
+    return 0;
+  }
+
+  if (pfd[0].revents & POLLIN)
+    return 1;
+
+  if ((pfd[1].revents & POLLIN) && editorLoadTake())
+    editorRefreshScreen();
+
+  return 0;
+}
+
+ssize_t editorWriteCompressed(char *filename, struct editorCodec *codec) {
+  // pipes the rows through the compressor into a new file next to filename,
+  // which then replaces it, so a failing compressor can't leave half a file
+  // behind, returns the number of bytes before compression or -1
+  char *tmp = malloc(strlen(filename) + 8);
+  sprintf(tmp, "%s.XXXXXX", filename);
+
+  int out = mkstemp(tmp);
+  if (out == -1) {
+    free(tmp);
+    return -1;
+  }
+
+  struct stat st; // keep the permissions of the file, mkstemp uses 0600
+  fchmod(out, stat(filename, &st) == 0 ? st.st_mode & 07777 : 0644);
+
+  int in[2] = {-1, -1};
+  pid_t pid = -1;
+  if (pipe2(in, O_CLOEXEC) == 0) {
+    pid = editorSpawn(codec->compress, in[0], out);
+    close(in[0]);
+  }
+
+  ssize_t len = -1;
+  int saved = errno;
+  close(out);
+
+  if (pid != -1) {
+    // if the compressor dies, writing to it fails with EPIPE, SIGPIPE is
+    // ignored by main
+    len = editorWriteRows(in[1]);
+    saved = errno;
+    close(in[1]);
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      if (len != -1)
+        saved = EIO;
+      len = -1;
+    }
+  } else if (in[1] != -1) {
+    close(in[1]);
+  }
+
+  if (len != -1 && rename(tmp, filename) == -1) {
+    saved = errno;
+    len = -1;
+  }
+
+  if (len == -1)
+    unlink(tmp);
+
+  free(tmp);
+  errno = saved;
+  return len;
+}
+
+// --- PAGER ---
+// pager mode (-R) never copies the file into E.row, the file is mmapped and
+// only the lines that are on the screen get rendered, into a single scratch
+// row that is reused for every line, the newline index is built lazily, only
+// as far as the user has looked, so opening even a huge file is instant
+
+void editorPagerGrow() {
+  // makes room for more lines in the index, an index that came from the
+  // cache is copied out of its mapping first
+  int cap = E.pager.linecap ? E.pager.linecap * 2 : 1024;
+  cap = (cap + 7) & ~7; // a whole byte of comment bits for every 8
+
+  if (E.pager.cache) {
+    size_t *line = malloc(sizeof(size_t) * cap);
+    unsigned char *comment = malloc(cap / 8);
+    memcpy(line, E.pager.line, sizeof(size_t) * E.pager.nlines);
+    memcpy(comment, E.pager.comment, (E.pager.nlines + 7) / 8);
+    munmap(E.pager.cache, E.pager.cachesize);
+    E.pager.cache = NULL;
+    E.pager.line = line;
+    E.pager.comment = comment;
+  } else {
+    E.pager.line = realloc(E.pager.line, sizeof(size_t) * cap);
+    E.pager.comment = realloc(E.pager.comment, cap / 8);
+  }
+
+  E.pager.linecap = cap;
+}
+
+void editorPagerScan() {
+  // searches the next chunk of the file for newlines, adding every line that
+  // starts there to the index
+  size_t end = E.pager.scanned + KILO_PAGER_SCAN;
+  if (end > E.pager.size)
+    end = E.pager.size;
+
+  char *p = E.pager.map + E.pager.scanned;
+  char *nl;
+
+  while ((nl = memchr(p, '\n', E.pager.map + end - p))) {
+    p = nl + 1;
+    if (p == E.pager.map + E.pager.size)
+      break; // a newline at the very end doesn't start another line
+
+    if (E.pager.nlines == E.pager.linecap)
+      editorPagerGrow();
+
+    E.pager.line[E.pager.nlines++] = p - E.pager.map;
+  }
+
+  E.pager.scanned = end;
+}
+
+int editorPagerIndexTo(int n) {
+  // makes sure the lines up to n and where they end are indexed, returns the
+  // number of lines indexed so far
+  while (E.pager.scanned < E.pager.size && E.pager.nlines <= n + 1)
+    editorPagerScan();
+
+  return E.pager.nlines;
+}
+
+int editorPagerLineOf(size_t off) {
+  // the line that contains the byte at off, found by binary search
+  while (E.pager.scanned <= off && E.pager.scanned < E.pager.size)
+    editorPagerScan();
+
+  int lo = 0;
+  int hi = E.pager.nlines - 1;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo + 1) / 2;
+    if (E.pager.line[mid] <= off)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  return lo;
+}
+
+void editorPagerRender(int n) {
+  // renders line n into E.pager.scratch, just like editorUpdateRow does
+  editorPagerIndexTo(n);
+
+  size_t start = E.pager.line[n];
+  size_t end = (n + 1 < E.pager.nlines) ? E.pager.line[n + 1] - 1
+                                         : E.pager.size;
+
+  if (n + 1 == E.pager.nlines && end > start && E.pager.map[end - 1] == '\n')
+    end--; // the last line with a newline at the end of the file
+  if (end > start && E.pager.map[end - 1] == '\r')
+    end--;
+
+  erow *row = &E.pager.scratch;
+  row->idx = n;
+  row->chars = E.pager.map + start; // points into the mapping, never written
+  row->size = end - start;
+
+  int tabs = 0;
+  int j;
+  for (j = 0; j < row->size; j++) {
+    if (row->chars[j] == '\t')
+      tabs++;
+  }
+
+  int need = row->size + tabs * (KILO_TAB_STOP - 1) + 1;
+  if (need > E.pager.scratchcap) { // only grows, so no allocation per frame
+    E.pager.scratchcap = need;
+    row->render = realloc(row->render, need);
+    row->hl = realloc(row->hl, need);
+    E.pager.cols = realloc(E.pager.cols, sizeof(int) * need);
+  }
+
+  int ascii = editorIsAscii(row->chars, row->size);
+
+  row->rsize = editorRenderChars(row->chars, row->size, row->render, ascii);
+
+  // like editorUpdateWidths, without freeing what the next line needs again
+  if (ascii) {
+    row->rcol = NULL;
+    row->rcols = row->rsize;
+  } else {
+    row->rcol = E.pager.cols;
+    row->rcols = editorRenderColumns(row->render, row->rsize, row->rcol);
+  }
+}
+
+int editorPagerCommentBefore(int n) {
+  // tells if line n starts inside a multiline comment, to know it all the
+  // lines above have to be highlighted once, the result is remembered in the
+  // comment bitmap
+  if (n == 0 || E.syntax == NULL || E.syntax->multiline_comment_start == NULL)
+    return 0;
+
+  while (E.pager.hl_valid < n) {
+    int l = E.pager.hl_valid;
+    int prev = l > 0 && (E.pager.comment[(l - 1) / 8] & (1 << ((l - 1) % 8)));
+
+    editorPagerRender(l);
+    if (editorHighlightRow(&E.pager.scratch, prev))
+      E.pager.comment[l / 8] |= 1 << (l % 8);
+    else
+      E.pager.comment[l / 8] &= ~(1 << (l % 8));
+
+    E.pager.hl_valid++;
+  }
+
+  return (E.pager.comment[(n - 1) / 8] & (1 << ((n - 1) % 8))) != 0;
+}
+
+erow *editorPagerRow(int n) {
+  // renders and highlights line n into the scratch row, the row is only valid
+  // until the next call
+  int in_comment = editorPagerCommentBefore(n);
+
+  editorPagerRender(n);
+  editorHighlightRow(&E.pager.scratch, in_comment);
+
+  if (n == E.pager.match_line) { // overlay the current search match
+    int at = editorRowColToByte(&E.pager.scratch, E.pager.match_col);
+    int len = E.pager.match_len;
+    if (at + len > E.pager.scratch.rsize)
+      len = E.pager.scratch.rsize - at;
+    if (len > 0)
+      memset(&E.pager.scratch.hl[at], HL_MATCH, len);
+  }
+
+  return &E.pager.scratch;
+}
+
+void editorPagerOpen(char *filename) {
+  free(E.filename);
+  E.filename = strdup(filename);
+
+  editorSelectSyntaxHighlight();
+
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    die("open");
+
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+    die("fstat");
+
+  E.pager.size = st.st_size;
+  E.pager.map = NULL;
+
+  if (E.pager.size > 0) { // mmap refuses to map 0 bytes
+    E.pager.map = mmap(NULL, E.pager.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (E.pager.map == MAP_FAILED)
+      die("mmap");
+  }
+
+  close(fd); // the mapping stays valid after closing
+
+  E.pager.enabled = 1;
+
+  if (editorIndexLoad(&st))
+    return; // indexed before, as far as the user looked then
+
+  if (E.pager.size > 0) { // the first line starts at offset 0
+    E.pager.linecap = 1024;
+    E.pager.line = malloc(sizeof(size_t) * E.pager.linecap);
+    E.pager.comment = malloc(E.pager.linecap / 8);
+    E.pager.line[E.pager.nlines++] = 0;
+  }
+}
+
+int editorPagerWidth(int n) {
+  // the rendered length of line n, where the cursor can go at most
+  if (n >= editorPagerIndexTo(n))
+    return 0;
+
+  editorPagerRender(n);
+  return E.pager.scratch.rcols;
+}
+
+void editorPagerProcessKeypress(int c) {
+  int numrows = editorPagerIndexTo(E.cy + E.screenrows);
+
+  switch (c) {
+  case 'q':
+  case CTRL_KEY('q'):
+    editorIndexSave(); // for opening it again
+    editorOutput("\x1b[2J", 4);
+    editorOutput("\x1b[H", 3);
+    exit(0);
+    break;
+
+  case CTRL_KEY('f'):
+    editorFind();
+    break;
+
+  case CTRL_KEY('g'):
+    editorGoto();
+    break;
+
+  case CTRL_KEY('n'):
+    E.linenumbers = !E.linenumbers;
+    break;
+
+  case ARROW_UP:
+    if (E.cy > 0)
+      E.cy--;
+    break;
+
+  case ARROW_DOWN:
+    if (E.cy + 1 < numrows)
+      E.cy++;
+    break;
+
+  case ARROW_LEFT:
+    if (E.cx > 0)
+      E.cx--;
+    break;
+
+  case ARROW_RIGHT:
+    if (E.cx < editorPagerWidth(E.cy))
+      E.cx++;
+    break;
+
+  case HOME_KEY:
+    E.cx = 0;
+    break;
+
+  case END_KEY:
+    E.cx = editorPagerWidth(E.cy);
+    break;
+
+  case PAGE_UP:
+    E.cy -= E.screenrows;
+    if (E.cy < 0)
+      E.cy = 0;
+    break;
+
+  case PAGE_DOWN:
+    E.cy += E.screenrows;
+    if (E.cy >= numrows)
+      E.cy = numrows > 0 ? numrows - 1 : 0;
+    break;
+
+  case CTRL_KEY('t'):
+    statsToggle();
+    break;
+
+  case 'g': // top of the file, like less
+    E.cy = 0;
+    break;
+
+  case 'G': // bottom of the file, this has to index all of it
+    while (E.pager.scanned < E.pager.size)
+      editorPagerScan();
+    E.cy = E.pager.nlines > 0 ? E.pager.nlines - 1 : 0;
+    break;
+
+  case CTRL_KEY('l'):
+  case '\x1b':
+    break;
+
+  default:
+    editorSetStatusMessage("Read-only! The file was opened with -R");
+    break;
+  }
+
+  int width = editorPagerWidth(E.cy);
+  if (E.cx > width) // same as editorMoveCursor, stay within the line
+    E.cx = width;
+}
+
+char *editorPagerFindBack(char *query, size_t qlen, size_t before) {
+  // the last match that starts before the offset before, memmem only looks
+  // forward, so look for the last match in chunks going backwards
+  size_t hi = before;
+
+  while (hi > 0) {
+    size_t lo = hi > KILO_PAGER_SCAN ? hi - KILO_PAGER_SCAN : 0;
+    size_t end = hi + qlen - 1; // matches may go past hi, but not start there
+    if (end > E.pager.size)
+      end = E.pager.size;
+
+    char *last = NULL;
+    char *p = E.pager.map + lo;
+    char *m;
+    while ((m = memmem(p, E.pager.map + end - p, query, qlen))) {
+      last = m;
+      p = m + 1;
+    }
+
+    if (last)
+      return last;
+    hi = lo;
+  }
+
+  return NULL;
+}
+
+void editorPagerFindCallback(char *query, int key) {
+  static size_t last_match = (size_t)-1; // offset of the last match
+  static int direction = 1;
+
+  E.pager.match_line = -1; // removes the highlight of the previous match
+
+  if (key == '\r' || key == '\x1b') {
+    last_match = (size_t)-1;
+    direction = 1;
+    return;
+  } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
+    direction = 1;
+  } else if (key == ARROW_LEFT || key == ARROW_UP) {
+    direction = -1;
+  } else {
+    last_match = (size_t)-1;
+    direction = 1;
+  }
+
+  size_t qlen = strlen(query);
+  if (qlen == 0 || E.pager.size == 0)
+    return;
+
+  // a new query searches from the line the cursor is on, unlike
+  // editorFindCallback which starts at the top, a huge file would take long
+  size_t from = (last_match == (size_t)-1) ? E.pager.line[E.cy] : last_match;
+  char *match;
+
+  if (direction == 1) {
+    if (last_match != (size_t)-1)
+      from++;
+
+    match = memmem(E.pager.map + from, E.pager.size - from, query, qlen);
+    if (!match) // wrap around to the beginning of the file
+      match = memmem(E.pager.map, E.pager.size, query, qlen);
+  } else {
+    match = editorPagerFindBack(query, qlen, from);
+    if (!match) // wrap around to the end of the file
+      match = editorPagerFindBack(query, qlen, E.pager.size);
+  }
+
+  if (!match)
+    return;
+
+  last_match = match - E.pager.map;
+
+  int line = editorPagerLineOf(last_match);
+
+  erow row; // only chars and size are needed to convert cx to rx
+  row.chars = E.pager.map + E.pager.line[line];
+  row.size = last_match - E.pager.line[line];
+
+  E.cy = line;
+  E.cx = editorRowCxToRx(&row, row.size); // the pager cursor is a render column
+  E.rowoff = line; // puts the match at the top of the screen
+
+  E.pager.match_line = line;
+  E.pager.match_col = E.cx;
+  E.pager.match_len = qlen;
+}
+
+// --- INDEX CACHE ---
+// the newline index of the pager and the comment bits of its lines are kept
+// in a cache file when it quits, keyed by the path of the file, and checked
+// against its device, inode, size and mtime, opening the file unchanged maps
+// the cache and scans nothing, a file that only grew, like a log, is scanned
+// from where the cache ends, the cache is in $XDG_CACHE_HOME/te, or in
+// ~/.cache/te
+
+unsigned long long editorIndexHash(const char *s, size_t len) {
+  // FNV-1a, for the cache file names and for the tail of the indexed bytes
+  unsigned long long h = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+unsigned long long editorIndexTail(size_t scanned) {
+  // the bytes right before scanned, if they are the same the file is taken
+  // to have only grown since it was indexed
+  size_t from = scanned > 4096 ? scanned - 4096 : 0;
+  return editorIndexHash(E.pager.map + from, scanned - from);
+}
+
+char *editorIndexPath(char *path, int create) {
+  // the cache file of path, which has to be absolute, its directory is made
+  // if create is 1, returns NULL if there is no place for caches
+  char *base = getenv("XDG_CACHE_HOME");
+  char *home = getenv("HOME");
+  char dir[PATH_MAX];
+
+  if (base && base[0])
+    snprintf(dir, sizeof(dir), "%s/te", base);
+  else if (home && home[0])
+    snprintf(dir, sizeof(dir), "%s/.cache/te", home);
+  else
+    return NULL;
+
+  if (create) { // the cache directory itself may be missing too
+    *strrchr(dir, '/') = '\0';
+    mkdir(dir, 0700);
+    dir[strlen(dir)] = '/';
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+      return NULL;
+  }
+
+  char *file = malloc(strlen(dir) + 32);
+  sprintf(file, "%s/%016llx.idx", dir, editorIndexHash(path, strlen(path)));
+  return file;
+}
+
+int editorIndexLoad(struct stat *st) {
+  // sets up the pager's index from the cache of the file, returns 0 if
+  // there is none that fits the file
+  char *path = realpath(E.filename, NULL);
+  char *file = path ? editorIndexPath(path, 0) : NULL;
+  int fd = file ? open(file, O_RDONLY | O_CLOEXEC) : -1;
+  free(file);
+
+  struct stat cst;
+  if (fd == -1 || fstat(fd, &cst) == -1 ||
+      cst.st_size < (off_t)sizeof(struct editorIndexHeader)) {
+    if (fd != -1)
+      close(fd);
+    free(path);
+    return 0;
+  }
+
+  // private and writable, the comment bits are filled in as the user goes
+  char *map = mmap(NULL, cst.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    free(path);
+    return 0;
+  }
+
+  struct editorIndexHeader *h = (struct editorIndexHeader *)map;
+  long long pathlen = (long long)strlen(path);
+  long long at = (sizeof(*h) + pathlen + 7) & ~7LL; // where line starts
+
+  int fits = !memcmp(h->magic, KILO_INDEX_MAGIC, sizeof(KILO_INDEX_MAGIC)) &&
+             h->pathlen == pathlen && h->nlines > 0 &&
+             h->nlines <= INT_MAX &&
+             at + h->nlines * (long long)sizeof(size_t) + (h->nlines + 7) / 8 <=
+                 (long long)cst.st_size &&
+             !memcmp(map + sizeof(*h), path, pathlen);
+  free(path);
+
+  int same = fits && h->dev == (unsigned long long)st->st_dev &&
+             h->ino == (unsigned long long)st->st_ino;
+  int unchanged = same && h->size == (long long)st->st_size &&
+                  h->mtime_sec == (long long)st->st_mtim.tv_sec &&
+                  h->mtime_nsec == (long long)st->st_mtim.tv_nsec;
+  int grew = same && !unchanged && h->size < (long long)st->st_size &&
+             h->scanned <= h->size && h->scanned > 0 &&
+             editorIndexTail(h->scanned) == h->tail;
+
+  if (!unchanged && !grew) {
+    munmap(map, cst.st_size);
+    return 0;
+  }
+
+  E.pager.cache = map;
+  E.pager.cachesize = cst.st_size;
+  E.pager.line = (size_t *)(map + at);
+  E.pager.comment = (unsigned char *)(map + at + h->nlines * sizeof(size_t));
+  E.pager.nlines = E.pager.linecap = h->nlines; // full, more lines move it
+  E.pager.scanned = h->scanned;
+  E.pager.hl_valid = h->hl_valid;
+  E.pager.cached = h->scanned;
+  E.pager.cached_hl = h->hl_valid;
+
+  if (grew) {
+    // the last line may go on in the new bytes, so its comment bit isn't
+    // known anymore, and a newline at the old end starts a line now, which
+    // the scan finds when it begins right at that newline
+    if (E.pager.hl_valid >= E.pager.nlines)
+      E.pager.hl_valid = E.pager.nlines - 1;
+    if (E.pager.scanned == (size_t)h->size)
+      E.pager.scanned--;
+  }
+  return 1;
+}
+
+void editorIndexSave() {
+  // writes the pager's index to the cache, if it got further than the one
+  // that was read, small files are quick enough to scan again
+  if (!E.pager.enabled || E.pager.scanned < KILO_INDEX_MIN ||
+      (E.pager.scanned <= E.pager.cached &&
+       E.pager.hl_valid <= E.pager.cached_hl))
+    return;
+
+  struct stat st;
+  char *path = realpath(E.filename, NULL);
+  char *file = path ? editorIndexPath(path, 1) : NULL;
+  if (file == NULL || stat(path, &st) == -1 ||
+      (size_t)st.st_size != E.pager.size) { // it changed while being paged
+    free(path);
+    free(file);
+    return;
+  }
+
+  struct editorIndexHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, KILO_INDEX_MAGIC, sizeof(KILO_INDEX_MAGIC));
+  h.dev = st.st_dev;
+  h.ino = st.st_ino;
+  h.size = st.st_size;
+  h.mtime_sec = st.st_mtim.tv_sec;
+  h.mtime_nsec = st.st_mtim.tv_nsec;
+  h.scanned = E.pager.scanned;
+  h.nlines = E.pager.nlines;
+  h.hl_valid = E.pager.hl_valid;
+  h.tail = editorIndexTail(E.pager.scanned);
+  h.pathlen = strlen(path);
+
+  // written next to the old cache and renamed over it, a pager that has the
+  // old one mapped keeps it
+  char *tmp = malloc(strlen(file) + 8);
+  sprintf(tmp, "%s.XXXXXX", file);
+  int fd = mkstemp(tmp);
+  FILE *fp = fd != -1 ? fdopen(fd, "w") : NULL;
+
+  if (fp) {
+    static const char pad[8];
+    size_t padlen = ((sizeof(h) + h.pathlen + 7) & ~7) - sizeof(h) - h.pathlen;
+    size_t bits = (E.pager.nlines + 7) / 8;
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+             fwrite(path, 1, h.pathlen, fp) == (size_t)h.pathlen &&
+             fwrite(pad, 1, padlen, fp) == padlen &&
+             fwrite(E.pager.line, sizeof(size_t), E.pager.nlines, fp) ==
+                 (size_t)E.pager.nlines &&
+             fwrite(E.pager.comment, 1, bits, fp) == bits;
+    if (fclose(fp) == 0 && ok && rename(tmp, file) == 0)
+      tmp[0] = '\0'; // nothing to clean up
+  } else if (fd != -1) {
+    close(fd);
+  }
+
+  if (tmp[0])
+    unlink(tmp);
+  free(tmp);
+  free(path);
+  free(file);
+}
+
+// --- FIND ---
+// the rows that have the query are kept, when the query grows by a key, the
+// rows that have the new one can only be among them, so only those are
+// looked at again instead of the whole file, any edit, or a shorter or
+// different query, starts over, both are done lazily, only as far down as the
+// next match, so a key costs no more than the scan from the top did
+
+const char *editorSearchMem(const char *s, size_t len, const char *query,
+                            int qlen) {
+  // the first match of query in s, rows are short, so memchr for the first
+  // byte beats what memmem does to set up, Ctrl-A runs it over whole files
+  if (len < (size_t)qlen)
+    return NULL;
+
+  const char *p = s;
+  const char *end = s + len - qlen + 1;
+
+  while (p < end && (p = memchr(p, query[0], end - p))) {
+    if (!memcmp(p + 1, query + 1, qlen - 1))
+      return p;
+    p++;
+  }
+  return NULL;
+}
+
+char *editorSearchRow(erow *row, int from, char *query, int qlen) {
+  // the first match in the render of the row at or after from
+  if (row->rsize - from < qlen)
+    return NULL;
+
+  return (char *)editorSearchMem(&row->render[from], row->rsize - from, query,
+                                 qlen);
+}
+
+void editorSearchUpdate(char *query) {
+  // brings E.search up to date with query
+  struct editorSearch *s = &E.search;
+  int qlen = strlen(query);
+
+  if (s->query && s->edits == E.edits && !strcmp(query, s->query))
+    return; // only an arrow was pressed
+
+  if (s->query && s->edits == E.edits && s->qlen > 0 && qlen >= s->qlen &&
+      !memcmp(query, s->query, s->qlen)) {
+    // a row that has the longer query has the shorter one as well, the
+    // rows that had it all have to be looked at again
+    if (s->next < s->n)
+      memmove(&s->rows[s->done], &s->rows[s->next],
+              sizeof(int) * (s->n - s->next));
+    s->n = s->done + s->n - s->next;
+    s->done = s->next = 0;
+  } else {
+    s->n = s->done = s->next = s->scanned = 0;
+  }
+
+  free(s->query);
+  s->query = strdup(query);
+  s->qlen = qlen;
+  s->edits = E.edits;
+  if (++s->gen == 0) // 0 is for the empty entries
+    s->gen = 1;
+}
+
+int editorSearchStep() {
+  // looks at one more row, one that had a shorter query, or else the next
+  // one that was never looked at, returns 0 when all rows are known
+  struct editorSearch *s = &E.search;
+  int at;
+
+  if (s->next < s->n) {
+    at = s->rows[s->next++];
+  } else if (s->scanned < E.numrows && s->qlen > 0) {
+    at = s->scanned++;
+    s->n = s->next = s->done; // there is nothing left behind done
+  } else {
+    return 0;
+  }
+
+  if (editorSearchRow(&E.row[at], 0, s->query, s->qlen)) {
+    if (s->done == s->cap) {
+      s->cap = s->cap ? s->cap * 2 : 256;
+      s->rows = realloc(s->rows, sizeof(int) * s->cap);
+    }
+    s->rows[s->done++] = at; // never past next, or a row not read yet
+    if (s->n < s->done)
+      s->n = s->next = s->done;
+  }
+  return 1;
+}
+
+int editorSearchIndex(int at) {
+  // the first of the rows known to have the query that is at or after at
+  struct editorSearch *s = &E.search;
+  int lo = 0, hi = s->done;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (s->rows[mid] < at)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int editorSearchRowAfter(int at, int direction) {
+  // the row with a match after at, or the last one before it, wrapping
+  // around the file, -1 if there are none
+  struct editorSearch *s = &E.search;
+  int i;
+
+  if (direction == 1) {
+    i = editorSearchIndex(at + 1);
+    if (i < s->done)
+      return s->rows[i];
+    while (editorSearchStep()) // the rows are known in order from the top
+      if (s->done > i && s->rows[s->done - 1] > at)
+        return s->rows[s->done - 1];
+    return s->done ? s->rows[0] : -1; // all are known now
+  }
+
+  // every row up to at has to be known for the one right before it
+  while ((s->next < s->n ? s->rows[s->next] : s->scanned) < at &&
+         editorSearchStep())
+    ;
+  i = editorSearchIndex(at);
+  if (i > 0)
+    return s->rows[i - 1];
+  while (editorSearchStep())
+    ;
+  return s->done ? s->rows[s->done - 1] : -1;
+}
+
+int editorSearchFind(int at, int off, int direction) {
+  // the offset into the render of the row of the match after off, or the
+  // last one before it, -1 if there is none, the whole row for off -1
+  erow *row = &E.row[at];
+  char *query = E.search.query;
+  int qlen = E.search.qlen;
+
+  if (direction == 1) {
+    char *m = off < row->rsize ? editorSearchRow(row, off + 1, query, qlen)
+                               : NULL;
+    return m ? m - row->render : -1;
+  }
+
+  int last = -1;
+  char *m = editorSearchRow(row, 0, query, qlen);
+  while (m && (off == -1 || m - row->render < off)) {
+    last = m - row->render;
+    m = editorSearchRow(row, last + 1, query, qlen);
+  }
+  return last;
+}
+
+int editorSearchNext(int *at, int *off, int direction) {
+  // moves (at, off) to the next match in direction, at -1 starts from the
+  // top, returns 0 if there are no matches
+  if (*at != -1) {
+    int o = editorSearchFind(*at, *off, direction);
+    if (o != -1) { // another one on the same row
+      *off = o;
+      return 1;
+    }
+  }
+
+  int row = editorSearchRowAfter(*at, direction);
+  if (row == -1)
+    return 0;
+
+  *at = row;
+  *off = editorSearchFind(row, -1, direction);
+  return 1;
+}
+
+int *editorSearchMatches(erow *row, int *n) {
+  // the matches of the query on a row that is drawn, they are looked for
+  // again only when the row or the query changed since the last time, a
+  // row is in one of two entries picked by its version
+  struct editorSearch *s = &E.search;
+  if (s->cache == NULL)
+    s->cache = calloc(KILO_MATCH_SETS * 2, sizeof(struct editorRowMatches));
+
+  struct editorRowMatches *e =
+      &s->cache[(row->version % KILO_MATCH_SETS) * 2];
+  if (e->gen != s->gen || e->version != row->version) {
+    e++;
+    if (e->gen != s->gen || e->version != row->version) {
+      if (e[-1].used < e->used) // the one drawn longer ago is replaced
+        e--;
+
+      e->version = row->version;
+      e->gen = s->gen;
+      e->n = 0;
+
+      char *m = editorSearchRow(row, 0, s->query, s->qlen);
+      while (m) {
+        if (e->n == e->cap) {
+          e->cap = e->cap ? e->cap * 2 : 8;
+          e->off = realloc(e->off, sizeof(int) * e->cap);
+        }
+        e->off[e->n++] = m - row->render;
+        m = editorSearchRow(row, m - row->render + 1, s->query, s->qlen);
+      }
+    }
+  }
+
+  e->used = ++s->used;
+  *n = e->n;
+  return e->off;
+}
+
+void editorFindCallback(char *query, int key) {
+  // per thread, the documents of te -d are searched in their own threads
+  static __thread int last_row = -1; // where the last match was, -1 for none
+  static __thread int last_off;
+  static __thread int direction = 1;
+
+  if (key == '\r' || key == '\x1b') {
+    last_row = -1;
+    direction = 1;
+    E.search.active = 0; // the matches aren't drawn any more
+    return;
+  } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
+    direction = 1;
+  } else if (key == ARROW_LEFT || key == ARROW_UP) {
+    direction = -1;
+  } else {
+    last_row = -1;
+    direction = 1;
+  }
+
+  // narrows down the rows when the query grew, and starts over after edits,
+  // every match on the screen is drawn highlighted, see editorDrawRows
+  editorSearchUpdate(query);
+  E.search.active = 1;
+  if (last_row >= E.numrows)
+    last_row = -1;
+
+  int at = last_row, off = last_off;
+  if (!editorSearchNext(&at, &off, direction))
+    return;
+
+  erow *row = &E.row[at];
+
+  last_row = at; // updates the last match to the current one
+  last_off = off;
+  E.cy = at;
+  E.cx = editorRowRxToCx(
+      row, editorRowByteToCol(row, off)); // converts the rx to cx, since cx
+                                          // is referring to the position of
+                                          // char, not on the screen
+  E.rowoff = E.numrows;
+}
+
+void editorFind() {
+  int saved_cx = E.cx;
+  int saved_cy = E.cy;
+  int saved_coloff = E.coloff;
+  int saved_rowoff = E.rowoff;
+
+  char *query = editorPrompt("Search: %s (Use ESC/Arrows/Enter)",
+                             E.pager.enabled ? editorPagerFindCallback
+                                             : editorFindCallback);
+
+  if (query)
+    free(query);
+  else {
+    E.cx = saved_cx;
+    E.cy = saved_cy;
+    E.coloff = saved_coloff;
+    E.rowoff = saved_rowoff;
+  }
+}
+
+// --- GOTO ---
+
+void editorGoto() {
+  // jumps to a line, to a byte offset (@offset) or to a percentage of the
+  // file (N%), the offsets come from the line index in O(log n), the pager
+  // has its own index of line offsets
+  char *query = editorPrompt("Go to line, @offset or N%%: %s", NULL);
+  if (query == NULL)
+    return;
+
+  char *p = query;
+  int byoffset = (*p == '@');
+  if (byoffset)
+    p++;
+
+  char *end;
+  long long n = strtoll(p, &end, 10);
+
+  if (end == p || n < 0 || (*end && strcmp(end, "%"))) {
+    editorSetStatusMessage("Not a line, @offset or N%%: %s", query);
+    free(query);
+    return;
+  }
+
+  long long total = E.pager.enabled ? (long long)E.pager.size
+                                    : editorLinesOffset(E.numrows);
+
+  if (*end == '%') { // a percentage is just another byte offset
+    byoffset = 1;
+    n = total * (n > 100 ? 100 : n) / 100;
+  }
+
+  int line;
+  if (byoffset) {
+    if (n >= total)
+      n = total > 0 ? total - 1 : 0;
+    line = E.pager.enabled ? editorPagerLineOf(n) : editorLinesRowAt(n);
+  } else {
+    line = n > 0 ? (n - 1 > INT_MAX ? INT_MAX : n - 1) : 0;
+  }
+
+  int numrows = E.pager.enabled ? editorPagerIndexTo(line) : E.numrows;
+  if (line >= numrows)
+    line = numrows > 0 ? numrows - 1 : 0;
+
+  E.cy = line;
+  E.cx = 0;
+  E.rowoff = line; // puts the line at the top of the screen
+
+  if (byoffset && !E.pager.enabled && line < E.numrows) {
+    // and the cursor on the byte itself, or the start of its character
+    erow *row = &E.row[line];
+    long long at = n - editorLinesOffset(line);
+
+    E.cx = at < row->size ? at : row->size;
+    while (E.cx > 0 && editorIsContinuation(row->chars[E.cx]))
+      E.cx--;
+  }
+
+  free(query);
+}
+
+// --- SYMBOLS ---
+// jump to definition (Ctrl-]), the definitions are found with the lexer, in
+// the open buffer as its rows get highlighted, and in the sibling files of
+// the same syntax by a background thread that looks again at the ones that
+// change, the names go into hash tables so a jump is a single lookup
+
+struct editorIndexer indexer = {0, 0, PTHREAD_MUTEX_INITIALIZER, NULL, NULL,
+                                {NULL, 0, 0}, NULL, 0};
+
+unsigned int symtabHash(const char *name, int len) {
+  // FNV-1a
+  unsigned int h = 2166136261u;
+  int i;
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  return h;
+}
+
+void symtabGrow(struct editorSymtab *t) {
+  // doubles the buckets, relinking every symbol into its new chain
+  int n = t->nbuckets ? t->nbuckets * 2 : 1024;
+  struct editorSymbol **bucket = calloc(n, sizeof(struct editorSymbol *));
+  int b;
+
+  for (b = 0; b < t->nbuckets; b++) {
+    struct editorSymbol *sym = t->bucket[b];
+    while (sym) {
+      struct editorSymbol *next = sym->next;
+      unsigned int h = symtabHash(sym->name, strlen(sym->name)) & (n - 1);
+      sym->next = bucket[h];
+      bucket[h] = sym;
+      sym = next;
+    }
+  }
+
+  free(t->bucket);
+  t->bucket = bucket;
+  t->nbuckets = n;
+}
+
+struct editorSymbol *symtabAdd(struct editorSymtab *t, const char *name,
+                               int len, int file, int line) {
+  if (t->count >= t->nbuckets * 2)
+    symtabGrow(t);
+
+  struct editorSymbol *sym = malloc(sizeof(struct editorSymbol));
+  sym->name = malloc(len + 1);
+  memcpy(sym->name, name, len);
+  sym->name[len] = '\0';
+  sym->file = file;
+  sym->line = line;
+
+  unsigned int h = symtabHash(name, len) & (t->nbuckets - 1);
+  sym->next = t->bucket[h];
+  t->bucket[h] = sym;
+  t->count++;
+
+  return sym;
+}
+
+void symtabDel(struct editorSymtab *t, struct editorSymbol *sym) {
+  // unlinks the symbol from its chain and frees it
+  unsigned int h = symtabHash(sym->name, strlen(sym->name)) & (t->nbuckets - 1);
+  struct editorSymbol **p = &t->bucket[h];
+
+  while (*p != sym)
+    p = &(*p)->next;
+  *p = sym->next;
+  t->count--;
+
+  free(sym->name);
+  free(sym);
+}
+
+struct editorSymbol *symtabFind(struct editorSymtab *t, const char *name,
+                                int len) {
+  // the first definition of name, or NULL
+  if (t->nbuckets == 0)
+    return NULL;
+
+  struct editorSymbol *sym = t->bucket[symtabHash(name, len) & (t->nbuckets - 1)];
+  while (sym && (strncmp(sym->name, name, len) || sym->name[len] != '\0'))
+    sym = sym->next;
+
+  return sym;
+}
+
+int editorSymbolsScan(const char *s, int n, const unsigned char *hl,
+                      int *names, int max) {
+  // finds the definitions on a line of C from how the lexer highlighted it,
+  // a definition starts the line: a function (name followed by a parameter
+  // list, without the ; of a prototype), a struct, union or enum with a body,
+  // the name closing a typedef (} name;) or a macro, names[] gets the start
+  // and the length of every name found, returns how many there are
+  int found = 0;
+  int i, j;
+
+  if (n == 0 || hl[0] == HL_COMMENT || hl[0] == HL_MLCOMMENT)
+    return 0;
+
+  if (n > 8 && !memcmp(s, "#define", 7) && isspace((unsigned char)s[7])) {
+    for (i = 7; i < n && isspace((unsigned char)s[i]); i++)
+      ;
+    for (j = i; j < n && is_ident((unsigned char)s[j]); j++)
+      ;
+    if (j > i) {
+      names[0] = i;
+      names[1] = j - i;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (s[0] == '}') { // } name; closing a typedef
+    for (i = 1; i < n && isspace((unsigned char)s[i]); i++)
+      ;
+    for (j = i; j < n && is_ident((unsigned char)s[j]); j++)
+      ;
+    if (j > i && j < n && s[j] == ';') {
+      names[0] = i;
+      names[1] = j - i;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (!isalpha((unsigned char)s[0]) && s[0] != '_')
+    return 0; // indented, or not code
+
+  // struct, union or enum, with the name followed by its body
+  for (i = 0; i < n && found < max; i++) {
+    if (hl[i] != HL_KEYWORD1 || (i > 0 && hl[i - 1] == HL_KEYWORD1))
+      continue;
+
+    int klen = (i + 6 <= n && !memcmp(&s[i], "struct", 6))  ? 6
+               : (i + 5 <= n && !memcmp(&s[i], "union", 5)) ? 5
+               : (i + 4 <= n && !memcmp(&s[i], "enum", 4))  ? 4
+                                                             : 0;
+    if (klen == 0)
+      continue;
+
+    int start = i + klen;
+    while (start < n && isspace((unsigned char)s[start]))
+      start++;
+    for (j = start; j < n && is_ident((unsigned char)s[j]); j++)
+      ;
+
+    int end = j;
+    while (j < n && isspace((unsigned char)s[j]))
+      j++;
+
+    if (end > start && (j == n || s[j] == '{')) {
+      names[found * 2] = start;
+      names[found * 2 + 1] = end - start;
+      found++;
+    }
+  }
+
+  if (found)
+    return found;
+
+  // a function, the last name before the first ( that is code
+  int paren = -1;
+  for (i = 0; i < n; i++) {
+    if (hl[i] == HL_STRING || hl[i] == HL_COMMENT || hl[i] == HL_MLCOMMENT)
+      continue;
+    if (s[i] == '=' || s[i] == ';')
+      return 0; // a declaration, or an assignment
+    if (s[i] == '(') {
+      paren = i;
+      break;
+    }
+  }
+
+  if (paren <= 0)
+    return 0;
+
+  for (j = n - 1; j > paren; j--) { // a prototype ends with ;
+    if (!isspace((unsigned char)s[j]) && hl[j] != HL_COMMENT &&
+        hl[j] != HL_MLCOMMENT)
+      break;
+  }
+  if (s[j] == ';')
+    return 0;
+
+  for (j = paren; j > 0 && isspace((unsigned char)s[j - 1]); j--)
+    ;
+  for (i = j; i > 0 && is_ident((unsigned char)s[i - 1]); i--)
+    ;
+
+  if (i == j || hl[i] != HL_NORMAL || isdigit((unsigned char)s[i]))
+    return 0; // not a name, or a keyword like if
+
+  names[0] = i;
+  names[1] = j - i;
+  return 1;
+}
+
+// --- the open buffer ---
+
+int editorSymbolsFirst(int line) {
+  // the first index of byline with a definition at line or after it
+  int lo = 0, hi = E.symbols.n;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (E.symbols.byline[mid]->line < line)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void editorSymbolsRow(erow *row) {
+  // indexes the definitions of a row again, after it was highlighted
+  int names[16];
+  int found = editorSymbolsScan(row->render, row->rsize, row->hl, names, 8);
+
+  int first = editorSymbolsFirst(row->idx);
+  int last = first;
+  while (last < E.symbols.n && E.symbols.byline[last]->line == row->idx)
+    last++;
+
+  if (found == 0 && first == last)
+    return; // nearly every row, nothing was there and nothing is
+
+  int k;
+  if (found == last - first) { // maybe just the same ones
+    for (k = 0; k < found; k++) {
+      char *name = E.symbols.byline[first + k]->name;
+      if (strncmp(name, &row->render[names[2 * k]], names[2 * k + 1]) ||
+          name[names[2 * k + 1]] != '\0')
+        break;
+    }
+    if (k == found)
+      return;
+  }
+
+  for (k = first; k < last; k++)
+    symtabDel(&E.symbols.tab, E.symbols.byline[k]);
+
+  int n = E.symbols.n - (last - first) + found;
+  if (n > E.symbols.cap) {
+    E.symbols.cap = n > 2 * E.symbols.cap ? n : 2 * E.symbols.cap;
+    E.symbols.byline = realloc(E.symbols.byline,
+                               sizeof(struct editorSymbol *) * E.symbols.cap);
+  }
+
+  memmove(&E.symbols.byline[first + found], &E.symbols.byline[last],
+          sizeof(struct editorSymbol *) * (E.symbols.n - last));
+  E.symbols.n = n;
+
+  for (k = 0; k < found; k++)
+    E.symbols.byline[first + k] =
+        symtabAdd(&E.symbols.tab, &row->render[names[2 * k]],
+                  names[2 * k + 1], -1, row->idx);
+}
+
+void editorSymbolsMoved(int at, int removed, int added) {
+  // rows [at, at + removed) were deleted, or added rows were inserted at at,
+  // the definitions on deleted rows go away and the ones below move
+  int first = editorSymbolsFirst(at);
+  int last = first;
+  int k;
+
+  while (last < E.symbols.n && E.symbols.byline[last]->line < at + removed)
+    symtabDel(&E.symbols.tab, E.symbols.byline[last++]);
+
+  memmove(&E.symbols.byline[first], &E.symbols.byline[last],
+          sizeof(struct editorSymbol *) * (E.symbols.n - last));
+  E.symbols.n -= last - first;
+
+  for (k = first; k < E.symbols.n; k++)
+    E.symbols.byline[k]->line += added - removed;
+}
+
+// --- the sibling files ---
+
+int indexerScanFile(const char *path, struct editorSyntax *syntax, int file,
+                    struct editorSymbol ***syms) {
+  // lexes the file like the editor would highlight it, returns how many
+  // definitions were found, they aren't in any table yet
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return 0;
+
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t len;
+  unsigned char *hl = NULL;
+  size_t hlcap = 0;
+  int in_comment = 0;
+  int lineno = 0;
+  int n = 0, cap = 0;
+  int names[16];
+
+  *syms = NULL;
+
+  while ((len = getline(&line, &linecap, fp)) != -1) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      len--;
+
+    if ((size_t)len > hlcap) {
+      hlcap = len * 2;
+      hl = realloc(hl, hlcap);
+    }
+
+    in_comment = editorLexRow(syntax->lexer, line, len, hl, in_comment);
+
+    int found = editorSymbolsScan(line, len, hl, names, 8);
+    int k;
+    for (k = 0; k < found; k++) {
+      if (n == cap) {
+        cap = cap ? cap * 2 : 64;
+        *syms = realloc(*syms, sizeof(struct editorSymbol *) * cap);
+      }
+
+      // not in a table yet, only the chain pointer is missing
+      struct editorSymbol *sym = malloc(sizeof(struct editorSymbol));
+      sym->name = strndup(&line[names[2 * k]], names[2 * k + 1]);
+      sym->file = file;
+      sym->line = lineno;
+      (*syms)[n++] = sym;
+    }
+
+    lineno++;
+  }
+
+  free(line);
+  free(hl);
+  fclose(fp);
+  return n;
+}
+
+void indexerUpdateFile(int f, const char *path, time_t mtime) {
+  // indexes file f again, the old definitions are swapped for the new ones
+  // while holding the lock, the lexing itself happens without it
+  struct editorSymbol **syms;
+  int n = mtime ? indexerScanFile(path, indexer.syntax, f, &syms) : 0;
+  int k;
+
+  pthread_mutex_lock(&indexer.lock);
+
+  struct editorIndexedFile *file = &indexer.files[f];
+  for (k = 0; k < file->nsyms; k++)
+    symtabDel(&indexer.tab, file->syms[k]);
+  free(file->syms);
+
+  file->syms = NULL;
+  file->nsyms = 0;
+  file->mtime = mtime;
+
+  for (k = 0; k < n; k++) { // into the table, reusing the names
+    struct editorSymbol *sym = syms[k];
+    if (indexer.tab.count >= indexer.tab.nbuckets * 2)
+      symtabGrow(&indexer.tab);
+
+    unsigned int h =
+        symtabHash(sym->name, strlen(sym->name)) & (indexer.tab.nbuckets - 1);
+    sym->next = indexer.tab.bucket[h];
+    indexer.tab.bucket[h] = sym;
+    indexer.tab.count++;
+  }
+
+  if (n) {
+    file->syms = syms;
+    file->nsyms = n;
+  }
+
+  pthread_mutex_unlock(&indexer.lock);
+}
+
+void indexerPass() {
+  // looks at every file of the syntax in the directory, indexing the ones
+  // that are new or changed since the last pass, and forgetting the ones
+  // that are gone
+  DIR *dir = opendir(indexer.dir);
+  if (!dir)
+    return;
+
+  char *seen = calloc(indexer.nfiles + 1, 1);
+  int nseen = indexer.nfiles;
+  struct dirent *d;
+
+  while ((d = readdir(dir))) {
+    if (!editorSyntaxMatches(indexer.syntax, d->d_name))
+      continue;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", indexer.dir, d->d_name);
+
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+      continue;
+
+    int f;
+    for (f = 0; f < indexer.nfiles; f++) {
+      if (!strcmp(indexer.files[f].base, d->d_name))
+        break;
+    }
+
+    if (f == indexer.nfiles) { // a new file
+      pthread_mutex_lock(&indexer.lock);
+      indexer.files = realloc(indexer.files, sizeof(struct editorIndexedFile) *
+                                                 (indexer.nfiles + 1));
+      indexer.files[f].path = strdup(path);
+      indexer.files[f].base = strdup(d->d_name);
+      indexer.files[f].mtime = 0;
+      indexer.files[f].syms = NULL;
+      indexer.files[f].nsyms = 0;
+      indexer.nfiles++;
+      pthread_mutex_unlock(&indexer.lock);
+    }
+
+    if (f < nseen)
+      seen[f] = 1;
+
+    if (indexer.files[f].mtime != st.st_mtime)
+      indexerUpdateFile(f, path, st.st_mtime);
+  }
+
+  closedir(dir);
+
+  int f;
+  for (f = 0; f < nseen; f++) {
+    if (!seen[f] && indexer.files[f].mtime) // removed, or not a file anymore
+      indexerUpdateFile(f, indexer.files[f].path, 0);
+  }
+
+  free(seen);
+}
+
+void *indexerThread(void *arg) {
+  (void)arg;
+
+  while (1) { // the editor exits without stopping it
+    indexerPass();
+    sleep(2);
+  }
+
+  return NULL;
+}
+
+void editorSymbolsStart() {
+  // the open buffer is indexed from now on, as its rows are highlighted
+  E.symbols.enabled = 1;
+}
+
+void editorIndexerStart() {
+  // starts the background thread on the directory of the open file, there
+  // is nothing to index unless the file has a syntax
+  if (E.filename == NULL || E.syntax == NULL || indexer.running)
+    return;
+
+  char *slash = strrchr(E.filename, '/');
+  indexer.dir = slash ? strndup(E.filename, slash - E.filename == 0
+                                                ? 1
+                                                : slash - E.filename)
+                      : strdup(".");
+  indexer.syntax = E.syntax;
+
+  if (pthread_create(&indexer.thread, NULL, indexerThread, NULL) == 0) {
+    pthread_detach(indexer.thread);
+    indexer.running = 1;
+  }
+}
+
+// --- jumping ---
+
+void editorCloseFile() {
+  // empties the editor, like it was started without a file
+  editorLoadStop();
+  editorCursorsClear();
+  E.sel.mode = SEL_NONE;
+  editorDelRows(0, E.numrows);
+  editorUndoClear();
+  free(E.filename);
+  E.filename = NULL;
+  E.syntax = NULL;
+  E.load.codec = NULL;
+  E.grep.list = 0;
+  E.dirty = 0;
+  E.cx = E.cy = E.rowoff = E.coloff = 0;
+}
+
+char *editorWordAtCursor() {
+  // the identifier the cursor is on, or NULL
+  if (E.cy >= E.numrows)
+    return NULL;
+
+  erow *row = &E.row[E.cy];
+  int start = E.cx, end = E.cx;
+
+  while (start > 0 && is_ident((unsigned char)row->chars[start - 1]))
+    start--;
+  while (end < row->size && is_ident((unsigned char)row->chars[end]))
+    end++;
+
+  return end > start ? strndup(&row->chars[start], end - start) : NULL;
+}
+
+void editorJump() {
+  char *name =
+      editorPromptEx("Jump to definition of: %s (Enter: word at cursor)",
+                     NULL, 1);
+  if (name == NULL)
+    return;
+
+  if (name[0] == '\0') {
+    free(name);
+    name = editorWordAtCursor();
+    if (name == NULL)
+      return;
+  }
+
+  int len = strlen(name);
+  int line = -1;
+  char path[PATH_MAX];
+
+  struct editorSymbol *sym = symtabFind(&E.symbols.tab, name, len);
+  if (sym) {
+    line = sym->line;
+  } else {
+    // the open file itself is in there too, but it may have been edited
+    const char *base = E.filename ? strrchr(E.filename, '/') : NULL;
+    base = base ? base + 1 : E.filename;
+
+    pthread_mutex_lock(&indexer.lock);
+    for (sym = symtabFind(&indexer.tab, name, len); sym; sym = sym->next) {
+      if (strcmp(sym->name, name) ||
+          (base && !strcmp(indexer.files[sym->file].base, base)))
+        continue;
+
+      line = sym->line;
+      snprintf(path, sizeof(path), "%s", indexer.files[sym->file].path);
+      break;
+    }
+    pthread_mutex_unlock(&indexer.lock);
+
+    if (line == -1) {
+      editorSetStatusMessage("No definition of %s", name);
+      free(name);
+      return;
+    }
+
+    if (E.dirty) {
+      editorSetStatusMessage("%s is in %s, save first", name, path);
+      free(name);
+      return;
+    }
+
+    if (access(path, R_OK) == -1) {
+      editorSetStatusMessage("Can't open %s: %s", path, strerror(errno));
+      free(name);
+      return;
+    }
+
+    editorCloseFile();
+    editorOpen(path);
+  }
+
+  editorLoadTo(line); // the definition might not have been read yet
+
+  if (line >= E.numrows)
+    line = E.numrows > 0 ? E.numrows - 1 : 0;
+
+  E.cy = line;
+  E.cx = 0;
+  E.rowoff = line; // puts the definition at the top of the screen
+
+  free(name);
+}
+
+// --- COMPLETE ---
+
+void editorCompleteReset() {
+  // the next Ctrl-P starts over
+  int i;
+  for (i = 0; i < E.words.ncand; i++)
+    free(E.words.cand[i]);
+  E.words.ncand = 0;
+}
+
+void editorComplete() {
+  // completes the word before the cursor with a word of the buffer, pressing
+  // it again puts the next candidate in place of the last one
+  if (E.cy >= E.numrows)
+    return;
+
+  if (E.words.ncand) { // cycling, take back what the last one inserted
+    while (E.words.inserted-- > 0)
+      editorDelChar();
+    E.words.at = (E.words.at + 1) % E.words.ncand;
+  } else {
+    erow *row = &E.row[E.cy];
+    int start = E.cx;
+    while (start > 0 && is_ident((unsigned char)row->chars[start - 1]))
+      start--;
+
+    if (start == E.cx) {
+      editorSetStatusMessage("Nothing to complete");
+      return;
+    }
+
+    if (!E.words.cand)
+      E.words.cand = malloc(sizeof(char *) * KILO_COMPLETIONS);
+
+    E.words.ncand = editorWordsComplete(&row->chars[start], E.cx - start,
+                                        E.words.cand, KILO_COMPLETIONS);
+    E.words.at = 0;
+
+    if (E.words.ncand == 0) {
+      editorSetStatusMessage("No completion for %.*s", E.cx - start,
+                             &row->chars[start]);
+      return;
+    }
+  }
+
+  // the prefix is already there, only the rest of the word goes in
+  char *word = E.words.cand[E.words.at];
+  int plen = 0;
+  while (E.cx - plen > 0 &&
+         is_ident((unsigned char)E.row[E.cy].chars[E.cx - plen - 1]))
+    plen++;
+
+  char *rest = word + plen;
+  E.words.inserted = strlen(rest);
+  while (*rest)
+    editorInsertChar(*rest++);
+
+  editorSetStatusMessage("%s (%d of %d%s)", word, E.words.at + 1,
+                         E.words.ncand,
+                         E.words.ncand == KILO_COMPLETIONS ? "+" : "");
+}
+
+// --- REPLACE ---
+
+void editorReplaceAll(char *query, char *with) {
+  // replaces every occurrence in the document in one pass, each row that
+  // contains the query is rebuilt, rendered and highlighted once, and the
+  // whole change is a single undo unit
+  int qlen = strlen(query);
+  int wlen = strlen(with);
+  long total = 0;
+  int rows = 0;
+
+  editorUndoOpen();
+
+  int j;
+  for (j = 0; j < E.numrows; j++) {
+    erow *row = &E.row[j];
+    char *old;
+    int oldsize = row->size;
+
+    int n = editorRowReplace(row, query, qlen, with, wlen, &old);
+    if (n) {
+      editorUndoRecordOwned(j, old, oldsize); // no need to copy the old row
+      total += n;
+      rows++;
+    }
+  }
+
+  if (rows == 0) { // nothing changed, so there is nothing to undo either
+    editorUndoFreeUnit(&E.undo[--E.nundo]);
+    editorSetStatusMessage("No match for %s", query);
+    return;
+  }
+
+  if (E.cy < E.numrows && E.cx > E.row[E.cy].size)
+    E.cx = E.row[E.cy].size; // the cursor row might have become shorter
+
+  editorSetStatusMessage("Replaced %ld occurrences on %d lines (Ctrl-Z to "
+                         "undo)",
+                         total, rows);
+}
+
+void editorReplace() {
+  char *query = editorPrompt("Replace: %s (ESC to cancel)", NULL);
+  if (query == NULL)
+    return;
+
+  char *with = editorPromptEx("Replace with: %s (ESC to cancel)", NULL, 1);
+  if (with == NULL) {
+    free(query);
+    return;
+  }
+
+  editorReplaceAll(query, with);
+
+  free(query);
+  free(with);
+}
+
+// --- CURSORS ---
+// Ctrl-D puts a cursor at the end of every match of a text, typing, deleting
+// and moving then happen at all of them, the cursors are sorted, so the ones
+// in the same row are next to each other and every row is rebuilt, rendered
+// and highlighted once per key, no matter how many cursors it has
+
+void editorCursorsClear() {
+  E.cursors.n = 0;
+  if (E.undo_typing == -2)
+    E.undo_typing = -1; // the next edit starts a new undo unit
+}
+
+void editorCursorsPush(int cy, int cx) {
+  if (E.cursors.n == E.cursors.cap) {
+    E.cursors.cap = E.cursors.cap ? E.cursors.cap * 2 : 64;
+    E.cursors.at =
+        realloc(E.cursors.at, sizeof(struct editorCursor) * E.cursors.cap);
+  }
+
+  E.cursors.at[E.cursors.n].cy = cy;
+  E.cursors.at[E.cursors.n].cx = cx;
+  E.cursors.n++;
+}
+
+int editorCursorsFirst(int cy, int cx) {
+  // index of the first cursor at or after (cy, cx), a binary search
+  int lo = 0, hi = E.cursors.n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    struct editorCursor *c = &E.cursors.at[mid];
+    if (c->cy < cy || (c->cy == cy && c->cx < cx))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int editorCursorsNext(erow *row, int *i, int from) {
+  // render byte of the next cursor in row at or after byte from, starting the
+  // search at cursor *i, the one the terminal draws is skipped, -1 for none
+  while (*i < E.cursors.n && E.cursors.at[*i].cy == row->idx) {
+    struct editorCursor *c = &E.cursors.at[(*i)++];
+    if (c->cy == E.cy && c->cx == E.cx)
+      continue;
+
+    int b = editorRowColToByte(row, editorRowCxToRx(row, c->cx));
+    if (b >= from)
+      return b;
+  }
+  return -1;
+}
+
+void editorCursorsMerge() {
+  // cursors that ended up in the same place become one
+  int i, j = 0;
+  for (i = 0; i < E.cursors.n; i++) {
+    if (j > 0 && E.cursors.at[j - 1].cy == E.cursors.at[i].cy &&
+        E.cursors.at[j - 1].cx == E.cursors.at[i].cx)
+      continue;
+    E.cursors.at[j++] = E.cursors.at[i];
+  }
+  E.cursors.n = j;
+}
+
+void editorCursorsEdit(int key) {
+  // inserts the byte key at every cursor, or deletes the character before
+  // (BACKSPACE) or after (DEL_KEY) every cursor, the whole run of keys is a
+  // single undo unit as long as nothing else happens in between
+  int record = (E.undo_typing != -2 || E.nundo == 0);
+  if (record)
+    editorUndoOpen();
+
+  int p = editorCursorsFirst(E.cy, E.cx); // the one drawn by the terminal
+  char ch = key;
+  int i = 0;
+
+  while (i < E.cursors.n) {
+    int cy = E.cursors.at[i].cy;
+    int k = i; // cursors [i, k) are in this row
+    while (k < E.cursors.n && E.cursors.at[k].cy == cy)
+      k++;
+
+    erow *row = &E.row[cy];
+    char *chars = malloc(row->size + (k - i) + 1); // big enough for any key
+    int out = 0, from = 0, j;
+
+    // one pass over the row, copying the text between the cursors and
+    // doing the edit at each of them, the cursors move with the text
+    for (j = i; j < k; j++) {
+      struct editorCursor *c = &E.cursors.at[j];
+      int at = c->cx, len = 0;
+
+      if (key == BACKSPACE && at > from) {
+        len = 1;
+        while (at - len > from && editorIsContinuation(row->chars[at - len]))
+          len++;
+        at -= len;
+      } else if (key == DEL_KEY && at < row->size) {
+        len = 1;
+        while (at + len < row->size &&
+               editorIsContinuation(row->chars[at + len]))
+          len++;
+      }
+
+      memcpy(&chars[out], &row->chars[from], at - from);
+      out += at - from;
+      c->cx = out;
+
+      if (key != BACKSPACE && key != DEL_KEY) {
+        chars[out++] = ch;
+        c->cx = out;
+      }
+      from = at + len;
+    }
+
+    memcpy(&chars[out], &row->chars[from], row->size - from);
+    out += row->size - from;
+    chars[out] = '\0';
+
+    if (record) // the old buffer is what undo puts back
+      editorUndoRecordOwned(cy, row->chars, row->size);
+    else
+      free(row->chars);
+
+    row->chars = chars;
+    row->size = out;
+    editorUpdateRow(row);
+
+    i = k;
+  }
+
+  E.dirty++;
+  E.undo_typing = -2;
+
+  E.cx = E.cursors.at[p].cx;
+  E.cy = E.cursors.at[p].cy;
+  editorCursorsMerge();
+}
+
+void editorCursorsMove(int key) {
+  // moves every cursor within its row
+  int p = editorCursorsFirst(E.cy, E.cx); // the one drawn by the terminal
+  int i;
+  for (i = 0; i < E.cursors.n; i++) {
+    struct editorCursor *c = &E.cursors.at[i];
+    erow *row = &E.row[c->cy];
+
+    if (key == HOME_KEY) {
+      c->cx = 0;
+    } else if (key == END_KEY) {
+      c->cx = row->size;
+    } else if (key == ARROW_LEFT && c->cx > 0) {
+      c->cx--;
+      while (c->cx > 0 && editorIsContinuation(row->chars[c->cx]))
+        c->cx--;
+    } else if (key == ARROW_RIGHT && c->cx < row->size) {
+      c->cx++;
+      while (c->cx < row->size && editorIsContinuation(row->chars[c->cx]))
+        c->cx++;
+    }
+  }
+
+  E.cx = E.cursors.at[p].cx;
+  editorCursorsMerge();
+}
+
+int editorCursorsKey(int c) {
+  // handles a key while there is more than one cursor, returns 0 for the
+  // keys that only make sense with one, the extra cursors are gone then
+  switch (c) {
+  case BACKSPACE:
+  case CTRL_KEY('h'):
+    editorCursorsEdit(BACKSPACE);
+    break;
+
+  case DEL_KEY:
+    editorCursorsEdit(DEL_KEY);
+    break;
+
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+  case HOME_KEY:
+  case END_KEY:
+    editorCursorsMove(c);
+    break;
+
+  case '\x1b':
+    editorCursorsClear();
+    editorSetStatusMessage("");
+    break;
+
+  default:
+    if (c == '\t' || ((c >= 32 || c < 0) && c < ARROW_LEFT)) {
+      editorCursorsEdit(c); // a byte that is typed into the text
+      break;
+    }
+
+    editorCursorsClear();
+    return 0;
+  }
+
+  if (E.cursors.n == 1)
+    editorCursorsClear(); // merged into a single one again
+
+  return 1;
+}
+
+void editorCursorsAdd() {
+  // puts a cursor at the end of every match, the first one after the cursor
+  // becomes the one the terminal draws
+  char *query = editorPrompt("Cursors at: %s (ESC to cancel)", NULL);
+  if (query == NULL)
+    return;
+
+  int qlen = strlen(query);
+  editorCursorsClear();
+
+  int j;
+  for (j = 0; j < E.numrows; j++) {
+    erow *row = &E.row[j];
+    char *p = row->chars;
+    char *end = row->chars + row->size;
+    char *m;
+
+    while ((m = memmem(p, end - p, query, qlen))) {
+      p = m + qlen;
+      editorCursorsPush(j, p - row->chars);
+    }
+  }
+
+  if (E.cursors.n == 0) {
+    editorSetStatusMessage("No match for %s", query);
+  } else {
+    int p = editorCursorsFirst(E.cy, E.cx);
+    if (p == E.cursors.n)
+      p = 0; // none after the cursor, wrap around
+
+    E.cy = E.cursors.at[p].cy;
+    E.cx = E.cursors.at[p].cx;
+
+    editorSetStatusMessage("%d cursors (ESC to drop them)", E.cursors.n);
+    if (E.cursors.n == 1)
+      editorCursorsClear(); // a single match is just a cursor
+  }
+
+  free(query);
+}
+
+// --- SELECTION ---
+// Ctrl-B sets the mark at the cursor, the text between the mark and the
+// cursor is selected, pressing it again selects whole lines, then a block of
+// columns, then nothing, Ctrl-C copies, Ctrl-X cuts and Ctrl-V pastes, a
+// range is removed or inserted with one editorDelRows or editorInsertRows,
+// so cutting 100,000 lines moves the rows below them once, not 100,000 times
+
+void editorYankFree() {
+  free(E.yank.text);
+  free(E.yank.off);
+  E.yank.text = NULL;
+  E.yank.off = NULL;
+  E.yank.n = 0;
+}
+
+int editorSelectionRange(int *sy, int *sx, int *ey, int *ex) {
+  // the selected rows, for SEL_CHARS also from where in the first to where
+  // in the last, for SEL_BLOCK the columns, returns 0 if nothing is selected
+  if (!E.sel.mode || E.numrows == 0)
+    return 0;
+
+  int my = E.sel.my, mx = E.sel.mx;
+  int py = E.cy, px = E.cx;
+
+  if (my >= E.numrows) { // past the end, that is the end of the last row
+    my = E.numrows - 1;
+    mx = E.row[my].size;
+  }
+  if (py >= E.numrows) {
+    py = E.numrows - 1;
+    px = E.row[py].size;
+  }
+  if (mx > E.row[my].size)
+    mx = E.row[my].size;
+
+  if (E.sel.mode == SEL_BLOCK) {
+    int mc = editorRowCxToRx(&E.row[my], mx);
+    int pc = editorRowCxToRx(&E.row[py], px);
+    *sy = my < py ? my : py;
+    *ey = my < py ? py : my;
+    *sx = mc < pc ? mc : pc;
+    *ex = mc < pc ? pc : mc;
+  } else if (my < py || (my == py && mx <= px)) {
+    *sy = my, *sx = mx, *ey = py, *ex = px;
+  } else {
+    *sy = py, *sx = px, *ey = my, *ex = mx;
+  }
+
+  if (E.sel.mode == SEL_LINES) {
+    *sx = 0;
+    *ex = E.row[*ey].size;
+  }
+
+  return 1;
+}
+
+void editorSelectionBytes(int y, int sy, int sx, int ey, int ex, int *a,
+                          int *b) {
+  // the selected bytes [a, b) of row y, which is one of the selected ones
+  erow *row = &E.row[y];
+
+  if (E.sel.mode == SEL_BLOCK) {
+    *a = editorRowRxToCx(row, sx);
+    *b = editorRowRxToCx(row, ex);
+  } else {
+    *a = y == sy ? sx : 0;
+    *b = y == ey ? ex : row->size;
+  }
+}
+
+int editorSelectionDrawn(erow *row, int *a, int *b) {
+  // the selected bytes of render, for drawing row, b is past the end when
+  // the newline is selected too, returns 0 if there are none
+  int sy, sx, ey, ex;
+  if (!editorSelectionRange(&sy, &sx, &ey, &ex) || row->idx < sy ||
+      row->idx > ey)
+    return 0;
+
+  editorSelectionBytes(row->idx, sy, sx, ey, ex, a, b);
+  *a = editorRowColToByte(row, editorRowCxToRx(row, *a));
+  *b = editorRowColToByte(row, editorRowCxToRx(row, *b));
+
+  if (E.sel.mode == SEL_LINES || (E.sel.mode == SEL_CHARS && row->idx < ey))
+    *b = row->rsize + 1;
+  return 1;
+}
+
+void editorSelectionCopy() {
+  // copies the selection into the yank, all of it into a single buffer
+  int sy, sx, ey, ex;
+  if (!editorSelectionRange(&sy, &sx, &ey, &ex))
+    return;
+
+  editorYankFree();
+  E.yank.mode = E.sel.mode;
+  E.yank.n = ey - sy + 1;
+  E.yank.off = malloc(sizeof(int) * (E.yank.n + 1));
+
+  int y, a, b, total = 0;
+  for (y = sy; y <= ey; y++) {
+    editorSelectionBytes(y, sy, sx, ey, ex, &a, &b);
+    total += b - a;
+  }
+
+  E.yank.text = malloc(total + 1);
+  total = 0;
+
+  for (y = sy; y <= ey; y++) {
+    editorSelectionBytes(y, sy, sx, ey, ex, &a, &b);
+    E.yank.off[y - sy] = total;
+    memcpy(&E.yank.text[total], &E.row[y].chars[a], b - a);
+    total += b - a;
+  }
+  E.yank.off[E.yank.n] = total;
+}
+
+undoSpan *editorUndoTake(int at, int nold, int nnew) {
+  // like editorUndoRecord, but the rows' buffers are moved to the undo unit
+  // instead of copied, the caller gives the rows new ones or deletes them
+  undoSpan *span = editorUndoSpan(at, nold, nnew);
+
+  int k;
+  for (k = 0; k < nold; k++) {
+    erow *row = &E.row[at + k];
+    span->old[k].chars = row->chars;
+    span->old[k].size = row->size;
+    row->chars = NULL;
+  }
+
+  return span;
+}
+
+void editorRowSet(erow *row, char *chars, int size) {
+  // gives row a new buffer, rendered and highlighted once
+  free(row->chars);
+  row->chars = chars;
+  row->size = size;
+  editorUpdateRow(row);
+  E.dirty++;
+}
+
+void editorSelectionDelete() {
+  // removes the selection in one undo unit, the removed text is kept by the
+  // undo unit as it was, not copied
+  int sy, sx, ey, ex;
+  if (!editorSelectionRange(&sy, &sx, &ey, &ex))
+    return;
+
+  int n = ey - sy + 1, k;
+  editorUndoOpen();
+
+  if (E.sel.mode == SEL_LINES) {
+    editorUndoTake(sy, n, 0);
+    editorDelRows(sy, n);
+    E.cx = 0;
+  } else if (E.sel.mode == SEL_CHARS) {
+    // what is before the selection in the first row and after it in the last
+    // are joined into one row, the rows in between go all at once
+    undoSpan *span = editorUndoTake(sy, n, 1);
+    erow *first = &span->old[0], *last = &span->old[n - 1];
+
+    char *chars = malloc(sx + last->size - ex + 1);
+    memcpy(chars, first->chars, sx);
+    memcpy(&chars[sx], &last->chars[ex], last->size - ex);
+    chars[sx + last->size - ex] = '\0';
+
+    editorDelRows(sy + 1, n - 1);
+    editorRowSet(&E.row[sy], chars, sx + last->size - ex);
+    E.cx = sx;
+  } else {
+    int *cut = malloc(sizeof(int) * 2 * n); // where the columns are in bytes
+    for (k = 0; k < n; k++)
+      editorSelectionBytes(sy + k, sy, sx, ey, ex, &cut[2 * k],
+                           &cut[2 * k + 1]);
+
+    undoSpan *span = editorUndoTake(sy, n, n);
+    for (k = 0; k < n; k++) {
+      erow *old = &span->old[k];
+      int a = cut[2 * k], b = cut[2 * k + 1];
+
+      char *chars = malloc(old->size - (b - a) + 1);
+      memcpy(chars, old->chars, a);
+      memcpy(&chars[a], &old->chars[b], old->size - b + 1);
+      editorRowSet(&E.row[sy + k], chars, old->size - (b - a));
+    }
+
+    E.cx = cut[0];
+    free(cut);
+  }
+
+  E.cy = sy;
+  if (E.cy < E.numrows && E.cx > E.row[E.cy].size)
+    E.cx = E.row[E.cy].size;
+}
+
+void editorPaste() {
+  // inserts the yank at the cursor, lines go above the cursor row, a block
+  // goes into the rows from the cursor down, at the cursor's column
+  if (E.yank.n == 0) {
+    editorSetStatusMessage("Nothing to paste");
+    return;
+  }
+
+  int n = E.yank.n, k;
+  char *text = E.yank.text;
+  int *off = E.yank.off;
+
+  editorUndoOpen();
+
+  if (E.yank.mode == SEL_LINES) {
+    char **lines = malloc(sizeof(char *) * n);
+    int *sizes = malloc(sizeof(int) * n);
+    for (k = 0; k < n; k++) {
+      lines[k] = &text[off[k]];
+      sizes[k] = off[k + 1] - off[k];
+    }
+
+    editorUndoRecord(E.cy, 0, n);
+    editorInsertRows(E.cy, lines, sizes, n);
+    E.cx = 0;
+
+    free(lines);
+    free(sizes);
+    return;
+  }
+
+  if (E.cy == E.numrows) { // same as typing there, a row is added first
+    editorUndoRecord(E.numrows, 0, 1);
+    editorInsertRow(E.numrows, "", 0);
+  }
+
+  if (E.yank.mode == SEL_CHARS) {
+    // the cursor row is split around the pasted text, its first line goes
+    // at the end of the first part and its last line before the second part
+    undoSpan *span = editorUndoTake(E.cy, 1, n);
+    erow *old = &span->old[0];
+    int cx = E.cx;
+    int first = off[1] - off[0];
+    int last = off[n] - off[n - 1];
+
+    if (n == 1) {
+      char *chars = malloc(old->size + first + 1);
+      memcpy(chars, old->chars, cx);
+      memcpy(&chars[cx], text, first);
+      memcpy(&chars[cx + first], &old->chars[cx], old->size - cx + 1);
+      editorRowSet(&E.row[E.cy], chars, old->size + first);
+      E.cx += first;
+      return;
+    }
+
+    char **lines = malloc(sizeof(char *) * (n - 1));
+    int *sizes = malloc(sizeof(int) * (n - 1));
+    for (k = 1; k < n - 1; k++) {
+      lines[k - 1] = &text[off[k]];
+      sizes[k - 1] = off[k + 1] - off[k];
+    }
+
+    char *tail = malloc(last + old->size - cx + 1);
+    memcpy(tail, &text[off[n - 1]], last);
+    memcpy(&tail[last], &old->chars[cx], old->size - cx);
+    lines[n - 2] = tail;
+    sizes[n - 2] = last + old->size - cx;
+
+    char *head = malloc(cx + first + 1);
+    memcpy(head, old->chars, cx);
+    memcpy(&head[cx], text, first);
+    head[cx + first] = '\0';
+
+    editorInsertRows(E.cy + 1, lines, sizes, n - 1);
+    editorRowSet(&E.row[E.cy], head, cx + first);
+
+    free(tail);
+    free(lines);
+    free(sizes);
+
+    E.cy += n - 1;
+    E.cx = last;
+    return;
+  }
+
+  // a block, rows that are too short are filled up with spaces up to the
+  // column, and rows are added at the end if the block needs more of them
+  int col = editorRowCxToRx(&E.row[E.cy], E.cx);
+  int have = E.numrows - E.cy < n ? E.numrows - E.cy : n;
+  int *at = malloc(sizeof(int) * 2 * have); // byte and padding of each row
+  for (k = 0; k < have; k++) {
+    erow *row = &E.row[E.cy + k];
+    at[2 * k] = editorRowRxToCx(row, col);
+    at[2 * k + 1] = 0;
+    if (at[2 * k] == row->size && row->rcols < col) // ends before the column
+      at[2 * k + 1] = col - row->rcols;
+  }
+
+  undoSpan *span = editorUndoTake(E.cy, have, have);
+  for (k = 0; k < have; k++) {
+    erow *old = &span->old[k];
+    int len = off[k + 1] - off[k];
+    int b = at[2 * k], pad = at[2 * k + 1];
+
+    char *chars = malloc(old->size + pad + len + 1);
+    memcpy(chars, old->chars, b);
+    memset(&chars[b], ' ', pad);
+    memcpy(&chars[b + pad], &text[off[k]], len);
+    memcpy(&chars[b + pad + len], &old->chars[b], old->size - b + 1);
+    editorRowSet(&E.row[E.cy + k], chars, old->size + pad + len);
+  }
+  free(at);
+
+  if (have < n) {
+    editorUndoRecord(E.numrows, 0, n - have);
+    for (k = have; k < n; k++) { // padded to the column too
+      int len = off[k + 1] - off[k];
+      char *chars = malloc(col + len + 1);
+      memset(chars, ' ', col);
+      memcpy(&chars[col], &text[off[k]], len);
+      editorInsertRow(E.numrows, chars, col + len);
+      free(chars);
+    }
+  }
+}
+
+void editorMark() {
+  // sets the mark, or switches to the next kind of selection
+  static const char *names[] = {"", "text", "lines", "block"};
+
+  if (E.sel.mode == SEL_NONE) {
+    E.sel.my = E.cy;
+    E.sel.mx = E.cx;
+  }
+
+  E.sel.mode = (E.sel.mode + 1) % (SEL_BLOCK + 1);
+
+  if (E.sel.mode == SEL_NONE)
+    editorSetStatusMessage("Mark cleared");
+  else
+    editorSetStatusMessage("Selecting %s (Ctrl-C copy | Ctrl-X cut | Ctrl-B "
+                           "for %s)",
+                           names[E.sel.mode],
+                           E.sel.mode == SEL_BLOCK ? "none"
+                                                   : names[E.sel.mode + 1]);
+}
+
+void editorSelectionKey(int c) {
+  // Ctrl-C, Ctrl-X and Ctrl-V
+  int sy, sx, ey, ex;
+  int selected = editorSelectionRange(&sy, &sx, &ey, &ex);
+
+  if (c == CTRL_KEY('v')) {
+    if (selected) // a paste over a selection replaces it
+      editorSelectionDelete();
+    editorPaste();
+  } else if (!selected) {
+    editorSetStatusMessage("Nothing selected, Ctrl-B sets the mark");
+    return;
+  } else {
+    editorSelectionCopy();
+    if (c == CTRL_KEY('x'))
+      editorSelectionDelete();
+    editorSetStatusMessage("%s %d line%s", c == CTRL_KEY('x') ? "Cut" : "Copied",
+                           E.yank.n, E.yank.n == 1 ? "" : "s");
+  }
+
+  E.sel.mode = SEL_NONE;
+}
+
+// --- FILTER ---
+// Ctrl-E pipes the selected lines, or the whole file, through a shell
+// command and puts what it prints in their place, like ! in vi, the rows are
+// written straight from their buffers while the output is read at the same
+// time, so neither side can get stuck on a full pipe, every line of the
+// output is made into the buffer its row gets, and the old rows go to the
+// undo unit as they are, so nothing is ever copied twice
+
+struct editorFilterOut { // what the command printed so far
+  char **lines; // buffers for the rows, taken over by editorInsertRowsEx
+  int *sizes;
+  int n;
+  int cap;
+  char *part; // the start of a line whose end hasn't been read yet
+  int partlen;
+};
+
+void editorFilterLine(struct editorFilterOut *out, const char *s, int len,
+                      int end) {
+  // adds s to the line being read, end is 1 if the line is complete now
+  if (!end || out->part) { // a line that goes on in the next read
+    out->part = realloc(out->part, out->partlen + len + 1);
+    memcpy(out->part + out->partlen, s, len);
+    out->partlen += len;
+    if (!end)
+      return;
+  }
+
+  if (out->n == out->cap) {
+    out->cap = out->cap ? out->cap * 2 : 1024;
+    out->lines = realloc(out->lines, sizeof(char *) * out->cap);
+    out->sizes = realloc(out->sizes, sizeof(int) * out->cap);
+  }
+
+  char *line = out->part;
+  if (line) {
+    len = out->partlen;
+    out->part = NULL;
+    out->partlen = 0;
+  } else {
+    line = malloc(len + 1);
+    memcpy(line, s, len);
+  }
+
+  if (len > 0 && line[len - 1] == '\r')
+    len--; // same as editorOpen, strip the \r of \r\n line endings
+  out->lines[out->n] = line;
+  out->sizes[out->n++] = len;
+}
+
+int editorFilterWrite(int fd, int *at, int *off, int end) {
+  // writes as much of rows [*at, end) as the pipe takes, each with its
+  // newline, *off bytes of row *at are written already, returns -1 if the
+  // command doesn't read anymore
+  struct iovec iov[KILO_IOV_BATCH];
+  int cnt = 0, j;
+
+  for (j = *at; j < end && cnt < KILO_IOV_BATCH; j++) {
+    int skip = j == *at ? *off : 0; // the newline is byte size of the row
+    if (skip < E.row[j].size) {
+      iov[cnt].iov_base = E.row[j].chars + skip;
+      iov[cnt++].iov_len = E.row[j].size - skip;
+    }
+    iov[cnt].iov_base = "\n";
+    iov[cnt++].iov_len = 1;
+  }
+
+  ssize_t n = writev(fd, iov, cnt);
+  if (n == -1)
+    return errno == EINTR || errno == EAGAIN ? 0 : -1;
+
+  while (n > 0) { // moves past what was written
+    int left = E.row[*at].size + 1 - *off;
+    if (n < left) {
+      *off += n;
+      break;
+    }
+    n -= left;
+    (*at)++;
+    *off = 0;
+  }
+  return 0;
+}
+
+int editorFilter(char *command, int first, int n) {
+  // replaces rows [first, first + n) with what command prints when they are
+  // its input, in one undo unit, returns 0 if it failed or was cancelled,
+  // Esc kills the command, the buffer stays as it was then
+  int in[2], out[2];
+  if (pipe2(in, O_CLOEXEC) == -1)
+    return 0;
+  if (pipe2(out, O_CLOEXEC) == -1) {
+    close(in[0]);
+    close(in[1]);
+    return 0;
+  }
+
+  char *argv[] = {"/bin/sh", "-c", command, NULL};
+  pid_t pid = editorSpawn(argv, in[0], out[1]);
+  close(in[0]);
+  close(out[1]);
+  if (pid == -1) {
+    close(in[1]);
+    close(out[0]);
+    return 0;
+  }
+
+  // a command that exits before it read everything makes the writes fail
+  // with EPIPE, SIGPIPE is ignored by main
+  fcntl(in[1], F_SETFL, O_NONBLOCK);
+
+  struct editorFilterOut res;
+  memset(&res, 0, sizeof(res));
+  char buf[KILO_FOLLOW_CHUNK];
+  int at = first, off = 0, end = first + n;
+  int cancelled = 0;
+
+  if (at == end) { // nothing to give it, like vi's :r !command
+    close(in[1]);
+    in[1] = -1;
+  }
+
+  while (out[0] != -1 && !cancelled) {
+    struct pollfd pfd[3] = {{out[0], POLLIN, 0},
+                            {in[1], POLLOUT, 0},
+                            {editorCancelFd(), POLLIN, 0}};
+
+    if (poll(pfd, 3, editorCancelTimeout()) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (pfd[1].revents & (POLLOUT | POLLERR | POLLHUP)) {
+      if (editorFilterWrite(in[1], &at, &off, end) == -1 || at == end) {
+        close(in[1]); // the end of its input
+        in[1] = -1;
+      }
+    }
+
+    if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t got = read(out[0], buf, sizeof(buf));
+      if (got == -1 && errno == EINTR)
+        continue;
+      if (got <= 0) {
+        close(out[0]);
+        out[0] = -1;
+        break;
+      }
+
+      char *p = buf, *last = buf + got, *nl;
+      while ((nl = memchr(p, '\n', last - p))) {
+        editorFilterLine(&res, p, nl - p, 1);
+        p = nl + 1;
+      }
+      if (p < last)
+        editorFilterLine(&res, p, last - p, 0);
+    }
+
+    if (editorCancelled(pfd[2].revents))
+      cancelled = 1; // other keys are dropped until it is done
+  }
+
+  if (in[1] != -1)
+    close(in[1]);
+  if (out[0] != -1)
+    close(out[0]);
+  if (cancelled)
+    kill(pid, SIGTERM);
+
+  int status;
+  int ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0 && !cancelled;
+
+  if (res.part) // the last line had no newline
+    editorFilterLine(&res, "", 0, 1);
+
+  if (ok) {
+    editorUndoOpen();
+    editorUndoTake(first, n, res.n);
+    editorDelRows(first, n);
+    editorInsertRowsEx(first, res.lines, res.sizes, res.n, 1);
+    if (n > 0 && res.n == 0)
+      E.dirty++; // only rows were deleted
+    editorSetStatusMessage("%d lines filtered into %d", n, res.n);
+  } else {
+    int k;
+    for (k = 0; k < res.n; k++)
+      free(res.lines[k]);
+    if (cancelled)
+      editorSetStatusMessage("Filter cancelled");
+    else if (WIFEXITED(status))
+      editorSetStatusMessage("Filter failed, %s exited with %d", command,
+                             WEXITSTATUS(status));
+    else
+      editorSetStatusMessage("Filter failed, %s was killed", command);
+  }
+
+  free(res.lines);
+  free(res.sizes);
+  return ok;
+}
+
+void editorFilterPrompt() {
+  // Ctrl-E, asks for the command, the lines of the selection are filtered,
+  // or the whole file if nothing is selected
+  int sy, sx, ey, ex;
+  int first = 0, n;
+
+  editorLoadFinish(); // the whole file has to be there
+
+  if (editorSelectionRange(&sy, &sx, &ey, &ex)) {
+    first = sy;
+    n = ey - sy + 1;
+  } else {
+    n = E.numrows;
+  }
+
+  char *command = editorPrompt("Filter through: %s (ESC to cancel)", NULL);
+  if (command == NULL)
+    return;
+
+  editorSetStatusMessage("Filtering through %s (ESC to cancel)", command);
+  editorRefreshScreen();
+
+  if (editorFilter(command, first, n)) {
+    E.cy = first;
+    E.cx = 0;
+  }
+  free(command);
+}
+
+// --- GREP ---
+// Ctrl-A searches every file under the current directory and lists the lines
+// that have the query in a buffer of their own, Enter on one of them opens
+// its file there, the walk is done by a thread per core, each with a deque of
+// the directories and files still to look at, it takes from the end of its
+// own and steals from the front of the others when it runs dry, or sleeps
+// until there is something to steal, so one big directory is soon spread
+// over all of them, the files are mmapped and
+// searched with the matcher Ctrl-F uses, and the results are handed to the
+// main thread as they come, which puts them in the buffer between keys
+
+struct grepDeque { // the paths still to look at of one thread of the search
+  char **paths;
+  int head; // the others steal paths[head], the owner takes paths[n - 1]
+  int n;
+  int cap;
+  pthread_mutex_t lock;
+};
+
+struct grepJob { // what the threads of a search share
+  const char *query;
+  int qlen;
+  struct grepDeque *deques;
+  int nthreads;
+  pthread_mutex_t lock;
+  pthread_cond_t more; // signalled when a path is pushed or the search ends
+  int stop;    // set on Esc, the threads drop the paths they have left
+  int pending; // paths pushed and not done yet, the search is over at 0
+  int queued;  // paths in the deques, that no thread has taken yet
+  int running; // threads that haven't returned yet
+  char *out;   // result lines the main thread hasn't taken yet
+  size_t outlen, outcap;
+  long files, matches;
+  int wake[2]; // written to when there are results or a thread returned
+};
+
+struct grepThread {
+  struct grepJob *job;
+  int id;
+};
+
+void grepPush(struct grepJob *job, int id, char *path) {
+  // adds path to the deque of thread id, taking it over
+  struct grepDeque *d = &job->deques[id];
+
+  pthread_mutex_lock(&d->lock);
+  if (d->head > 0 && d->n == d->cap) { // room stolen from the front
+    memmove(d->paths, d->paths + d->head, sizeof(char *) * (d->n - d->head));
+    d->n -= d->head;
+    d->head = 0;
+  }
+  if (d->n == d->cap) {
+    d->cap = d->cap ? d->cap * 2 : 64;
+    d->paths = realloc(d->paths, sizeof(char *) * d->cap);
+  }
+  d->paths[d->n++] = path;
+  pthread_mutex_unlock(&d->lock);
+
+  // the path being looked at by whoever pushed this one is still pending, so
+  // pending can't have been 0 in the meantime
+  pthread_mutex_lock(&job->lock);
+  job->pending++;
+  job->queued++;
+  pthread_cond_signal(&job->more); // wakes one idle thread to steal it
+  pthread_mutex_unlock(&job->lock);
+}
+
+int grepStopped(struct grepJob *job) {
+  pthread_mutex_lock(&job->lock);
+  int stop = job->stop;
+  pthread_mutex_unlock(&job->lock);
+  return stop;
+}
+
+char *grepTake(struct grepJob *job, int id) {
+  // the next path for thread id, the last one it pushed, else one stolen
+  // from the front of another deque, where the directories near the top of
+  // the tree are, NULL if all of them are empty
+  int k;
+  for (k = 0; k < job->nthreads; k++) {
+    struct grepDeque *d = &job->deques[(id + k) % job->nthreads];
+    char *path = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->n > d->head)
+      path = k == 0 ? d->paths[--d->n] : d->paths[d->head++];
+    if (d->n == d->head)
+      d->n = d->head = 0;
+    pthread_mutex_unlock(&d->lock);
+
+    if (path) {
+      pthread_mutex_lock(&job->lock);
+      job->queued--;
+      pthread_mutex_unlock(&job->lock);
+      return path;
+    }
+  }
+  return NULL;
+}
+
+void grepAppend(char **buf, size_t *len, size_t *cap, const char *s,
+                size_t n) {
+  if (*len + n > *cap) {
+    *cap = (*len + n) * 2;
+    *buf = realloc(*buf, *cap);
+  }
+  memcpy(*buf + *len, s, n);
+  *len += n;
+}
+
+void grepFile(struct grepJob *job, const char *path) {
+  // adds a "path:line: text" result for every line of the file with a match
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+
+  const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return;
+
+  size_t size = st.st_size;
+  const char *end = map + size;
+
+  // a NUL near the start is taken to mean a binary, like grep -I
+  if (memchr(map, '\0', size < 4096 ? size : 4096)) {
+    munmap((void *)map, size);
+    return;
+  }
+  madvise((void *)map, size, MADV_SEQUENTIAL);
+
+  char *out = NULL;
+  size_t outlen = 0, outcap = 0;
+  long matches = 0;
+  long line = 1;
+  const char *counted = map; // line is the line of this byte
+  const char *p = map, *m;
+
+  while (p < end && (m = editorSearchMem(p, end - p, job->query, job->qlen))) {
+    const char *nl;
+    while ((nl = memchr(counted, '\n', m - counted))) {
+      line++;
+      counted = nl + 1;
+    }
+
+    const char *start = counted;
+    const char *stop = memchr(m, '\n', end - m);
+    if (stop == NULL)
+      stop = end;
+
+    int textlen = stop - start;
+    if (textlen > KILO_GREP_TEXT)
+      textlen = KILO_GREP_TEXT;
+    if (textlen > 0 && start[textlen - 1] == '\r')
+      textlen--;
+
+    char num[32];
+    int numlen = snprintf(num, sizeof(num), ":%ld: ", line);
+    grepAppend(&out, &outlen, &outcap, path, strlen(path));
+    grepAppend(&out, &outlen, &outcap, num, numlen);
+    grepAppend(&out, &outlen, &outcap, start, textlen);
+    grepAppend(&out, &outlen, &outcap, "\n", 1);
+    matches++;
+
+    p = stop; // the next match is on a later line, if any
+  }
+  munmap((void *)map, size);
+
+  pthread_mutex_lock(&job->lock);
+  job->files++;
+  if (outlen) {
+    grepAppend(&job->out, &job->outlen, &job->outcap, out, outlen);
+    job->matches += matches;
+  }
+  pthread_mutex_unlock(&job->lock);
+
+  if (outlen && write(job->wake[1], "", 1) == -1) {
+    // a full pipe is already waking the main thread
+  }
+  free(out);
+}
+
+void grepDir(struct grepJob *job, int id, const char *path) {
+  // pushes what is in the directory, hidden entries and links are skipped,
+  // so .git and the like aren't searched and a link can't make a loop
+  DIR *dir = opendir(path);
+  if (dir == NULL)
+    return;
+
+  struct dirent *ent;
+  while ((ent = readdir(dir)) && !grepStopped(job)) {
+    if (ent->d_name[0] == '.')
+      continue;
+
+    char *child;
+    if (!strcmp(path, "."))
+      child = strdup(ent->d_name); // results are listed without ./
+    else if (asprintf(&child, "%s/%s", path, ent->d_name) == -1)
+      continue;
+
+    unsigned char type = ent->d_type;
+    if (type == DT_UNKNOWN) { // the filesystem doesn't say
+      struct stat st;
+      type = lstat(child, &st) == -1 ? DT_UNKNOWN
+             : S_ISDIR(st.st_mode)   ? DT_DIR
+             : S_ISREG(st.st_mode)   ? DT_REG
+                                     : DT_UNKNOWN;
+    }
+
+    if (type == DT_DIR || type == DT_REG)
+      grepPush(job, id, child);
+    else
+      free(child);
+  }
+  closedir(dir);
+}
+
+void *grepWorker(void *arg) {
+  struct grepThread *t = arg;
+  struct grepJob *job = t->job;
+
+  while (1) {
+    char *path = grepTake(job, t->id);
+
+    if (path == NULL) {
+      // another thread may push more from what it is on, this one sleeps
+      // until it does, or until the search is over
+      pthread_mutex_lock(&job->lock);
+      while (job->queued == 0 && job->pending > 0 && !job->stop)
+        pthread_cond_wait(&job->more, &job->lock);
+      int done = job->pending == 0 || job->stop;
+      pthread_mutex_unlock(&job->lock);
+      if (done)
+        break;
+      continue;
+    }
+
+    if (!grepStopped(job)) {
+      struct stat st;
+      if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        grepDir(job, t->id, path);
+      else
+        grepFile(job, path);
+    }
+    free(path);
+
+    pthread_mutex_lock(&job->lock);
+    if (--job->pending == 0)
+      pthread_cond_broadcast(&job->more); // the others can return now
+    pthread_mutex_unlock(&job->lock);
+  }
+
+  pthread_mutex_lock(&job->lock);
+  job->running--;
+  pthread_mutex_unlock(&job->lock);
+  if (write(job->wake[1], "", 1) == -1) {
+    // as in grepFile
+  }
+  return NULL;
+}
+
+int grepResults(struct grepJob *job) {
+  // moves the results found so far to the end of the buffer, returns 1 when
+  // every thread has returned
+  pthread_mutex_lock(&job->lock);
+  char *out = job->out;
+  size_t len = job->outlen;
+  int done = job->running == 0;
+  job->out = NULL;
+  job->outlen = job->outcap = 0;
+  pthread_mutex_unlock(&job->lock);
+
+  int n = 0, cap = 0;
+  char **lines = NULL;
+  int *sizes = NULL;
+  char *p = out, *end = out + len, *nl;
+
+  while (p < end && (nl = memchr(p, '\n', end - p))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 256;
+      lines = realloc(lines, sizeof(char *) * cap);
+      sizes = realloc(sizes, sizeof(int) * cap);
+    }
+    lines[n] = p;
+    sizes[n++] = nl - p;
+    p = nl + 1;
+  }
+
+  if (n)
+    editorInsertRows(E.numrows, lines, sizes, n);
+
+  free(lines);
+  free(sizes);
+  free(out);
+  return done;
+}
+
+void editorGrep(const char *query) {
+  // lists the lines of the files under the current directory that have
+  // query, the buffer must have been closed already
+  struct grepJob job;
+  memset(&job, 0, sizeof(job));
+  job.query = query;
+  job.qlen = strlen(query);
+  job.nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (job.nthreads < 1)
+    job.nthreads = 1;
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.more, NULL);
+  if (pipe2(job.wake, O_CLOEXEC | O_NONBLOCK) == -1) {
+    editorSetStatusMessage("Can't search: %s", strerror(errno));
+    return;
+  }
+
+  job.deques = calloc(job.nthreads, sizeof(struct grepDeque));
+  struct grepThread *threads =
+      malloc(sizeof(struct grepThread) * job.nthreads);
+  pthread_t *tids = malloc(sizeof(pthread_t) * job.nthreads);
+
+  int t;
+  for (t = 0; t < job.nthreads; t++)
+    pthread_mutex_init(&job.deques[t].lock, NULL);
+  grepPush(&job, 0, strdup("."));
+
+  int started = 0;
+  for (t = 0; t < job.nthreads; t++) {
+    threads[t].job = &job;
+    threads[t].id = t;
+    pthread_mutex_lock(&job.lock);
+    job.running++;
+    pthread_mutex_unlock(&job.lock);
+    if (pthread_create(&tids[t], NULL, grepWorker, &threads[t]) != 0) {
+      pthread_mutex_lock(&job.lock);
+      job.running--;
+      pthread_mutex_unlock(&job.lock);
+      break;
+    }
+    started++;
+  }
+
+  E.grep.list = 1;
+  long long last = 0;
+
+  while (started) {
+    pthread_mutex_lock(&job.lock);
+    editorSetStatusMessage("Searching for %s, %ld matches in %ld files (ESC "
+                           "to stop)",
+                           query, job.matches, job.files);
+    pthread_mutex_unlock(&job.lock);
+
+    // redraws at most every 50ms, the results may come a lot faster
+    long long now = editorNow();
+    if (now - last > 50000000LL) {
+      editorRefreshScreen();
+      last = now;
+    }
+
+    struct pollfd pfd[2] = {{job.wake[0], POLLIN, 0},
+                            {editorCancelFd(), POLLIN, 0}};
+    if (poll(pfd, 2, 50) == -1 && errno != EINTR)
+      break;
+
+    if (pfd[0].revents & POLLIN) {
+      char buf[256];
+      while (read(job.wake[0], buf, sizeof(buf)) > 0)
+        ;
+    }
+    if (editorCancelled(pfd[1].revents)) { // other keys are dropped
+      pthread_mutex_lock(&job.lock);
+      job.stop = 1;
+      pthread_cond_broadcast(&job.more);
+      pthread_mutex_unlock(&job.lock);
+    }
+
+    if (grepResults(&job))
+      break;
+  }
+
+  for (t = 0; t < started; t++)
+    pthread_join(tids[t], NULL);
+  grepResults(&job); // what came after the last look
+
+  if (started == 0)
+    editorSetStatusMessage("Can't search: %s", strerror(errno));
+  else
+    editorSetStatusMessage("%s%ld matches of %s in %ld files%s",
+                           job.stop ? "Stopped, " : "", job.matches, query,
+                           job.files,
+                           job.matches ? " (Enter opens one)" : "");
+
+  for (t = 0; t < job.nthreads; t++) {
+    int k;
+    for (k = job.deques[t].head; k < job.deques[t].n; k++)
+      free(job.deques[t].paths[k]); // left behind by Esc
+    free(job.deques[t].paths);
+    pthread_mutex_destroy(&job.deques[t].lock);
+  }
+  free(job.deques);
+  free(threads);
+  free(tids);
+  close(job.wake[0]);
+  close(job.wake[1]);
+  pthread_cond_destroy(&job.more);
+  pthread_mutex_destroy(&job.lock);
+
+  editorUndoClear(); // the results aren't edits
+  E.dirty = 0;
+  E.cx = E.cy = E.rowoff = 0;
+}
+
+void editorGrepPrompt() {
+  // Ctrl-A, asks for the query and replaces the buffer with the results
+  if (E.server.enabled) { // the document of a server thread stays its file
+    editorSetStatusMessage("Searching files isn't done in te -a");
+    return;
+  }
+
+  char *query = editorPromptEx(
+      "Search files for: %s (Enter: the last search, ESC to cancel)", NULL, 1);
+  if (query == NULL)
+    return;
+
+  if (query[0] == '\0') {
+    free(query);
+    if (E.grep.query == NULL)
+      return;
+    query = strdup(E.grep.query);
+  }
+
+  if (E.dirty && !E.grep.list) {
+    editorSetStatusMessage("Save first, the results replace the buffer");
+    free(query);
+    return;
+  }
+
+  free(E.grep.query);
+  E.grep.query = query;
+
+  editorCloseFile();
+  editorGrep(query);
+}
+
+void editorGrepOpen() {
+  // Enter in the results, opens the file of the result at its line
+  if (E.cy >= E.numrows)
+    return;
+
+  erow *row = &E.row[E.cy];
+  int i = 0, line = -1;
+
+  // the first ":digits:" ends the path, a name may have colons of its own
+  while (line == -1 && i < row->size) {
+    char *colon = memchr(&row->chars[i], ':', row->size - i);
+    if (colon == NULL)
+      break;
+    i = colon - row->chars;
+
+    int j = i + 1;
+    while (j < row->size && isdigit((unsigned char)row->chars[j]))
+      j++;
+    if (j > i + 1 && j < row->size && row->chars[j] == ':')
+      line = atoi(&row->chars[i + 1]) - 1;
+    else
+      i++;
+  }
+
+  if (line < 0) {
+    editorSetStatusMessage("Not a result");
+    return;
+  }
+
+  char *path = strndup(row->chars, i);
+  if (access(path, R_OK) == -1) {
+    editorSetStatusMessage("Can't open %s: %s", path, strerror(errno));
+    free(path);
+    return;
+  }
+
+  editorCloseFile();
+  editorOpen(path);
+  free(path);
+
+  editorLoadTo(line); // the line might not have been read yet
+
+  if (line >= E.numrows)
+    line = E.numrows > 0 ? E.numrows - 1 : 0;
+
+  E.cy = line;
+  E.cx = 0;
+  E.rowoff = line; // puts the result at the top of the screen
+}
+
+// --- INPUT ---
+
+char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
+  return editorPromptEx(prompt, callback, 0);
+}
+
+char *editorPromptEx(char *prompt, void (*callback)(char *, int),
+                     int allow_empty) {
+  // prompt is expected to be a format string containing a %s user input,
+  // unless allow_empty is set, enter is ignored until something is typed
+  size_t bufsize = 128;        // user input will be stored in this buf
+  char *buf = malloc(bufsize); // here on buf
+
+  size_t buflen = 0;
+  buf[0] = '\0'; // initialize the buf string to empty string, despite there is
+                 // null char inside
+
+  while (1) {
+    editorSetStatusMessage(prompt, buf);
+    editorRefreshScreen();
+
+    int c = editorReadKey(); // read the key user press after
+    if (c == '\x1b') {
+      editorSetStatusMessage("");
+      if (callback)
+        callback(buf, c);
+
+      free(buf);
+      return NULL;
+    } else if (c ==
+               '\r') { // if the key pressed is enter, clear the status message
+      if (buflen != 0 || allow_empty) { // and if the buf is not empty
+        editorSetStatusMessage("");
+        if (callback)
+          callback(buf, c);
+
+        return buf;
+      }
+    } else if (!iscntrl(c) && c < 128) { // if c is not a control or special
+                                         // key (key id is less than 128)
+      if (buflen == bufsize - 1) { // if the buflen reached the maximum capacity
+        bufsize *= 2;              // double the size of the bufsize
+        buf = realloc(buf, bufsize); // and reallocate them
+      }
+
+      buf[buflen++] = c;
+      buf[buflen] = '\0';
+    } else if (c == BACKSPACE || c == DEL_KEY || c == CTRL_KEY('h')) {
+      // when the key pressed is the bs, del, or ctrl-h
+
+      if (buflen != 0)
+        buf[--buflen] = '\0';
+    }
+
+    if (callback)
+      callback(buf, c);
+  }
+}
+
+void editorMoveCursor(int key) {
+  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+  int cy = E.cy;
+  // to know what is the len of current line
+
+  // to move the cursor inside the terminal window, and also checks whether
+  // the cursor has reaches the end of each side of the window
+  switch (key) {
+  case ARROW_LEFT:
+    if (E.cx != 0) {
+      E.cx--;
+      while (E.cx > 0 && editorIsContinuation(row->chars[E.cx]))
+        E.cx--; // the whole UTF-8 sequence is one character
+    } else if (E.cy >
+             0) { // allow cursor when hit the left screen to continue upward
+      E.cy--;
+      E.cx = E.row[E.cy].size;
+    }
+    break;
+  case ARROW_RIGHT:
+    if (row && E.cx < row->size) { // preventing user to able to move the
+                                   // cursor outside of the line
+      E.cx++;
+      while (E.cx < row->size && editorIsContinuation(row->chars[E.cx]))
+        E.cx++;
+    } else if (row &&
+               E.cx == row->size) { // makes the cursor put to the beginning
+                                    // of new line when reaches the end
+      E.cy++;
+      E.cx = 0;
+    }
+    break;
+  case ARROW_UP:
+    if (editorWrapOn()) {
+      editorWrapMove(-1); // a screen line up, not a row
+      return;
+    }
+    if (E.cy != 0)
+      E.cy--;
+    break;
+  case ARROW_DOWN:
+    if (editorWrapOn()) {
+      editorWrapMove(1);
+      return;
+    }
+    if (E.cy < E.numrows)
+      E.cy++;
+    break;
+  }
+
+  int k = E.folds.n ? editorFoldAt(E.cy) : -1;
+  if (k != -1 && E.cy < cy) { // folded rows are gone past at once
+    E.cy = E.folds.at[k].start;
+    if (key == ARROW_LEFT)
+      E.cx = E.row[E.cy].size;
+  } else if (k != -1) {
+    E.cy = E.folds.at[k].end + 1;
+  }
+
+  row = (E.cy >= E.numrows) ? NULL
+                            : &E.row[E.cy]; // the next line or previous line
+
+  int rowlen = row ? row->size : 0;
+
+  if (E.cx > rowlen) {
+    E.cx = rowlen; // forces the cursor to stay in the last character on each
+                   // line after doing cursor movement (up or down)
+  }
+
+  while (E.cx > 0 && E.cx < rowlen && editorIsContinuation(row->chars[E.cx]))
+    E.cx--; // up or down may land in the middle of a character
+}
+
+void editorProcessKeypress() {
+  // handles what key is pressed
+  int c = editorReadKey();
+
+  if (E.pager.enabled) { // the pager has its own keys, there is no editing
+    editorPagerProcessKeypress(c);
+    return;
+  }
+
+  if (E.hex.enabled) { // and so does hex view
+    editorHexProcessKeypress(c);
+    return;
+  }
+
+  static __thread int quit_times =
+      KILO_QUIT_TIMES; // keep track how many Ctrl-Q has been pressed
+
+  if (E.cursors.n && editorCursorsKey(c)) { // typing at every cursor
+    quit_times = KILO_QUIT_TIMES;
+    return;
+  }
+
+  switch (c) {
+  case '\r':
+    // when enter key is pressed
+    if (E.grep.list)
+      editorGrepOpen();
+    else
+      editorInsertNewline();
+    break;
+
+  case CTRL_KEY('q'):
+
+    if (E.server.enabled) { // the document stays open in the server
+      serverDetach();
+      return;
+    }
+
+    if (E.dirty && quit_times > 0) {
+      editorSetStatusMessage("WARNING!!! File has unsaved changes. "
+                             "Press Ctrl-Q %d more times to quit.",
+                             quit_times);
+      quit_times--;
+
+      return;
+    }
+
+    editorOutput("\x1b[2J", 4);
+    editorOutput("\x1b[H", 3);
+    exit(0);
+    break;
+
+  case CTRL_KEY('s'):
+
+    editorSave();
+    break;
+
+  case HOME_KEY:
+    E.cx = 0;
+    break;
+
+  case END_KEY:
+    if (E.cy < E.numrows)
+      E.cx = E.row[E.cy].size; // ensures to move to the end of the line
+                               // defined by the row cy size
+    break;
+
+  case CTRL_KEY('f'):
+    editorFind();
+    break;
+
+  case CTRL_KEY('r'):
+    editorReplace();
+    break;
+
+  case CTRL_KEY('z'):
+    editorUndo();
+    break;
+
+  case CTRL_KEY('g'):
+    editorGoto();
+    break;
+
+  case CTRL_KEY('n'):
+    E.linenumbers = !E.linenumbers;
+    break;
+
+  case CTRL_KEY('w'):
+    editorWrapToggle();
+    break;
+
+  case CTRL_KEY('o'):
+    editorBracketsJump();
+    break;
+
+  case CTRL_KEY('k'):
+    editorFoldToggle();
+    break;
+
+  case CTRL_KEY('e'):
+    editorFilterPrompt();
+    break;
+
+  case CTRL_KEY('a'):
+    editorGrepPrompt();
+    break;
+
+  case CTRL_KEY(']'):
+    if (E.symbols.enabled)
+      editorJump();
+    break;
+
+  case CTRL_KEY('p'):
+    editorComplete();
+    break;
+
+  case CTRL_KEY('d'):
+    editorCursorsAdd();
+    break;
+
+  case CTRL_KEY('b'):
+    editorMark();
+    break;
+
+  case CTRL_KEY('c'):
+  case CTRL_KEY('x'):
+  case CTRL_KEY('v'):
+    editorSelectionKey(c);
+    break;
+
+  case CTRL_KEY('t'):
+    statsToggle();
+    break;
+
+  case BACKSPACE:
+  case CTRL_KEY('h'):
+  case DEL_KEY:
+    if (c == DEL_KEY) // when the pressed key is DEL_KEY, move the cursor to
+                      // the right by 1
       editorMoveCursor(ARROW_RIGHT);
 
-    editorDelChar();
-    break;
+    editorDelChar();
+    break;
+
+  case PAGE_UP:
+  case PAGE_DOWN: {
+    if (editorWrapOn()) { // from the top screen line, by screen lines
+      E.cy = E.rowoff;
+      E.cx = 0;
+      if (E.cy < E.numrows) {
+        erow *row = &E.row[E.cy];
+        int b = editorWrapStart(row, E.wrap.sub);
+        E.cx = editorRowRxToCx(row, editorRowByteToCol(row, b));
+      }
+      if (c == PAGE_DOWN)
+        editorWrapMove(E.screenrows - 1);
+      editorWrapMove(c == PAGE_UP ? -E.screenrows : E.screenrows);
+      break;
+    }
+
+    if (c ==
+        PAGE_UP) { // positions the cursor at the top or bottom of the screen
+      E.cy = E.rowoff;
+    } else if (c == PAGE_DOWN) {
+      E.cy = E.rowoff + E.screenrows - 1;
+
+      if (E.cy > E.numrows)
+        E.cy = E.numrows;
+    }
+
+    int times = E.screenrows;
+    while (times--)
+      editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+  } break;
+
+  case ARROW_DOWN: // for navigating or cursor movement
+  case ARROW_UP:
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+    editorMoveCursor(c);
+    break;
+
+  case CTRL_KEY('l'):
+  case '\x1b':
+    break;
+
+  default:
+    editorInsertChar(c); // insert the new char to the row
+    break;
+  }
+
+  quit_times = KILO_QUIT_TIMES;
+
+  if (c != CTRL_KEY('p')) // any other key keeps the completion
+    editorCompleteReset();
+
+  // moving the cursor moves the end of the selection, anything else drops it
+  switch (c) {
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+  case PAGE_UP:
+  case PAGE_DOWN:
+  case HOME_KEY:
+  case END_KEY:
+  case CTRL_KEY('b'):
+  case CTRL_KEY('s'):
+  case CTRL_KEY('f'):
+  case CTRL_KEY('g'):
+  case CTRL_KEY('n'):
+  case CTRL_KEY('w'):
+  case CTRL_KEY('o'):
+  case CTRL_KEY('t'):
+  case CTRL_KEY('l'):
+    break;
+  default:
+    E.sel.mode = SEL_NONE;
+  }
+}
+
+// --- APPEND BUFFER ---
+// append buffer to reduce the consumption of write function
+// and also limitting bugs to occur when using write func
+// abuf is a dynamically string, C doesnt have this, we have to do it manually
+
+struct abuf {
+  char *b;
+  int len;
+};
+
+#define ABUF_INIT {NULL, 0}
+
+void abAppend(struct abuf *ab, const char *s,
+              int len) { // append the new string with is appropriate length to
+                         // be added to the abuf
+  char *new = realloc(ab->b, ab->len + len);
+
+  if (new == NULL)
+    return;
+
+  memcpy(&new[ab->len], s, len);
+  ab->b = new;
+  ab->len += len;
+}
+
+void abFree(struct abuf *ab) {
+  free(ab->b);
+} // dont forget to free the fucking memory used by the abuf, since it uses
+  // realloc
+
+// --- HEX ---
+// hex view (-x) shows any file as rows of 16 bytes, like hexdump -C, for core
+// dumps and binary protocols, the file is mmapped and nothing is read into
+// rows, a screen row is formatted from the mapping when it is drawn, into a
+// buffer on the stack, so even a 20 GB image opens and scrolls instantly,
+// typing overwrites bytes in place, the changed bytes are kept apart until
+// Ctrl-S writes each run of them with pwrite, the file never changes size
+
+int editorHexFirst(size_t off) {
+  // the index of the first overwritten byte at or after off
+  int lo = 0, hi = E.hex.nedits;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (E.hex.edits[mid].off < off)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+int editorHexAt(size_t off) {
+  // the byte at off as it is shown, with what was typed over it
+  int k = editorHexFirst(off);
+  if (k < E.hex.nedits && E.hex.edits[k].off == off)
+    return E.hex.edits[k].byte;
+  return E.hex.map[off];
+}
+
+void editorHexSet(size_t off, int byte, int undoing) {
+  // overwrites the byte at off, undoing is 1 for Ctrl-Z, which isn't undone
+  int k = editorHexFirst(off);
+  int had = k < E.hex.nedits && E.hex.edits[k].off == off;
+
+  if (!undoing) { // what was there before, for Ctrl-Z
+    if (E.hex.nundo == E.hex.undocap) {
+      E.hex.undocap = E.hex.undocap ? E.hex.undocap * 2 : 64;
+      E.hex.undo = realloc(E.hex.undo, sizeof(struct editorHexByte) *
+                                           E.hex.undocap);
+    }
+    struct editorHexByte *u = &E.hex.undo[E.hex.nundo++];
+    u->off = off;
+    u->byte = had ? E.hex.edits[k].byte : E.hex.map[off];
+    u->edited = had;
+  }
+
+  if (!had) {
+    if (E.hex.nedits == E.hex.editcap) {
+      E.hex.editcap = E.hex.editcap ? E.hex.editcap * 2 : 64;
+      E.hex.edits = realloc(E.hex.edits, sizeof(struct editorHexByte) *
+                                             E.hex.editcap);
+    }
+    memmove(&E.hex.edits[k + 1], &E.hex.edits[k],
+            sizeof(struct editorHexByte) * (E.hex.nedits - k));
+    E.hex.nedits++;
+    E.hex.edits[k].off = off;
+  }
+
+  E.hex.edits[k].byte = byte;
+  E.dirty++;
+}
+
+void editorHexUndo() {
+  // puts back the byte changed last
+  if (E.hex.nundo == 0) {
+    editorSetStatusMessage("Nothing to undo");
+    return;
+  }
+
+  struct editorHexByte *u = &E.hex.undo[--E.hex.nundo];
+
+  if (u->edited) {
+    editorHexSet(u->off, u->byte, 1);
+  } else { // it wasn't overwritten before, so it goes back to the file's
+    int k = editorHexFirst(u->off);
+    memmove(&E.hex.edits[k], &E.hex.edits[k + 1],
+            sizeof(struct editorHexByte) * (E.hex.nedits - k - 1));
+    E.hex.nedits--;
+  }
+
+  E.hex.cur = u->off;
+  E.hex.low = 0;
+  E.dirty = E.hex.nedits ? E.dirty + 1 : 0;
+}
+
+void editorHexSave() {
+  // writes the overwritten bytes, every run of adjacent ones with one pwrite
+  if (E.hex.nedits == 0)
+    return;
+
+  if (E.trace.fp && E.trace.replay) { // a replay must not touch the file
+    E.hex.nundo = 0; // the bytes stay overlaid, as if they were written
+    E.dirty = 0;
+    editorSetStatusMessage("Replay: not saving %s", E.filename);
+    return;
+  }
+
+  if (E.hex.fd == -1) {
+    editorSetStatusMessage("Read-only! %s can't be written", E.filename);
+    return;
+  }
+
+  unsigned char buf[4096];
+  int k = 0;
+
+  while (k < E.hex.nedits) {
+    size_t start = E.hex.edits[k].off;
+    int n = 0;
+
+    while (k < E.hex.nedits && n < (int)sizeof(buf) &&
+           E.hex.edits[k].off == start + n)
+      buf[n++] = E.hex.edits[k++].byte;
+
+    if (pwrite(E.hex.fd, buf, n, start) != n) {
+      editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+      return; // what was written is in the mapping now, the rest stays
+    }
+  }
+
+  editorSetStatusMessage("%d bytes written to disk", E.hex.nedits);
+  E.hex.nedits = 0; // the mapping is shared, it has the new bytes already
+  E.hex.nundo = 0;
+  E.dirty = 0;
+}
+
+void editorHexOpen(char *filename) {
+  free(E.filename);
+  E.filename = strdup(filename);
+
+  int fd = open(filename, O_RDWR);
+  E.hex.fd = fd;
+  if (fd == -1) // can still be looked at
+    fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    die("open");
+
+  // lseek instead of st_size, so disk images on block devices work too
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size == -1)
+    die("lseek");
+
+  E.hex.size = size;
+  E.hex.map = NULL;
+
+  if (E.hex.size > 0) { // mmap refuses to map 0 bytes
+    E.hex.map = mmap(NULL, E.hex.size, PROT_READ, MAP_SHARED, fd, 0);
+    if (E.hex.map == MAP_FAILED)
+      die("mmap");
+  }
+
+  if (E.hex.fd == -1)
+    close(fd); // the mapping stays valid after closing
+
+  // the offsets are as wide as the biggest one, 8 hex digits at least
+  size_t last = E.hex.size ? E.hex.size - 1 : 0;
+  for (E.hex.width = 8; E.hex.width < 16 && last >> (E.hex.width * 4);)
+    E.hex.width++;
+
+  E.hex.enabled = 1;
+}
+
+int editorHexCol(int i, int ascii) {
+  // the screen column of byte i of a row, in the hex or the text column
+  if (ascii)
+    return E.hex.width + 53 + i;
+  return E.hex.width + 2 + i * 3 + (i >= 8);
+}
+
+void editorHexScroll() {
+  // keeps the cursor row on the screen, and puts where it goes on the screen
+  // into E.cy and E.rx for editorRefreshScreen
+  size_t row = E.hex.cur / 16;
+
+  if (row < E.hex.top)
+    E.hex.top = row;
+  if (row >= E.hex.top + E.screenrows)
+    E.hex.top = row - E.screenrows + 1;
+
+  E.rowoff = E.coloff = E.gutter = 0;
+  E.cy = row - E.hex.top;
+  E.rx = editorHexCol(E.hex.cur % 16, E.hex.ascii) +
+         (E.hex.ascii ? 0 : E.hex.low);
+  if (E.rx >= E.screencols)
+    E.rx = E.screencols - 1; // a narrow terminal cuts the rows
+}
+
+void editorHexDrawRow(struct abuf *ab, size_t row) {
+  // formats the row into a line on the stack, with an attribute for every
+  // column, overwritten bytes are drawn red, and the byte of the cursor is
+  // inverted in the column the cursor isn't in
+  char line[96];
+  char attr[96];
+  size_t off = row * 16;
+  int n = E.hex.size - off < 16 ? E.hex.size - off : 16;
+
+  int len = snprintf(line, sizeof(line), "%0*zx", E.hex.width, off);
+  memset(line + len, ' ', sizeof(line) - len);
+  memset(attr, 0, sizeof(attr));
+
+  int k = editorHexFirst(off);
+  int i;
+  for (i = 0; i < n; i++) {
+    int edited = k < E.hex.nedits && E.hex.edits[k].off == off + i;
+    int c = edited ? E.hex.edits[k++].byte : E.hex.map[off + i];
+    int hx = editorHexCol(i, 0), tx = editorHexCol(i, 1);
+
+    line[hx] = "0123456789abcdef"[c >> 4];
+    line[hx + 1] = "0123456789abcdef"[c & 15];
+    line[tx] = c >= 32 && c < 127 ? c : '.';
+    attr[hx] = attr[hx + 1] = attr[tx] = edited;
+
+    if (off + i == E.hex.cur) {
+      if (E.hex.ascii)
+        attr[hx] = attr[hx + 1] |= 2;
+      else
+        attr[tx] |= 2;
+    }
+  }
+  line[editorHexCol(0, 1) - 1] = '|';
+  line[editorHexCol(n, 1)] = '|';
+  len = editorHexCol(n, 1) + 1;
+
+  if (len > E.screencols)
+    len = E.screencols;
+
+  // every run of columns with the same attribute goes out in one piece
+  int run;
+  for (i = 0; i < len; i = run) {
+    for (run = i + 1; run < len && attr[run] == attr[i];)
+      run++;
+
+    if (attr[i] & 1)
+      abAppend(ab, "\x1b[31m", 5);
+    if (attr[i] & 2)
+      abAppend(ab, "\x1b[7m", 4);
+    abAppend(ab, &line[i], run - i);
+    if (attr[i])
+      abAppend(ab, "\x1b[m", 3);
+  }
+}
+
+void editorHexDrawRows(struct abuf *ab) {
+  size_t rows = (E.hex.size + 15) / 16;
+  int y;
+
+  for (y = 0; y < E.screenrows; y++) {
+    if (E.hex.top + y < rows)
+      editorHexDrawRow(ab, E.hex.top + y);
+    else
+      abAppend(ab, "~", 1);
+
+    abAppend(ab, "\x1b[K", 3);
+    abAppend(ab, "\r\n", 2);
+  }
+}
+
+void editorHexMove(long long by) {
+  // moves the cursor by bytes, stopping at either end of the file
+  long long to = (long long)E.hex.cur + by;
+
+  if (to < 0)
+    to = by < -15 ? (long long)E.hex.cur % 16 : 0; // up on the first row
+  if (to >= (long long)E.hex.size)
+    to = E.hex.size ? E.hex.size - 1 : 0;
+
+  E.hex.cur = to;
+  E.hex.low = 0;
+}
+
+void editorHexGoto() {
+  char *query = editorPrompt("Go to offset: %s (0x for hex, ESC to cancel)",
+                             NULL);
+  if (query == NULL)
+    return;
+
+  char *end;
+  errno = 0;
+  unsigned long long off = strtoull(query, &end, 0);
+
+  if (errno || *end || off >= E.hex.size)
+    editorSetStatusMessage("No offset %s in the file", query);
+  else
+    editorHexMove((long long)off - (long long)E.hex.cur);
+
+  free(query);
+}
+
+void editorHexFind() {
+  // finds the text after the cursor, then from the top, the bytes typed over
+  // and not saved yet aren't searched
+  char *query = editorPrompt("Search: %s (ESC to cancel)", NULL);
+  if (query == NULL || E.hex.size == 0) {
+    free(query);
+    return;
+  }
+
+  size_t qlen = strlen(query);
+  size_t from = E.hex.cur + 1;
+  unsigned char *m = NULL;
+
+  if (from < E.hex.size)
+    m = memmem(E.hex.map + from, E.hex.size - from, query, qlen);
+  if (m == NULL)
+    m = memmem(E.hex.map, E.hex.size, query, qlen);
+
+  if (m)
+    editorHexMove((long long)(m - E.hex.map) - (long long)E.hex.cur);
+  else
+    editorSetStatusMessage("%s isn't in the file", query);
+
+  free(query);
+}
+
+void editorHexProcessKeypress(int c) {
+  static __thread int quit_times = KILO_QUIT_TIMES;
+
+  switch (c) {
+  case CTRL_KEY('q'):
+    if (E.dirty && quit_times > 0) {
+      editorSetStatusMessage("WARNING!!! File has unsaved changes. "
+                             "Press Ctrl-Q %d more times to quit.",
+                             quit_times);
+      quit_times--;
+      return;
+    }
+    editorOutput("\x1b[2J", 4);
+    editorOutput("\x1b[H", 3);
+    exit(0);
+    break;
+
+  case CTRL_KEY('s'):
+    editorHexSave();
+    break;
+
+  case CTRL_KEY('z'):
+    editorHexUndo();
+    break;
+
+  case CTRL_KEY('f'):
+    editorHexFind();
+    break;
+
+  case CTRL_KEY('g'):
+    editorHexGoto();
+    break;
+
+  case CTRL_KEY('t'):
+    statsToggle();
+    break;
+
+  case '\t': // typing goes to the other column
+    E.hex.ascii = !E.hex.ascii;
+    E.hex.low = 0;
+    break;
+
+  case ARROW_LEFT:
+    editorHexMove(-1);
+    break;
+
+  case ARROW_RIGHT:
+    editorHexMove(1);
+    break;
+
+  case ARROW_UP:
+    editorHexMove(-16);
+    break;
+
+  case ARROW_DOWN:
+    editorHexMove(16);
+    break;
+
+  case PAGE_UP:
+    editorHexMove(-16LL * E.screenrows);
+    break;
+
+  case PAGE_DOWN:
+    editorHexMove(16LL * E.screenrows);
+    break;
+
+  case HOME_KEY:
+    editorHexMove(-(long long)(E.hex.cur % 16));
+    break;
+
+  case END_KEY:
+    editorHexMove(15 - (long long)(E.hex.cur % 16));
+    break;
+
+  case CTRL_KEY('l'):
+  case '\x1b':
+    break;
+
+  default:
+    if (E.hex.size == 0 || c < 32 || c >= 127) {
+      editorSetStatusMessage("Bytes can only be overwritten in hex view");
+      break;
+    }
+
+    if (E.hex.ascii) { // the character itself
+      editorHexSet(E.hex.cur, c, 0);
+      editorHexMove(1);
+      break;
+    }
+
+    if (!isxdigit(c)) {
+      editorSetStatusMessage("Type a hex digit, or Tab for the text column");
+      break;
+    }
+
+    // a digit replaces the high or the low half of the byte
+    int digit = isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+    int byte = editorHexAt(E.hex.cur);
+    if (E.hex.low) {
+      editorHexSet(E.hex.cur, (byte & 0xf0) | digit, 0);
+      editorHexMove(1);
+    } else {
+      editorHexSet(E.hex.cur, (byte & 0x0f) | digit << 4, 0);
+      E.hex.low = 1;
+    }
+    break;
+  }
+
+  quit_times = KILO_QUIT_TIMES;
+}
+
+// --- OUTPUT ---
+
+void editorWriteStdout(const char *s, int len) { write(STDOUT_FILENO, s, len); }
+
+// where editorRefreshScreen sends the frames, running without a terminal
+// (the benchmarks) swaps in a different sink
+void (*editorOutput)(const char *s, int len) = editorWriteStdout;
+
+void editorScroll() {
+  if (E.hex.enabled) { // there are no rows
+    editorHexScroll();
+    return;
+  }
+
+  E.rx = 0;
+
+  if (E.pager.enabled) {
+    E.rx = E.cx; // the pager keeps the cursor as a render column already
+  } else if (E.cy < E.numrows) {
+    E.rx = editorRowCxToRx(&E.row[E.cy],
+                           E.cx); // calculates the right value for E.rx
+  }
+
+  // the gutter is as wide as the biggest line number, plus a space
+  E.gutter = 0;
+  if (E.linenumbers) {
+    int n = E.pager.enabled ? E.pager.nlines : E.numrows;
+    for (E.gutter = 2; n >= 10; n /= 10)
+      E.gutter++;
+    if (E.gutter >= E.screencols)
+      E.gutter = 0; // no room for any text next to it
+  }
+
+  int textcols = E.screencols - E.gutter;
+
+  if (E.folds.n) {
+    int k = editorFoldAt(E.cy); // the cursor got into a fold, by a search or
+    if (k != -1)                // an undo, it is opened
+      editorFoldDel(k);
+    if ((k = editorFoldAt(E.rowoff)) != -1)
+      E.rowoff = E.folds.at[k].start;
+  }
+
+  if (editorWrapOn()) { // scrolls by screen lines, never sideways
+    editorWrapScroll(textcols);
+    return;
+  }
+
+  // to check if the cursor has moved outside of the visible window, and adjust
+  // the cursor to be inside the visible window or terminal window
+  if (E.cy < E.rowoff) {
+    // checks if the cursor is above the visible window
+    E.rowoff = E.cy;
+  }
+
+  if (E.folds.n == 0 && E.cy >= E.rowoff + E.screenrows) {
+    // checks if the cursor is past the bottom of the visible window
+    E.rowoff = E.cy - E.screenrows + 1;
+  } else if (E.folds.n && editorFoldRows(E.rowoff, E.cy) >= E.screenrows) {
+    // the same, counting only the rows that are shown
+    int n;
+    E.rowoff = E.cy;
+    for (n = 1; n < E.screenrows && E.rowoff > 0; n++)
+      E.rowoff = editorFoldPrev(E.rowoff);
+  }
+
+  // for the horizontal part, pretty much the same as the vertical one above
+  if (E.rx < E.coloff) {
+    E.coloff = E.rx;
+  }
+
+  if (E.rx >= E.coloff + textcols) {
+    E.coloff = E.rx - textcols + 1;
+  }
+}
+
+void editorDrawRows(struct abuf *ab) {
+  if (E.hex.enabled) {
+    editorHexDrawRows(ab);
+    return;
+  }
+
+  int textcols = E.screencols - E.gutter;
+  int numrows = E.numrows;
+  if (E.pager.enabled) // the pager only indexes as far as the screen reaches
+    numrows = editorPagerIndexTo(E.rowoff + E.screenrows);
+
+  // with soft wrap a row is drawn a screen line at a time, wrapstart is the
+  // byte the next one starts at
+  int wrap = editorWrapOn();
+  int filerow = E.rowoff;
+  int wrapstart = 0;
+  if (wrap && filerow < numrows)
+    wrapstart = editorWrapStart(&E.row[filerow], E.wrap.sub);
+
+  int y;
+  for (y = 0; y < E.screenrows;
+       y++) { // E.screenrows will have the appropriate screen rows size after
+              // succeeding get the values
+              // write(STDOUT_FILENO, "~", 1); // change this line
+
+    if (!wrap && y > 0) // the rows folded away are skipped
+      filerow = editorFoldNext(filerow);
+    if (filerow >= numrows) {
+      if (y == E.screenrows / 3 && numrows == 0 &&
+          !E.pager.enabled) { // welcome screen only show when there is no
+                              // arguments included when the program is called
+        char welcome[80];
+        int welcomelen = snprintf(welcome, sizeof(welcome),
+                                  "TE editor -- version %s", KILO_VERSION);
+        if (welcomelen > E.screencols)
+          welcomelen = E.screencols;
+
+        int padding = (E.screencols - welcomelen) / 2;
+
+        if (padding) {
+          abAppend(ab, "~", 1);
+          padding--;
+        }
+
+        while (padding-- >= 0) { // makes the welcome screen text centered
+          abAppend(ab, " ", 1);
+        }
+
+        abAppend(ab, welcome, welcomelen); // prints the welcome screen text
+      } else {
+        abAppend(ab, "~", 1);
+      }
+    } else {
+      // in pager mode the row is rendered from the mapping into a scratch row
+      erow *row = E.pager.enabled ? editorPagerRow(filerow) : &E.row[filerow];
+
+      if (E.gutter && wrap && wrapstart > 0) { // the row goes on, no number
+        int k;
+        for (k = 0; k < E.gutter; k++)
+          abAppend(ab, " ", 1);
+      } else if (E.gutter) {
+        char num[16];
+        int numlen =
+            snprintf(num, sizeof(num), "%*d ", E.gutter - 1, filerow + 1);
+        abAppend(ab, num, numlen);
+      }
+
+      // coloff and screencols are columns, which are only bytes of render
+      // when the row is all ASCII, otherwise the cached columns tell where
+      // the visible part starts and ends
+      int start = editorRowColToByte(row, E.coloff);
+      int end = editorRowColToByte(row, E.coloff + textcols);
+      int leftcol = E.coloff;
+      int pad = 0;
+      int wrapnext = -1;
+
+      if (wrap) { // the screen line, there is nothing to cut
+        start = wrapstart;
+        wrapnext = editorWrapNext(row, start, E.wrap.width);
+        end = wrapnext == -1 ? row->rsize : wrapnext;
+        leftcol = editorRowByteToCol(row, start);
+      } else if (row->rcol) {
+        // a wide character cut by the right edge isn't drawn at all, and one
+        // cut by the left edge leaves blanks
+        if (end > start && row->rcol[end] > E.coloff + textcols) {
+          end--;
+          while (end > start && editorIsContinuation(row->render[end]))
+            end--;
+        }
+        if (start < row->rsize)
+          pad = row->rcol[start] - E.coloff;
+      }
+
+      while (pad-- > 0)
+        abAppend(ab, " ", 1);
+
+      int len = end - start; // draws the input text to the buffer ab on
+                             // each line of erow, now coloff serve as an
+                             // index of the chars each time each row is
+                             // displayed to the screen
+
+      char *c = &row->render[start];
+
+      unsigned char *hl =
+          &row->hl[start]; // grab the hl index based on the coloff
+
+      int current_color = -1; // -1 for default color
+
+      // the extra cursors of Ctrl-D are drawn inverted, they are sorted, so
+      // the next one is looked up only once the last one is drawn
+      int cur = E.cursors.n;
+      int curbyte = -1;
+      if (E.cursors.n && !E.pager.enabled) {
+        cur = editorCursorsFirst(filerow, 0);
+        curbyte = editorCursorsNext(row, &cur, start);
+      }
+
+      int sela = -1, selb = -1; // and so is the selection of Ctrl-B
+      if (E.sel.mode && !E.pager.enabled)
+        editorSelectionDrawn(row, &sela, &selb);
+
+      // the matches of Ctrl-F are drawn over the highlighting, matches can
+      // overlap, matchend is where the ones begun so far end
+      int nmatch = 0, m = 0, matchend = 0;
+      int *match = NULL;
+      if (E.search.active && E.search.qlen && !E.pager.enabled)
+        match = editorSearchMatches(row, &nmatch);
+
+      int j, step;
+      for (j = 0; j < len; j += step) {
+        int bad = 0; // drawn inverted, as a symbol
+        step = 1;
+
+        if (c[j] & 0x80) { // a UTF-8 sequence, drawn as a whole
+          int cp = editorDecodeUtf8(&c[j], len - j, &step);
+          bad = cp < 0 || cp <= 0x9f; // invalid or a C1 control character
+        } else {
+          bad = iscntrl(c[j]);
+        }
+
+        while (m < nmatch && match[m] <= start + j)
+          matchend = match[m++] + E.search.qlen;
+        int h = start + j < matchend ? HL_MATCH : hl[j];
+
+        int inverted = start + j == curbyte ||
+                       (start + j >= sela && start + j < selb);
+        if (inverted)
+          abAppend(ab, "\x1b[7m", 4);
+
+        if (bad) { // checks if the current char is control char
+          char sym = (c[j] >= 0 && c[j] <= 26)
+                         ? '@' + c[j]
+                         : '?'; // if the char <= 26 print @_ otherwise ?
+
+          abAppend(ab, "\x1b[7m", 4); // invert the color
+          abAppend(ab, &sym, 1);
+          abAppend(ab, "\x1b[m", 3); // put back to normal
+
+          if (current_color !=
+              -1) { // if the color not the normal ones, set it back
+                    // since \x1b[m reset all color or highlight
+            char buf[16];
+            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
+            abAppend(ab, buf, clen);
+          }
+
+        } else if (h == HL_NORMAL) { // if its HL_NORMAL, use \x1b[39m
+          if (current_color !=
+              -1) { // and if the current_color is not -1, set it back
+            abAppend(ab, "\x1b[39m", 5);
+            current_color = -1;
+          }
+
+          abAppend(ab, &c[j], step);
+        } else { // otherwise use the appropriate color
+          int color = editorSyntaxToColor(h);
 
-  case PAGE_UP:
-  case PAGE_DOWN: {
-    if (c ==
-        PAGE_UP) { // positions the cursor at the top or bottom of the screen
-      E.cy = E.rowoff;
-    } else if (c == PAGE_DOWN) {
-      E.cy = E.rowoff + E.screenrows - 1;
+          if (color != current_color) { // update the color
+            current_color = color;
 
-      if (E.cy > E.numrows)
-        E.cy = E.numrows;
+            char buf[16];
+
+            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+
+            abAppend(ab, buf, clen);
+          }
+          abAppend(ab, &c[j], step);
+        }
+
+        if (inverted)
+          abAppend(ab, "\x1b[27m", 5);
+        if (start + j == curbyte)
+          curbyte = editorCursorsNext(row, &cur, start + j + 1);
+      }
+
+      int endcol = editorRowByteToCol(row, end);
+      if ((curbyte == end || (sela <= end && selb > end)) &&
+          end == row->rsize && endcol >= leftcol &&
+          endcol < leftcol + textcols)
+        abAppend(ab, "\x1b[7m \x1b[27m", 10); // a cursor, or a selected
+                                               // newline, after the text
+
+      if (E.folds.n && end == row->rsize && !E.pager.enabled &&
+          endcol - leftcol + 5 <= textcols) { // the rows below are folded
+        int k = editorFoldFirst(filerow);
+        if (k < E.folds.n && E.folds.at[k].start == filerow)
+          abAppend(ab, " \x1b[36m...\x1b[39m", 14);
+      }
+
+      abAppend(ab, "\x1b[39m", 5); // make the text color is reset to default
+
+      if (wrap && wrapnext == -1) { // the next screen line is the next row
+        filerow = editorFoldNext(filerow); // that isn't folded away
+        wrapstart = 0;
+      } else if (wrap) {
+        wrapstart = wrapnext;
+      }
     }
 
-    int times = E.screenrows;
-    while (times--)
-      editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-  } break;
+    abAppend(ab, "\x1b[K", 3); // clean the remaining length of the line
 
-  case ARROW_DOWN: // for navigating or cursor movement
-  case ARROW_UP:
-  case ARROW_LEFT:
-  case ARROW_RIGHT:
-    editorMoveCursor(c);
-    break;
+    // the last line of the terminal screen seems not to print a tilde, this is
+    // a bug on our code when it reaches the last line, it prints the \r\n and
+    // causes the terminal to scroll in order to make room for the new blank
+    // line
 
-  case CTRL_KEY('l'):
-  case '\x1b':
-    break;
+    abAppend(ab, "\r\n", 2);
+  }
+}
 
-  default:
-    editorInsertChar(c); // insert the new char to the row
-    break;
+void editorDrawStatusBar(struct abuf *ab) {
+  abAppend(ab, "\x1b[7m", 4);
+
+  char status[80];
+  char rstatus[80];
+
+  int numrows = E.numrows;
+  const char *more = ""; // the pager might not know how many lines there are
+
+  if (E.pager.enabled) {
+    numrows = E.pager.nlines;
+    if (E.pager.scanned < E.pager.size)
+      more = "+";
   }
 
-  quit_times = KILO_QUIT_TIMES;
+  char loading[32] = ""; // how much of the file is read already
+  if (E.load.active) {
+    more = "+";
+    if (E.load.total) // a compressed file's size says nothing about its rows
+      snprintf(loading, sizeof(loading), "[loading %d%%]",
+               (int)(E.load.loaded * 100 / E.load.total));
+    else
+      snprintf(loading, sizeof(loading), "[loading %lld MB]",
+               E.load.loaded >> 20);
+  }
+
+  int len = snprintf(status, sizeof(status),
+                     "%.20s - %d%s lines %s%s%s%s%s%s%s",
+                     E.filename ? E.filename : "[No Name]", numrows, more,
+                     E.dirty ? "(modified) " : "",
+                     E.follow.fd != -1 ? "[follow]" : "",
+                     E.pager.enabled ? "[read-only]" : "",
+                     E.load.codec ? "[" : "",
+                     E.load.codec ? E.load.codec->name : "",
+                     E.load.codec ? "]" : "", loading);
+
+  // how far into the file the cursor line starts, in bytes, both come from
+  // an index, O(log n) at most
+  long long off, total;
+  if (E.pager.enabled) {
+    off = E.cy < E.pager.nlines ? (long long)E.pager.line[E.cy] : 0;
+    total = E.pager.size;
+  } else {
+    off = editorLinesOffset(E.cy < E.numrows ? E.cy : E.numrows);
+    total = editorLinesOffset(E.numrows);
+  }
+
+  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d,%d | %d%%",
+                      E.syntax ? E.syntax->filetype : "no ft", E.cy + 1,
+                      E.rx + 1, total ? (int)(off * 100 / total) : 100);
+
+  if (E.hex.enabled) { // bytes instead of lines
+    size_t last = E.hex.size ? E.hex.size - 1 : 0;
+    len = snprintf(status, sizeof(status), "%.20s - %zu bytes %s[hex]%s",
+                   E.filename, E.hex.size, E.dirty ? "(modified) " : "",
+                   E.hex.fd == -1 ? "[read-only]" : "");
+    rlen = snprintf(rstatus, sizeof(rstatus), "%s | %0*zx | %d%%",
+                    E.hex.ascii ? "text" : "hex", E.hex.width, E.hex.cur,
+                    last ? (int)(E.hex.cur * 100.0 / last) : 100);
+  }
+
+  if (len > E.screencols)
+    len = E.screencols - 1;
+
+  abAppend(ab, status, len);
+
+  while (len < E.screencols) {
+    if (E.screencols - len == rlen) {
+      abAppend(ab, rstatus, rlen);
+      break;
+    } else {
+      abAppend(ab, " ", 1);
+      len++;
+    }
+  }
+
+  abAppend(ab, "\x1b[m", 3);
+  abAppend(ab, "\r\n", 2);
 }
 
-// --- APPEND BUFFER ---
-// append buffer to reduce the consumption of write function
-// and also limitting bugs to occur when using write func
-// abuf is a dynamically string, C doesnt have this, we have to do it manually
+void editorDrawMessageBar(struct abuf *ab) {
+  abAppend(ab, "\x1b[K", 3); // clears the line
 
-struct abuf {
-  char *b;
-  int len;
+  int msglen = strlen(E.statusmsg);
+
+  if (msglen > E.screencols)
+    msglen = E.screencols;
+  if (msglen && editorTime() - E.statusmsg_time < 5)
+    abAppend(ab, E.statusmsg, msglen);
+}
+
+void editorDrawStatsBar(struct abuf *ab) {
+  // the summary of the recent frames, p50/p99 of the keys and p50 of the rest
+  char k50[24], k99[24], hl[24], draw[24], wr[24];
+  char line[160];
+
+  int len = snprintf(
+      line, sizeof(line),
+      "key %s/%s | hl %s | draw %s | write %s | %lldB/frame | %lld frames",
+      statsFormat(k50, statsPercentile(STAT_KEY, 50)),
+      statsFormat(k99, statsPercentile(STAT_KEY, 99)),
+      statsFormat(hl, statsPercentile(STAT_SYNTAX, 50)),
+      statsFormat(draw, statsPercentile(STAT_DRAW, 50)),
+      statsFormat(wr, statsPercentile(STAT_WRITE, 50)),
+      statsPercentile(STAT_BYTES, 50), E.stats.frames);
+
+  if (len > E.screencols)
+    len = E.screencols;
+
+  abAppend(ab, line, len);
+  abAppend(ab, "\x1b[K", 3);
+  abAppend(ab, "\r\n", 2);
+}
+
+void editorRefreshScreen() {
+  long long start = E.stats.enabled ? editorNow() : 0;
+  long long t = 0;
+
+  editorScroll();
+
+  struct abuf ab = ABUF_INIT;
+
+  abAppend(&ab, "\x1b[?25l", 6);
+  // abAppend(&ab, "\x1b[2J", 4);
+  abAppend(&ab, "\x1b[H", 3);
+
+  // write(STDOUT_FILENO, "\x1b[2J", 4); // clears the screen
+  // write(STDOUT_FILENO, "\x1b[H", 3);  // moves the cursor to the top
+
+  if (E.stats.enabled)
+    t = editorNow();
+
+  editorDrawRows(&ab);
+
+  if (E.stats.enabled)
+    E.stats.cur[STAT_DRAW] += editorNow() - t;
+
+  editorDrawStatusBar(&ab);
+
+  if (E.stats.visible)
+    editorDrawStatsBar(&ab);
+
+  editorDrawMessageBar(&ab);
+
+  // write(STDOUT_FILENO, "\x1b[H", 3);
+  // E.cy now only refers the cursor position within the text file, not the
+  // window
+  char buf[32];
+  if (editorWrapOn()) // editorScroll knows where the cursor is on the screen
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", E.wrap.y + 1,
+             E.wrap.x + E.gutter + 1);
+  else
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH",
+             editorFoldRows(E.rowoff, E.cy) + 1,
+             (E.rx - E.coloff) + E.gutter + 1);
+  abAppend(&ab, buf, strlen(buf));
+
+  abAppend(&ab, "\x1b[?25h", 6);
+
+  if (E.stats.enabled)
+    t = editorNow();
+
+  editorOutput(ab.b, ab.len);
+
+  if (E.stats.enabled) {
+    E.stats.cur[STAT_WRITE] += editorNow() - t;
+    E.stats.cur[STAT_BYTES] += ab.len;
+    statsFrame(start);
+  }
+
+  abFree(&ab);
+}
+
+void editorSetStatusMessage(const char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+
+  va_end(ap);
+
+  E.statusmsg_time = editorTime();
+}
+
+// --- BATCH ---
+// batch mode (-b) applies an edit script to many files without a terminal,
+// every worker thread loads one file at a time into its own E (E is
+// thread-local), edits it with the normal row operations and saves it with
+// editorWriteFile, the script has one command per line:
+//
+//   s/from/to/   replace every from with to, any character can be the / here
+//   d/text/      delete the lines containing text
+//   d N          delete line N, or d N,M for N up to M, $ is the last line
+//   # ...        comment, so are empty lines
+
+struct batchCmd {
+  char type; // 's', 'd' for deleting matching lines, 'r' for a range
+  char *from;
+  int fromlen;
+  char *to;
+  int tolen;
+  int first, last; // 1-based line range for 'r', last is -1 for $
+};
+
+struct batchJob {
+  struct batchCmd *cmds;
+  int ncmds;
+  char **files;
+  int nfiles;
+  int next; // the next file a worker should take
+  int changed, failed;
+  long replaced, deleted;
+  pthread_mutex_t lock;
 };
 
-#define ABUF_INIT {NULL, 0}
+void batchDie(const char *script, int lineno, const char *msg) {
+  fprintf(stderr, "te: %s:%d: %s\n", script, lineno, msg);
+  exit(1);
+}
+
+int batchParseLine(char *p) {
+  // parses a line number for d, $ means the last line
+  if (*p == '$')
+    return -1;
+  return atoi(p);
+}
+
+int batchParse(char *script, struct batchCmd **cmds) {
+  // reads the script into an array of commands, returns how many there are
+  FILE *fp = fopen(script, "r");
+  if (!fp) {
+    fprintf(stderr, "te: %s: %s\n", script, strerror(errno));
+    exit(1);
+  }
+
+  int n = 0;
+  int lineno = 0;
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+
+  *cmds = NULL;
+
+  while ((linelen = getline(&line, &linecap, fp)) != -1) {
+    lineno++;
+
+    while (linelen > 0 &&
+           (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+      line[--linelen] = '\0';
+
+    if (linelen == 0 || line[0] == '#')
+      continue;
+
+    struct batchCmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+
+    if (line[0] == 'd' && (line[1] == ' ' || isdigit(line[1]) ||
+                           line[1] == '$')) {
+      char *p = line + 1;
+      while (*p == ' ')
+        p++;
+
+      cmd.type = 'r';
+      cmd.first = cmd.last = batchParseLine(p);
+
+      char *comma = strchr(p, ',');
+      if (comma)
+        cmd.last = batchParseLine(comma + 1);
+
+      if (cmd.first == 0 || cmd.last == 0)
+        batchDie(script, lineno, "bad line number");
+    } else if ((line[0] == 's' || line[0] == 'd') && line[1]) {
+      char delim = line[1];
+      char *from = line + 2;
+      char *end = strchr(from, delim);
+
+      cmd.type = line[0];
+      cmd.from = strndup(from, end ? end - from : (int)strlen(from));
+      cmd.fromlen = strlen(cmd.from);
+
+      if (cmd.fromlen == 0)
+        batchDie(script, lineno, "empty pattern");
+
+      if (cmd.type == 's') {
+        if (!end)
+          batchDie(script, lineno, "missing replacement");
+
+        char *to = end + 1;
+        end = strchr(to, delim);
+        cmd.to = strndup(to, end ? end - to : (int)strlen(to));
+        cmd.tolen = strlen(cmd.to);
+      }
+    } else {
+      batchDie(script, lineno, "unknown command");
+    }
+
+    *cmds = realloc(*cmds, sizeof(struct batchCmd) * (n + 1));
+    (*cmds)[n++] = cmd;
+  }
+
+  free(line);
+  fclose(fp);
+  return n;
+}
+
+void batchDelMatching(char *text, int len, long *deleted) {
+  // drops every row containing text, compacting E.row in a single pass
+  int i, j = 0;
+
+  for (i = 0; i < E.numrows; i++) {
+    if (memmem(E.row[i].chars, E.row[i].size, text, len)) {
+      editorFreeRow(&E.row[i]);
+      (*deleted)++;
+    } else {
+      E.row[j] = E.row[i];
+      E.row[j].idx = j;
+      j++;
+    }
+  }
+
+  if (j != E.numrows) {
+    E.lines.built = 0; // the rows are measured again if anything asks
+    E.wrap.lines.built = 0;
+    E.numrows = j;
+    E.dirty++;
+  }
+}
+
+int batchFile(struct batchJob *job, char *filename, long *replaced,
+              long *deleted) {
+  // runs the script on one file, returns 1 if it was changed, 0 if not and
+  // -1 on errors
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "te: %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+
+  editorLoad(fp);
+  fclose(fp);
+
+  int c, j;
+  for (c = 0; c < job->ncmds; c++) {
+    struct batchCmd *cmd = &job->cmds[c];
+
+    switch (cmd->type) {
+    case 's':
+      for (j = 0; j < E.numrows; j++)
+        *replaced += editorRowReplace(&E.row[j], cmd->from, cmd->fromlen,
+                                      cmd->to, cmd->tolen, NULL);
+      break;
+
+    case 'd':
+      batchDelMatching(cmd->from, cmd->fromlen, deleted);
+      break;
+
+    case 'r': {
+      int first = cmd->first == -1 ? E.numrows : cmd->first;
+      int last = cmd->last == -1 ? E.numrows : cmd->last;
+
+      if (first <= last && first <= E.numrows) {
+        if (last > E.numrows)
+          last = E.numrows;
+        editorDelRows(first - 1, last - first + 1);
+        *deleted += last - first + 1;
+      }
+    } break;
+    }
+  }
+
+  if (!E.dirty)
+    return 0;
+
+  if (editorWriteFile(filename) == -1) {
+    fprintf(stderr, "te: %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+
+  return 1;
+}
+
+void *batchWorker(void *arg) {
+  struct batchJob *job = arg;
+
+  while (1) {
+    pthread_mutex_lock(&job->lock);
+    int f = job->next++;
+    pthread_mutex_unlock(&job->lock);
+
+    if (f >= job->nfiles)
+      break;
+
+    long replaced = 0, deleted = 0;
+    int r = batchFile(job, job->files[f], &replaced, &deleted);
+
+    editorDelRows(0, E.numrows); // the row array itself is kept for the
+                                 // next file
+
+    pthread_mutex_lock(&job->lock);
+    if (r == 1)
+      job->changed++;
+    else if (r == -1)
+      job->failed++;
+    job->replaced += replaced;
+    job->deleted += deleted;
+    pthread_mutex_unlock(&job->lock);
+  }
+
+  free(E.row);
+  editorSumsFree(&E.lines);
+  editorSumsFree(&E.wrap.lines);
+  return NULL;
+}
+
+int editorBatch(char *script, char **files, int nfiles, int jobs) {
+  struct batchJob job;
+  memset(&job, 0, sizeof(job));
+
+  job.ncmds = batchParse(script, &job.cmds);
+  job.files = files;
+  job.nfiles = nfiles;
+  pthread_mutex_init(&job.lock, NULL);
+
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+
+  if (nfiles == 0) { // no files given, read their names from stdin instead
+    while ((linelen = getline(&line, &linecap, stdin)) != -1) {
+      if (linelen > 0 && line[linelen - 1] == '\n')
+        line[--linelen] = '\0';
+      if (linelen == 0)
+        continue;
+
+      job.files = realloc(job.nfiles ? job.files : NULL,
+                          sizeof(char *) * (job.nfiles + 1));
+      job.files[job.nfiles++] = strdup(line);
+    }
+    free(line);
+  }
+
+  if (jobs <= 0)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs > job.nfiles)
+    jobs = job.nfiles;
+  if (jobs < 1)
+    jobs = 1;
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+
+  int t;
+  for (t = 0; t < jobs; t++) {
+    if (pthread_create(&threads[t], NULL, batchWorker, &job) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+
+  for (t = 0; t < jobs; t++)
+    pthread_join(threads[t], NULL);
+
+  fprintf(stderr,
+          "te: %d files, %d changed, %d failed, %ld replaced, %ld lines "
+          "deleted\n",
+          job.nfiles, job.changed, job.failed, job.replaced, job.deleted);
+
+  free(threads);
+  return job.failed ? 1 : 0;
+}
+
+// --- SERVER ---
+// te -d keeps the documents open for te -a, which only passes the keys on
+// and writes back what it gets, so opening a file the server already has is
+// instant, every document is run by a thread of its own with its own E, like
+// a batch worker, its clients take turns having their view (cursor,
+// scrolling, terminal size) swapped into E, and are only sent the lines of a
+// frame that changed since the last frame they got
+
+struct serverDoc { // a document thread, known by the path of its file
+  char *path;
+  int feed[2]; // serverAttach structs for the thread
+  int dead;    // the thread failed and returned, the next client starts over
+};
 
-void abAppend(struct abuf *ab, const char *s,
-              int len) { // append the new string with is appropriate length to
-                         // be added to the abuf
-  char *new = realloc(ab->b, ab->len + len);
+// held while a client is handed to a document, and when one dies
+pthread_mutex_t serverLock = PTHREAD_MUTEX_INITIALIZER;
+__thread struct serverDoc *serverCur; // the document of this thread
 
-  if (new == NULL)
-    return;
+struct serverAttach { // a new client, as handed to the document thread
+  int fd;
+  int rows, cols;
+};
 
-  memcpy(&new[ab->len], s, len);
-  ab->b = new;
-  ab->len += len;
+char *serverPath() {
+  // where the socket is, $TE_SOCKET, or te.sock in $XDG_RUNTIME_DIR, or a
+  // socket in /tmp with the uid in its name
+  static char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  char *env = getenv("TE_SOCKET");
+  char *dir = getenv("XDG_RUNTIME_DIR");
+
+  if (env)
+    snprintf(path, sizeof(path), "%s", env);
+  else if (dir)
+    snprintf(path, sizeof(path), "%s/te.sock", dir);
+  else
+    snprintf(path, sizeof(path), "/tmp/te-%d.sock", (int)getuid());
+  return path;
 }
 
-void abFree(struct abuf *ab) {
-  free(ab->b);
-} // dont forget to free the fucking memory used by the abuf, since it uses
-  // realloc
-
-// --- OUTPUT ---
+int serverConnect(struct sockaddr_un *addr) {
+  // a connection to the server, or -1
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
 
-void editorScroll() {
-  E.rx = 0;
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", serverPath());
 
-  if (E.cy < E.numrows) {
-    E.rx = editorRowCxToRx(&E.row[E.cy],
-                           E.cx); // calculates the right value for E.rx
+  if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1) {
+    close(fd);
+    return -1;
   }
+  return fd;
+}
 
-  // to check if the cursor has moved outside of the visible window, and adjust
-  // the cursor to be inside the visible window or terminal window
-  if (E.cy < E.rowoff) {
-    // checks if the cursor is above the visible window
-    E.rowoff = E.cy;
+void serverSend(struct editorClient *c, const char *s, int len) {
+  // writes all of s to the client, one that went away is marked gone
+  while (len > 0 && !c->gone) {
+    ssize_t n = send(c->fd, s, len, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      c->gone = 1;
+      break;
+    }
+    s += n;
+    len -= n;
   }
+}
 
-  if (E.cy >= E.rowoff + E.screenrows) {
-    // checks if the cursor is past the bottom of the visible window
-    E.rowoff = E.cy - E.screenrows + 1;
+void serverOutput(const char *s, int len) {
+  // editorOutput in the document threads, a frame only sends the lines that
+  // differ from the client's last frame, the last line (the message bar and
+  // where the cursor goes) always, anything else is passed on as it is
+  if (E.server.cur == -1)
+    return; // the document is being opened, no client is looking yet
+
+  struct editorClient *c = &E.server.client[E.server.cur];
+  const char *head = "\x1b[?25l\x1b[H"; // how editorRefreshScreen starts
+  if (len < 9 || memcmp(s, head, 9)) {
+    free(c->frame); // the screen isn't what the last frame left anymore
+    c->frame = NULL;
+    c->framelen = 0;
+    serverSend(c, s, len);
+    return;
   }
 
-  // for the horizontal part, pretty much the same as the vertical one above
-  if (E.rx < E.coloff) {
-    E.coloff = E.rx;
+  struct abuf ab = ABUF_INIT;
+  abAppend(&ab, "\x1b[?25l", 6);
+
+  const char *p = s + 9, *end = s + len;
+  const char *q = c->frame ? c->frame + 9 : NULL; // the same line, last frame
+  const char *qend = q ? c->frame + c->framelen : NULL;
+  int y;
+
+  for (y = 1;; y++) {
+    const char *nl = memmem(p, end - p, "\r\n", 2);
+    const char *pe = nl ? nl : end;
+
+    int same = 0;
+    if (q) {
+      const char *qnl = memmem(q, qend - q, "\r\n", 2);
+      same = nl && qnl && qnl - q == pe - p && !memcmp(q, p, pe - p);
+      q = qnl ? qnl + 2 : NULL;
+    }
+
+    if (!same) {
+      char buf[32];
+      int n = snprintf(buf, sizeof(buf), "\x1b[%d;1H", y);
+      abAppend(&ab, buf, n);
+      abAppend(&ab, p, pe - p);
+    }
+
+    if (!nl)
+      break;
+    p = nl + 2;
   }
 
-  if (E.rx >= E.coloff + E.screencols) {
-    E.coloff = E.rx - E.screencols + 1;
+  serverSend(c, ab.b, ab.len);
+  abFree(&ab);
+
+  c->frame = realloc(c->frame, len);
+  memcpy(c->frame, s, len);
+  c->framelen = len;
+}
+
+void serverRedraw() {
+  // draws the document for every client while the one whose view is in E
+  // waits in a prompt, and gives it its view back, the clients that are gone
+  // are let go of by serverRefresh, so no client moves under the prompt
+  struct editorServer *sv = &E.server;
+  int cur = sv->cur, k;
+
+  for (k = 0; k < sv->n; k++) {
+    if (!sv->client[k].gone) {
+      serverSwap(k);
+      editorRefreshScreen();
+    }
   }
+  serverSwap(cur);
 }
 
-void editorDrawRows(struct abuf *ab) {
-  int y;
-  for (y = 0; y < E.screenrows;
-       y++) { // E.screenrows will have the appropriate screen rows size after
-              // succeeding get the values
-              // write(STDOUT_FILENO, "~", 1); // change this line
+int serverRead(char *c, int seq) {
+  // editorReadRaw for the client whose view is in E, waits for a byte as
+  // long as the terminal would (VTIME), a client that went away reads as
+  // Esc, which gets out of any prompt it left open, while a key is waited
+  // for (in a prompt) new clients are taken and rows that were loaded are
+  // drawn for everyone, the keys of the other clients wait for the prompt
+  struct editorServer *sv = &E.server;
+  struct editorClient *cl = &sv->client[sv->cur];
+
+  if (!cl->gone) {
+    struct pollfd pfd[3] = {{cl->fd, POLLIN, 0},
+                            {sv->feed, POLLIN, 0},
+                            {E.load.active ? E.load.wake[0] : -1, POLLIN, 0}};
+    if (poll(pfd, seq ? 1 : 3, 100) <= 0)
+      return 0;
+
+    if (!pfd[0].revents) {
+      int redraw = 0;
+      if (pfd[1].revents & POLLIN) {
+        serverAdd();
+        redraw = 1;
+      }
+      if ((pfd[2].revents & POLLIN) && E.load.active && editorLoadTake())
+        redraw = 1;
+      if (redraw)
+        serverRedraw();
+      return 0;
+    }
 
-    int filerow = y + E.rowoff;
-    if (filerow >= E.numrows) {
-      if (y == E.screenrows / 3 &&
-          E.numrows == 0) { // welcome screen only show when there is no
-                            // arguments included when the program is called
-        char welcome[80];
-        int welcomelen = snprintf(welcome, sizeof(welcome),
-                                  "TE editor -- version %s", KILO_VERSION);
-        if (welcomelen > E.screencols)
-          welcomelen = E.screencols;
+    ssize_t n = read(cl->fd, c, 1);
+    if (n == 1)
+      return 1;
+    if (n == -1 && errno == EINTR)
+      return 0;
+    cl->gone = 1;
+  }
 
-        int padding = (E.screencols - welcomelen) / 2;
+  if (seq)
+    return 0;
+  *c = '\x1b';
+  return 1;
+}
 
-        if (padding) {
-          abAppend(ab, "~", 1);
-          padding--;
-        }
+void serverSwap(int k) {
+  // puts the view of client k into E, and the one that was there back into
+  // its client, -1 leaves E without one
+  struct editorServer *sv = &E.server;
+  struct editorView *v;
 
-        while (padding-- >= 0) { // makes the welcome screen text centered
-          abAppend(ab, " ", 1);
-        }
+  if (sv->cur == k)
+    return;
 
-        abAppend(ab, welcome, welcomelen); // prints the welcome screen text
-      } else {
-        abAppend(ab, "~", 1);
-      }
-    } else {
-      int len =
-          E.row[filerow].rsize -
-          E.coloff; // draws the input text to the buffer ab on
-                    // each line of erow, now coloff serve as an index of the
-                    // chars each time each row is displayed to the screen
-
-      if (len < 0)
-        len = 0;
-      if (len > E.screencols)
-        len = E.screencols;
-      char *c = &E.row[filerow].render[E.coloff];
+  if (sv->cur != -1) {
+    v = &sv->client[sv->cur].view;
+    v->cx = E.cx;
+    v->cy = E.cy;
+    v->rx = E.rx;
+    v->rowoff = E.rowoff;
+    v->coloff = E.coloff;
+    v->screenrows = E.screenrows;
+    v->screencols = E.screencols;
+    v->linenumbers = E.linenumbers;
+    v->wrap = E.wrap.enabled;
+    v->sub = E.wrap.sub;
+    v->sel = E.sel;
+    v->cursors = E.cursors;
+    v->edits = E.edits;
+    memcpy(v->statusmsg, E.statusmsg, sizeof(v->statusmsg));
+    v->statusmsg_time = E.statusmsg_time;
+    memset(&E.cursors, 0, sizeof(E.cursors)); // they belong to the view now
+  }
 
-      unsigned char *hl =
-          &E.row[filerow].hl[E.coloff]; // grab the hl index based on the coloff
+  sv->cur = k;
+  E.undo_typing = -1; // typing of two clients never makes one undo step
+  if (k == -1)
+    return;
 
-      int current_color = -1; // -1 for default color
+  v = &sv->client[k].view;
+  E.cx = v->cx;
+  E.cy = v->cy;
+  E.rx = v->rx;
+  E.rowoff = v->rowoff;
+  E.coloff = v->coloff;
+  E.screenrows = v->screenrows;
+  E.screencols = v->screencols;
+  E.linenumbers = v->linenumbers;
+  E.wrap.enabled = v->wrap;
+  E.wrap.sub = v->sub;
+  E.sel = v->sel;
+  E.cursors = v->cursors;
+  memcpy(E.statusmsg, v->statusmsg, sizeof(E.statusmsg));
+  E.statusmsg_time = v->statusmsg_time;
+
+  // the other clients may have changed the rows under the view since then,
+  // the cursor and the mark are kept inside the document, and the extra
+  // cursors of Ctrl-D are dropped
+  if (E.cy > E.numrows)
+    E.cy = E.numrows;
+  int size = E.cy < E.numrows ? E.row[E.cy].size : 0;
+  if (E.cx > size)
+    E.cx = size;
+
+  if (E.sel.my > E.numrows)
+    E.sel.my = E.numrows;
+  size = E.sel.my < E.numrows ? E.row[E.sel.my].size : 0;
+  if (E.sel.mx > size)
+    E.sel.mx = size;
+
+  if (E.cursors.n && v->edits != E.edits)
+    editorCursorsClear();
+}
 
-      int j;
-      for (j = 0; j < len; j++) {
-        if (iscntrl(c[j])) { // checks if the current char is control char
-          char sym = (c[j] <= 26)
-                         ? '@' + c[j]
-                         : '?'; // if the char <= 26 print @_ otherwise ?
+void serverDetach() {
+  // Ctrl-Q of a client, the document stays open for the next one
+  struct editorClient *c = &E.server.client[E.server.cur];
+  serverSend(c, "\x1b[2J\x1b[H", 7);
+  c->gone = 1;
+}
 
-          abAppend(ab, "\x1b[7m", 4); // invert the color
-          abAppend(ab, &sym, 1);
-          abAppend(ab, "\x1b[m", 3); // put back to normal
+void serverAdd() {
+  // takes a new client from the server, and draws its first frame
+  struct editorServer *sv = &E.server;
+  struct serverAttach a;
 
-          if (current_color !=
-              -1) { // if the color not the normal ones, set it back
-                    // since \x1b[m reset all color or highlight
-            char buf[16];
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-            abAppend(ab, buf, clen);
-          }
+  if (read(sv->feed, &a, sizeof(a)) != sizeof(a))
+    return;
 
-        } else if (hl[j] == HL_NORMAL) { // if its HL_NORMAL, use \x1b[39m
-          if (current_color !=
-              -1) { // and if the current_color is not -1, set it back
-            abAppend(ab, "\x1b[39m", 5);
-            current_color = -1;
-          }
+  if (sv->n == sv->cap) {
+    sv->cap = sv->cap ? sv->cap * 2 : 4;
+    sv->client = realloc(sv->client, sizeof(struct editorClient) * sv->cap);
+  }
 
-          abAppend(ab, &c[j], 1);
-        } else { // otherwise use the appropriate color
-          int color = editorSyntaxToColor(hl[j]);
+  struct editorClient *c = &sv->client[sv->n++];
+  memset(c, 0, sizeof(*c));
+  c->fd = a.fd;
+  c->view.screenrows = a.rows - 2; // like initEditorHeadless
+  c->view.screencols = a.cols;
+  snprintf(c->view.statusmsg, sizeof(c->view.statusmsg),
+           "HELP: Ctrl-Q detach | Ctrl-S save | Ctrl-F find | %d attached",
+           sv->n);
+  c->view.statusmsg_time = time(NULL);
+}
 
-          if (color != current_color) { // update the color
-            current_color = color;
+void serverRefresh() {
+  // lets go of the clients that are gone, and draws the document for the
+  // rest, each in its own view
+  struct editorServer *sv = &E.server;
+  int k;
 
-            char buf[16];
+  serverSwap(-1);
 
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+  for (k = 0; k < sv->n;) {
+    struct editorClient *c = &sv->client[k];
+    if (!c->gone) {
+      k++;
+      continue;
+    }
 
-            abAppend(ab, buf, clen);
-          }
-          abAppend(ab, &c[j], 1);
-        }
-      }
+    close(c->fd);
+    free(c->frame);
+    free(c->view.cursors.at);
+    sv->client[k] = sv->client[--sv->n];
+  }
 
-      abAppend(ab, "\x1b[39m", 5); // make the text color is reset to default
-    }
+  for (k = 0; k < sv->n; k++) {
+    serverSwap(k);
+    editorRefreshScreen();
+  }
+}
 
-    abAppend(ab, "\x1b[K", 3); // clean the remaining length of the line
+void serverDie(const char *s) {
+  // die() in a document thread, tells its clients, and the ones on their way
+  // to it, what went wrong, and ends only this thread
+  static __thread int dying; // something in here died as well
+  char msg[256];
+  int len = snprintf(msg, sizeof(msg), "\x1b[2J\x1b[Hte: %s: %s: %s\r\n",
+                     serverCur->path, s, strerror(errno));
+  if (len >= (int)sizeof(msg))
+    len = sizeof(msg) - 1;
+
+  if (!dying) {
+    dying = 1;
+    int k;
+    for (k = 0; k < E.server.n; k++) {
+      serverSend(&E.server.client[k], msg, len);
+      close(E.server.client[k].fd);
+    }
+    E.server.n = 0;
+    E.server.cur = -1;
+    editorLoadStop(); // its thread uses this thread's E
+  }
 
-    // the last line of the terminal screen seems not to print a tilde, this is
-    // a bug on our code when it reaches the last line, it prints the \r\n and
-    // causes the terminal to scroll in order to make room for the new blank
-    // line
+  pthread_mutex_lock(&serverLock); // nobody is handed over after this
+  serverCur->dead = 1;
+  pthread_mutex_unlock(&serverLock);
 
-    abAppend(ab, "\r\n", 2);
+  struct serverAttach a;
+  fcntl(E.server.feed, F_SETFL, O_NONBLOCK);
+  while (read(E.server.feed, &a, sizeof(a)) == sizeof(a)) {
+    if (send(a.fd, msg, len, MSG_NOSIGNAL) == -1) {
+      // it went away already
+    }
+    close(a.fd);
   }
+  close(E.server.feed);
+
+  pthread_exit(NULL);
 }
 
-void editorDrawStatusBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[7m", 4);
+void *serverDoc(void *arg) {
+  // the thread of a document, opens the file and then serves its clients
+  // one key at a time, while the rest of the file is loaded in between
+  struct serverDoc *doc = arg;
+  serverCur = doc;
+
+  initEditorHeadless(24, 80); // every client brings the size of its own
+  E.server.enabled = 1;
+  E.server.feed = doc->feed[0];
+
+  editorSymbolsStart();
+  if (access(doc->path, F_OK) == 0) {
+    editorOpen(doc->path);
+  } else { // a new file, created by the first save
+    E.filename = strdup(doc->path);
+    editorSelectSyntaxHighlight();
+  }
 
-  char status[80];
-  char rstatus[80];
+  struct pollfd *pfd = NULL;
+  int cap = 0;
 
-  int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
-                     E.filename ? E.filename : "[No Name]", E.numrows,
-                     E.dirty ? "(modified)" : "");
+  while (1) {
+    struct editorServer *sv = &E.server;
+    if (sv->n + 2 > cap) {
+      cap = (sv->n + 2) * 2;
+      pfd = realloc(pfd, sizeof(struct pollfd) * cap);
+    }
 
-  int rlen =
-      snprintf(rstatus, sizeof(rstatus), "%s | %d,%d",
-               E.syntax ? E.syntax->filetype : "no ft", E.cy + 1, E.rx + 1);
+    int n = 0, wake = -1, k;
+    pfd[n++] = (struct pollfd){sv->feed, POLLIN, 0};
+    if (E.load.active) {
+      wake = n;
+      pfd[n++] = (struct pollfd){E.load.wake[0], POLLIN, 0};
+    }
+    int first = n, clients = sv->n;
+    for (k = 0; k < clients; k++)
+      pfd[n++] = (struct pollfd){sv->client[k].fd, POLLIN, 0};
 
-  if (len > E.screencols)
-    len = E.screencols - 1;
+    if (poll(pfd, n, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      die("poll");
+    }
 
-  abAppend(ab, status, len);
+    if (pfd[0].revents & POLLIN)
+      serverAdd();
 
-  while (len < E.screencols) {
-    if (E.screencols - len == rlen) {
-      abAppend(ab, rstatus, rlen);
-      break;
-    } else {
-      abAppend(ab, " ", 1);
-      len++;
+    if (wake != -1 && (pfd[wake].revents & POLLIN) && E.load.active)
+      editorLoadTake();
+
+    for (k = 0; k < clients; k++) {
+      if (pfd[first + k].revents && !sv->client[k].gone) {
+        serverSwap(k);
+        editorProcessKeypress();
+      }
     }
+
+    serverRefresh();
   }
 
-  abAppend(ab, "\x1b[m", 3);
-  abAppend(ab, "\r\n", 2);
+  return NULL;
 }
 
-void editorDrawMessageBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[K", 3); // clears the line
+int editorServe() {
+  // te -d, accepts the clients and hands each to the thread of its
+  // document, starting the thread if nobody had the file open yet
+  struct sockaddr_un addr;
+  int fd = serverConnect(&addr);
+  if (fd != -1) {
+    fprintf(stderr, "te: a server is already running at %s\n", addr.sun_path);
+    return 1;
+  }
+  unlink(addr.sun_path); // left behind by a server that didn't exit cleanly
+
+  int ls = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  mode_t mask = umask(077); // only for the user who started it
+  if (ls == -1 || bind(ls, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(ls, 16) == -1) {
+    perror(addr.sun_path);
+    return 1;
+  }
+  umask(mask);
 
-  int msglen = strlen(E.statusmsg);
+  struct serverDoc **docs = NULL;
+  int ndocs = 0;
 
-  if (msglen > E.screencols)
-    msglen = E.screencols;
-  if (msglen && time(NULL) - E.statusmsg_time < 5)
-    abAppend(ab, E.statusmsg, msglen);
-}
+  while (1) {
+    fd = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      perror("accept");
+      return 1;
+    }
 
-void editorRefreshScreen() {
-  editorScroll();
+    struct ucred cred; // even if the socket is in a shared directory
+    socklen_t credlen = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == -1 ||
+        cred.uid != getuid()) {
+      close(fd);
+      continue;
+    }
 
-  struct abuf ab = ABUF_INIT;
+    // the client sends its terminal size and the absolute path of the file
+    // on the first line, the keys come after that
+    struct timeval tv = {1, 0}; // a client that says nothing holds up all
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char line[PATH_MAX + 64];
+    int len = 0;
+    while (len < (int)sizeof(line) - 1 && read(fd, &line[len], 1) == 1 &&
+           line[len] != '\n')
+      len++;
+    line[len] = '\0';
 
-  abAppend(&ab, "\x1b[?25l", 6);
-  // abAppend(&ab, "\x1b[2J", 4);
-  abAppend(&ab, "\x1b[H", 3);
+    int rows, cols, at = 0;
+    if (sscanf(line, "%d %d %n", &rows, &cols, &at) != 2 || at == 0 ||
+        line[at] != '/' || rows < 3 || cols < 1) {
+      close(fd);
+      continue;
+    }
+    char *path = &line[at];
 
-  // write(STDOUT_FILENO, "\x1b[2J", 4); // clears the screen
-  // write(STDOUT_FILENO, "\x1b[H", 3);  // moves the cursor to the top
+    if (access(path, F_OK) == 0 && access(path, R_OK) == -1) {
+      dprintf(fd, "te: %s: %s\r\n", path, strerror(errno));
+      close(fd);
+      continue;
+    }
 
-  editorDrawRows(&ab);
+    int k;
+    for (k = 0; k < ndocs && strcmp(docs[k]->path, path); k++)
+      ;
+
+    pthread_mutex_lock(&serverLock);
+    if (k < ndocs && docs[k]->dead) { // its thread failed, it starts over
+      close(docs[k]->feed[1]);
+      free(docs[k]->path);
+      free(docs[k]);
+      docs[k] = docs[--ndocs];
+      k = ndocs;
+    }
 
-  editorDrawStatusBar(&ab);
+    if (k == ndocs) { // documents are never closed, the next client of the
+                      // file gets it as it was left
+      struct serverDoc *doc = malloc(sizeof(struct serverDoc));
+      doc->path = strdup(path);
+      doc->dead = 0;
+      pthread_t thread;
+      if (pipe2(doc->feed, O_CLOEXEC) == -1 ||
+          pthread_create(&thread, NULL, serverDoc, doc) != 0) {
+        perror("pthread_create");
+        return 1;
+      }
+      pthread_detach(thread);
 
-  editorDrawMessageBar(&ab);
+      docs = realloc(docs, sizeof(struct serverDoc *) * (ndocs + 1));
+      docs[ndocs++] = doc;
+    }
 
-  // write(STDOUT_FILENO, "\x1b[H", 3);
-  // E.cy now only refers the cursor position within the text file, not the
-  // window
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1,
-           (E.rx - E.coloff) + 1);
-  abAppend(&ab, buf, strlen(buf));
+    struct serverAttach a = {fd, rows, cols};
+    if (write(docs[k]->feed[1], &a, sizeof(a)) != sizeof(a))
+      close(fd);
+    pthread_mutex_unlock(&serverLock);
+  }
+}
 
-  abAppend(&ab, "\x1b[?25h", 6);
+int editorAttach(char *filename) {
+  // te -a, passes the keys to the server and writes what it sends back to
+  // the terminal, until the server lets go of the connection (Ctrl-Q)
+  struct sockaddr_un addr;
+  int fd = serverConnect(&addr);
+  if (fd == -1) {
+    fprintf(stderr, "te: no server at %s, start one with te -d\n",
+            addr.sun_path);
+    return 1;
+  }
 
-  write(STDOUT_FILENO, ab.b, ab.len);
-  abFree(&ab);
-}
+  // the server has its own working directory, so the path has to be
+  // absolute, a file that doesn't exist yet can't be resolved
+  char *path = realpath(filename, NULL);
+  if (path == NULL && filename[0] == '/') {
+    path = strdup(filename);
+  } else if (path == NULL) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+      die("getcwd");
+    path = malloc(strlen(cwd) + strlen(filename) + 2);
+    sprintf(path, "%s/%s", cwd, filename);
+  }
+  if (strchr(path, '\n')) {
+    fprintf(stderr, "te: %s: the server can't take this name\n", filename);
+    return 1;
+  }
 
-void editorSetStatusMessage(const char *fmt, ...) {
-  va_list ap;
+  enableRawMode();
 
-  va_start(ap, fmt);
-  vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+  int rows, cols;
+  if (getWindowSize(&rows, &cols) == -1)
+    die("getWindowSize");
+  dprintf(fd, "%d %d %s\n", rows, cols, path);
+  free(path);
 
-  va_end(ap);
+  char buf[KILO_FOLLOW_CHUNK];
+  struct pollfd pfd[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+
+  while (1) {
+    if (poll(pfd, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      die("poll");
+    }
+
+    ssize_t n;
+    if ((pfd[0].revents & POLLIN) &&
+        (n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+      ssize_t off = 0, w;
+      while (off < n && (w = send(fd, buf + off, n - off, MSG_NOSIGNAL)) > 0)
+        off += w;
+    }
+
+    if (pfd[1].revents) {
+      n = read(fd, buf, sizeof(buf));
+      if (n <= 0)
+        break; // detached, or the server is gone
+      ssize_t off = 0, w;
+      while (off < n && (w = write(STDOUT_FILENO, buf + off, n - off)) > 0)
+        off += w;
+    }
+  }
 
-  E.statusmsg_time = time(NULL);
+  return 0;
 }
 
 // --- INIT ---
 
-void initEditor() {
+void initEditorHeadless(int rows, int cols) {
   // sets the initial location of the cursor to be in (0,0) -> leftmost and
-  // topmost of the screen
+  // topmost of the screen, for a terminal of the given size, without asking
+  // any terminal for it
 
   E.cx = 0;
   E.cy = 0;
@@ -1441,6 +9218,7 @@ void initEditor() {
   E.rowoff = 0; // set offset of scrolling to 0
   E.coloff = 0; // same as rowoff, it's now column
   E.numrows = 0;
+  E.rowcap = 0;
   E.row = NULL;
 
   E.dirty = 0;
@@ -1451,23 +9229,209 @@ void initEditor() {
 
   E.syntax = NULL;
 
-  if (getWindowSize(&E.screenrows, &E.screencols) == -1)
+  E.undo = NULL;
+  E.nundo = 0;
+  E.undo_typing = -1;
+
+  memset(&E.lines, 0, sizeof(E.lines));
+  memset(&E.wrap, 0, sizeof(E.wrap)); // off until Ctrl-W or -w
+  memset(&E.symbols, 0, sizeof(E.symbols)); // enabled by editorSymbolsStart
+  memset(&E.words, 0, sizeof(E.words));     // built by the first Ctrl-P
+  memset(&E.cursors, 0, sizeof(E.cursors)); // added by Ctrl-D
+  memset(&E.sel, 0, sizeof(E.sel));         // nothing selected
+  memset(&E.yank, 0, sizeof(E.yank));       // nothing to paste
+  memset(&E.search, 0, sizeof(E.search));   // nothing searched for yet
+  memset(&E.brackets, 0, sizeof(E.brackets)); // built by the first Ctrl-O
+  memset(&E.folds, 0, sizeof(E.folds));
+  memset(&E.server, 0, sizeof(E.server)); // enabled in the threads of te -d
+  E.server.cur = -1;
+  E.edits = 0;
+  E.linenumbers = 0;
+  E.gutter = 0;
+
+  E.follow.fd = -1; // follow mode is off until -f is given
+  E.follow.wd = -1;
+
+  memset(&E.load, 0, sizeof(E.load)); // set by editorOpen for compressed files
+
+  memset(&E.pager, 0, sizeof(E.pager)); // pager mode is off until -R is given
+  E.pager.match_line = -1;
+  memset(&E.hex, 0, sizeof(E.hex)); // and so is hex view until -x
+  E.hex.fd = -1;
+
+  E.screenrows = rows - 2; // to make room for the status bar and status
+                           // message
+  E.screencols = cols;
+}
+
+void initEditor() {
+  int rows, cols;
+
+  if (getWindowSize(&rows, &cols) == -1)
     die("getWindowSize");
 
-  E.screenrows -= 2; // to make room for the status bar and status message
+  initEditorHeadless(rows, cols);
+}
+
+void usage() {
+  fprintf(stderr,
+          "Usage: te [-f | -R | -x] [-n] [-w] [-t trace] [-S stats] [file]\n"
+          "       te -b script [-j jobs] [file...]\n"
+          "       te -d | te -a file\n"
+          "       te -p trace [-s ROWSxCOLS] [file]\n"
+          "  -f  follow the file as it grows, like tail -f\n"
+          "  -R  read-only pager, for files too big to edit\n"
+          "  -x  hex view, typing overwrites bytes in place\n"
+          "  -n  show line numbers, Ctrl-N shows or hides them\n"
+          "  -w  wrap long lines instead of scrolling sideways, Ctrl-W\n"
+          "      turns it on or off\n"
+          "  -b  apply the edit script to the files without a terminal, the\n"
+          "      file names are read from stdin if none are given\n"
+          "  -j  number of worker threads for -b, defaults to the CPU count\n"
+          "  -d  run a server that keeps the files it opened loaded\n"
+          "  -a  edit the file in the server, opening one it has already\n"
+          "      loaded is instant, several terminals can edit it at once\n"
+          "  -S  measure what every frame costs and write the histograms\n"
+          "      to the given file on exit, Ctrl-T shows a summary\n"
+          "  -t  record the keys typed, with their timing, to a trace file\n"
+          "  -p  replay a trace without a terminal and report the latency\n"
+          "      of every key, -s ROWSxCOLS overrides the recorded size\n");
+  exit(1);
 }
 
 int main(int argc, char *argv[]) {
-  enableRawMode();
-  initEditor(); // searches the rows and cols for the editor
+  int follow = 0;
+  int pager = 0;
+  int hex = 0;
+  int linenumbers = 0;
+  int wrap = 0;
+  int serve = 0;
+  int attach = 0;
+  char *script = NULL;
+  int jobs = 0;
+  char *record = NULL;
+  char *replay = NULL;
+  char *stats = NULL;
+  int rows = 0, cols = 0;
+  char **files = malloc(sizeof(char *) * argc);
+  int nfiles = 0;
 
-  if (argc >= 2) { // if not te.c not called with argument, editorOpen will not
-                   // be called
-    editorOpen(argv[1]);
+  int i;
+  for (i = 1; i < argc; i++) { // parse the options before the file name
+    if (!strcmp(argv[i], "-f"))
+      follow = 1;
+    else if (!strcmp(argv[i], "-n"))
+      linenumbers = 1;
+    else if (!strcmp(argv[i], "-w"))
+      wrap = 1;
+    else if (!strcmp(argv[i], "-R"))
+      pager = 1;
+    else if (!strcmp(argv[i], "-x"))
+      hex = 1;
+    else if (!strcmp(argv[i], "-d"))
+      serve = 1;
+    else if (!strcmp(argv[i], "-a"))
+      attach = 1;
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      script = argv[++i];
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      record = argv[++i];
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+      replay = argv[++i];
+    else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+      stats = argv[++i];
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &rows, &cols) != 2 || rows < 3 ||
+          cols < 1)
+        usage();
+    }
+    else if (argv[i][0] == '-')
+      usage();
+    else
+      files[nfiles++] = argv[i];
   }
 
-  editorSetStatusMessage(
-      "HELP: Ctrl-Q to quit | Ctrl-S to save | Ctrl-F to find");
+  // a command (Ctrl-E), a compressor or a client of te -d that goes away
+  // makes writing to it fail with EPIPE instead of killing every document,
+  // it is set once, the threads of -b and -d must not swap it around
+  signal(SIGPIPE, SIG_IGN);
+
+  if (script) // batch mode never touches the terminal
+    return editorBatch(script, files, nfiles, jobs);
+
+  if (nfiles > 1)
+    usage(); // only batch mode takes more than one file
+
+  char *filename = nfiles ? files[0] : NULL;
+
+  if (serve) { // the server has no terminal, its clients bring their own
+    if (filename || attach)
+      usage();
+    editorOutput = serverOutput;
+    return editorServe();
+  }
+
+  if (attach) { // the editing happens in the server
+    if (filename == NULL)
+      usage();
+    return editorAttach(filename);
+  }
+
+  if ((follow || pager || hex) && filename == NULL)
+    usage(); // nothing to follow or to page through
+  if (follow + pager + hex > 1)
+    usage();
+  if (replay && (follow || record))
+    usage();
+
+  if (replay) { // no terminal at all, the trace says how big it was
+    traceReplayStart(replay);
+    initEditorHeadless(rows ? rows : E.trace.rows, cols ? cols : E.trace.cols);
+    editorOutput = traceSink;
+  } else {
+    enableRawMode();
+    initEditor(); // searches the rows and cols for the editor
+  }
+
+  if (record)
+    traceRecordStart(record, E.screenrows + 2, E.screencols);
+
+  E.linenumbers = linenumbers;
+  E.wrap.enabled = wrap;
+
+  if (stats)
+    statsStart(stats);
+
+  // definitions are indexed as the rows are loaded
+  if (!pager && !follow && !hex)
+    editorSymbolsStart();
+
+  if (pager) {
+    editorPagerOpen(filename);
+  } else if (hex) {
+    editorHexOpen(filename);
+  } else if (filename) { // if not te.c not called with argument, editorOpen
+                         // will not be called
+    editorOpen(filename);
+  }
+
+  if (E.symbols.enabled) // and the files next to it in the background
+    editorIndexerStart();
+
+  if (follow)
+    editorFollowStart();
+
+  if (pager)
+    editorSetStatusMessage("HELP: q to quit | Ctrl-F to find | g/G for top or "
+                           "bottom");
+  else if (hex)
+    editorSetStatusMessage("HELP: Ctrl-Q quit | Ctrl-S save | Tab hex/text | "
+                           "Ctrl-G offset | Ctrl-Z undo");
+  else
+    editorSetStatusMessage("HELP: Ctrl-Q quit | Ctrl-S save | Ctrl-F find | "
+                           "Ctrl-R replace | Ctrl-Z undo");
 
   while (1) {
     editorRefreshScreen();